@@ -0,0 +1,69 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    packTileBundle.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Packs the map-tile cache directory of a vtkOsmLayer
+// (e.g. ~/.vtkmap/tile.openstreetmap.org) into a tile bundle file,
+// to be loaded with vtkOsmLayer::SetTileBundleFile().
+
+#include "vtkMapTileBundle.h"
+
+#include <vtkNew.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+#include <iostream>
+#include <string>
+
+// ------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool showHelp = false;
+  std::string directory;
+  std::string output;
+
+  vtksys::CommandLineArguments arg;
+  arg.Initialize(argc, argv);
+  arg.AddArgument("-h", vtksys::CommandLineArguments::NO_ARGUMENT, &showHelp,
+    "show help message");
+  arg.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT,
+    &showHelp, "show help message");
+  arg.AddArgument("-d", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &directory, "map-tile cache directory to pack");
+  arg.AddArgument("-o", vtksys::CommandLineArguments::SPACE_ARGUMENT, &output,
+    "output bundle file");
+
+  if (!arg.Parse() || showHelp || directory.empty() || output.empty())
+  {
+    std::cout << "\n"
+              << "Usage: packTileBundle -d cachedirectory -o file.bundle"
+              << "\n\n"
+              << arg.GetHelp() << std::endl;
+    return -1;
+  }
+
+  if (!vtkMapTileBundle::Pack(directory, output))
+  {
+    std::cerr << "Failed to write " << output << std::endl;
+    return 1;
+  }
+
+  // Check result
+  vtkNew<vtkMapTileBundle> bundle;
+  if (!bundle->Open(output))
+  {
+    return 1;
+  }
+  std::cout << "Wrote " << bundle->GetNumberOfTiles() << " tiles to "
+            << output << std::endl;
+  return 0;
+}
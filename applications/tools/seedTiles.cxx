@@ -0,0 +1,531 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    seedTiles.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// Downloads every map tile covering a lat/lon bounding box or a GeoJSON
+// polygon, over a range of zoom levels, into the map-tile cache directory
+// of a vtkOsmLayer (e.g. ~/.vtkmap/tiles/tile.openstreetmap.org), and
+// optionally packs the directory into a tile bundle. Tiles are requested
+// from several threads, at most RATE requests per second. Completed tiles
+// are appended to a progress journal, so that an interrupted run resumes
+// where it stopped when restarted with the same arguments.
+
+#include "vtkMap.h"
+#include "vtkMapTileBundle.h"
+#include "vtkMapTileCoverage.h"
+#include "vtkMapTileKey.h"
+#include "vtkOsmLayer.h"
+
+#include <vtkAtomic.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkRenderer.h>
+#include <vtk_jsoncpp.h>
+#include <vtksys/CommandLineArguments.hxx>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef vtkMapTileCoverage::Ring Ring;
+
+// ------------------------------------------------------------
+// Osm layer downloading tiles from several threads, through the request
+// and cache logic of vtkOsmLayer
+class vtkSeedOsmLayer : public vtkOsmLayer
+{
+public:
+  static vtkSeedOsmLayer* New();
+  vtkTypeMacro(vtkSeedOsmLayer, vtkOsmLayer);
+
+  enum TileStatus
+  {
+    Cached = 0,  // already in the cache directory
+    Downloaded,  // new image, or expired image replaced
+    Unavailable, // not provided by the server
+    Failed       // transport error, retried on next run
+  };
+
+  // Seeds tiles (packed ZoomRowCol keys) with numberOfThreads threads,
+  // at most rate requests per second (no limit if 0)
+  void Seed(const std::vector<vtkTypeUInt64>& tiles, int numberOfThreads,
+    double rate, FILE* journal);
+
+  void WorkerThreadExecute();
+  TileStatus SeedTile(vtkMapTileSpecInternal& spec);
+  void PrintReport(std::ostream& os, bool final);
+
+protected:
+  vtkSeedOsmLayer();
+  ~vtkSeedOsmLayer() override;
+
+  // Blocks until the rate limit allows one more request
+  void WaitForRequestTime();
+
+  const std::vector<vtkTypeUInt64>* Tiles;
+  vtkAtomic<vtkTypeInt64> NextTile;
+  FILE* Journal;
+  std::string Host;
+  std::chrono::steady_clock::duration RequestInterval;
+  std::chrono::steady_clock::time_point NextRequestTime;
+  std::chrono::steady_clock::time_point StartTime;
+  std::chrono::steady_clock::time_point LastReportTime;
+  vtkSimpleMutexLock* Lock; // protects all members below it
+  vtkTypeInt64 Counts[4];   // number of tiles by TileStatus
+  vtkTypeUInt64 DownloadedBytes;
+
+private:
+  vtkSeedOsmLayer(const vtkSeedOsmLayer&);            // Not implemented
+  vtkSeedOsmLayer& operator=(const vtkSeedOsmLayer&); // Not implemented
+};
+
+vtkStandardNewMacro(vtkSeedOsmLayer);
+
+// ------------------------------------------------------------
+vtkSeedOsmLayer::vtkSeedOsmLayer()
+  : Tiles(nullptr)
+  , NextTile(0)
+  , Journal(nullptr)
+  , RequestInterval(0)
+  , DownloadedBytes(0)
+{
+  this->Lock = vtkSimpleMutexLock::New();
+  std::fill(this->Counts, this->Counts + 4, 0);
+}
+
+// ------------------------------------------------------------
+vtkSeedOsmLayer::~vtkSeedOsmLayer()
+{
+  this->Lock->Delete();
+}
+
+// ------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE StaticWorkerThreadExecute(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  static_cast<vtkSeedOsmLayer*>(info->UserData)->WorkerThreadExecute();
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+// ------------------------------------------------------------
+void vtkSeedOsmLayer::Seed(const std::vector<vtkTypeUInt64>& tiles,
+  int numberOfThreads, double rate, FILE* journal)
+{
+  this->Tiles = &tiles;
+  this->NextTile = 0;
+  this->Journal = journal;
+  this->Host = vtkMapTileDownloader::GetHost(this->MapTileServer);
+  this->RequestInterval = std::chrono::steady_clock::duration::zero();
+  if (rate > 0.0)
+  {
+    this->RequestInterval =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+  }
+  this->StartTime = std::chrono::steady_clock::now();
+  this->NextRequestTime = this->StartTime;
+  this->LastReportTime = this->StartTime;
+
+  // Let the adaptive concurrency limit of the server grow up to the
+  // number of threads
+  this->Downloader->SetHostConcurrencyCap(this->Host, numberOfThreads);
+
+  vtkNew<vtkMultiThreader> threader;
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(StaticWorkerThreadExecute, this);
+  threader->SingleMethodExecute();
+
+  this->DiskCache->FlushWrites();
+}
+
+// ------------------------------------------------------------
+void vtkSeedOsmLayer::WorkerThreadExecute()
+{
+  const std::vector<vtkTypeUInt64>& tiles = *this->Tiles;
+  for (vtkTypeInt64 i = this->NextTile++;
+       i < static_cast<vtkTypeInt64>(tiles.size()); i = this->NextTile++)
+  {
+    vtkMapTileSpecInternal spec;
+    vtkTypeUInt64 key = tiles[i];
+    int numTiles = 1 << vtkMapTileKey::Zoom(key);
+    spec.ZoomRowCol[0] = vtkMapTileKey::Zoom(key);
+    spec.ZoomRowCol[1] = vtkMapTileKey::X(key);
+    spec.ZoomRowCol[2] = vtkMapTileKey::Y(key);
+    spec.ZoomXY[0] = spec.ZoomRowCol[0];
+    spec.ZoomXY[1] = spec.ZoomRowCol[1];
+    spec.ZoomXY[2] = numTiles - 1 - spec.ZoomRowCol[2];
+    TileStatus status = this->SeedTile(spec);
+
+    this->Lock->Lock();
+    ++this->Counts[status];
+    if (status != Failed && this->Journal)
+    {
+      fprintf(this->Journal, "%llu\n", static_cast<unsigned long long>(key));
+      fflush(this->Journal);
+    }
+    std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+    if (now - this->LastReportTime > std::chrono::seconds(5))
+    {
+      this->LastReportTime = now;
+      this->PrintReport(std::cout, false);
+    }
+    this->Lock->Unlock();
+  }
+}
+
+// ------------------------------------------------------------
+vtkSeedOsmLayer::TileStatus vtkSeedOsmLayer::SeedTile(
+  vtkMapTileSpecInternal& spec)
+{
+  std::stringstream oss;
+  this->MakeFileSystemPath(spec, oss);
+  std::string filename = oss.str();
+
+  // Expired images are revalidated, so that the seeded cache is current
+  vtkMapTileDownloader::Request request;
+  std::vector<unsigned char> data;
+  bool revalidate = false;
+  if (this->FindTileImage(spec, filename, data))
+  {
+    revalidate = data.empty() && this->MakeRevalidationRequest(spec, request);
+    if (!revalidate)
+    {
+      return Cached;
+    }
+  }
+  else if (this->IsTileUnavailable(spec))
+  {
+    return Unavailable;
+  }
+  else if (!this->ClaimTileDownload(spec, this->DiskCache->GetClaimTimeout()))
+  {
+    // Downloaded by another process sharing the cache directory, or
+    // still being downloaded after the timeout
+    if (this->IsTileUnavailable(spec))
+    {
+      return Unavailable;
+    }
+    return this->FindTileImage(spec, filename, data) ? Cached : Failed;
+  }
+
+  this->MakeUrl(spec, oss);
+  request.Url = oss.str();
+  this->WaitForRequestTime();
+  while (!this->Downloader->BeginRequest(this->Host))
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  this->Downloader->Download(request);
+  this->Downloader->EndRequest(this->Host);
+
+  bool saved = revalidate
+    ? this->SaveRevalidatedImage(spec, request, filename)
+    : this->SaveImageFile(spec, request, filename);
+  if (saved)
+  {
+    this->Lock->Lock();
+    this->DownloadedBytes += request.Data.size();
+    this->Lock->Unlock();
+    return Downloaded;
+  }
+  if (revalidate)
+  {
+    // Still current, or kept until the next run
+    return request.Success ? Cached : Failed;
+  }
+  return request.Success ? Unavailable : Failed;
+}
+
+// ------------------------------------------------------------
+void vtkSeedOsmLayer::WaitForRequestTime()
+{
+  if (this->RequestInterval == std::chrono::steady_clock::duration::zero())
+  {
+    return;
+  }
+
+  // Reserve the next request time, then wait for it
+  this->Lock->Lock();
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point requestTime =
+    std::max(now, this->NextRequestTime);
+  this->NextRequestTime = requestTime + this->RequestInterval;
+  this->Lock->Unlock();
+  std::this_thread::sleep_until(requestTime);
+}
+
+// ------------------------------------------------------------
+void vtkSeedOsmLayer::PrintReport(std::ostream& os, bool final)
+{
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - this->StartTime)
+                     .count();
+  vtkTypeInt64 done =
+    this->Counts[0] + this->Counts[1] + this->Counts[2] + this->Counts[3];
+  if (!final)
+  {
+    os << done << "/" << this->Tiles->size() << " tiles, "
+       << this->Counts[Downloaded] << " downloaded ("
+       << this->DownloadedBytes / 1024 << " KB), " << static_cast<int>(elapsed)
+       << " s" << std::endl;
+    return;
+  }
+
+  os << "\n"
+     << "Tiles processed:   " << done << "\n"
+     << "  downloaded:      " << this->Counts[Downloaded] << " ("
+     << this->DownloadedBytes / 1024 << " KB)\n"
+     << "  already cached:  " << this->Counts[Cached] << "\n"
+     << "  unavailable:     " << this->Counts[Unavailable] << "\n"
+     << "  failed:          " << this->Counts[Failed] << "\n"
+     << "Elapsed time:      " << elapsed << " s";
+  if (elapsed > 0.0)
+  {
+    os << " (" << this->Counts[Downloaded] / elapsed << " tiles/s)";
+  }
+  os << std::endl;
+}
+
+// ------------------------------------------------------------
+// Appends the rings of a GeoJSON polygon (outer ring, then holes)
+static void AddPolygonRings(
+  const Json::Value& polygon, std::vector<Ring>& rings)
+{
+  for (Json::Value::ArrayIndex i = 0; i < polygon.size(); ++i)
+  {
+    Ring ring;
+    for (Json::Value::ArrayIndex j = 0; j < polygon[i].size(); ++j)
+    {
+      ring.push_back(polygon[i][j][0].asDouble());
+      ring.push_back(polygon[i][j][1].asDouble());
+    }
+    if (ring.size() >= 6)
+    {
+      rings.push_back(ring);
+    }
+  }
+}
+
+// ------------------------------------------------------------
+// Appends the rings of the (Multi)Polygon geometries of a GeoJSON object
+static void AddGeoJSONRings(const Json::Value& node, std::vector<Ring>& rings)
+{
+  if (!node.isObject())
+  {
+    return;
+  }
+
+  std::string type = node["type"].asString();
+  if (type == "FeatureCollection")
+  {
+    const Json::Value& features = node["features"];
+    for (Json::Value::ArrayIndex i = 0; i < features.size(); ++i)
+    {
+      AddGeoJSONRings(features[i], rings);
+    }
+  }
+  else if (type == "Feature")
+  {
+    AddGeoJSONRings(node["geometry"], rings);
+  }
+  else if (type == "GeometryCollection")
+  {
+    const Json::Value& geometries = node["geometries"];
+    for (Json::Value::ArrayIndex i = 0; i < geometries.size(); ++i)
+    {
+      AddGeoJSONRings(geometries[i], rings);
+    }
+  }
+  else if (type == "Polygon")
+  {
+    AddPolygonRings(node["coordinates"], rings);
+  }
+  else if (type == "MultiPolygon")
+  {
+    const Json::Value& polygons = node["coordinates"];
+    for (Json::Value::ArrayIndex i = 0; i < polygons.size(); ++i)
+    {
+      AddPolygonRings(polygons[i], rings);
+    }
+  }
+}
+
+// ------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  bool showHelp = false;
+  std::string server = "tile.openstreetmap.org";
+  std::string extension = "png";
+  std::string storageDirectory;
+  std::string bounds;
+  std::string polygonFile;
+  int minZoom = 0;
+  int maxZoom = -1;
+  int numberOfThreads = 8;
+  double rate = 10.0;
+  std::string journalFile;
+  std::string output;
+
+  vtksys::CommandLineArguments arg;
+  arg.Initialize(argc, argv);
+  arg.AddArgument("-h", vtksys::CommandLineArguments::NO_ARGUMENT, &showHelp,
+    "show help message");
+  arg.AddArgument("--help", vtksys::CommandLineArguments::NO_ARGUMENT,
+    &showHelp, "show help message");
+  arg.AddArgument("-s", vtksys::CommandLineArguments::SPACE_ARGUMENT, &server,
+    "map-tile server (default tile.openstreetmap.org)");
+  arg.AddArgument("-e", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &extension, "map-tile file extension (default png)");
+  arg.AddArgument("-d", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &storageDirectory,
+    "vtkMap storage directory, the cache directory is a subdirectory named "
+    "after the server (default ~/.vtkmap/tiles)");
+  arg.AddArgument("-b", vtksys::CommandLineArguments::SPACE_ARGUMENT, &bounds,
+    "bounding box: minlat,minlon,maxlat,maxlon");
+  arg.AddArgument("-g", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &polygonFile, "GeoJSON file of the (multi)polygon to cover");
+  arg.AddArgument("-z", vtksys::CommandLineArguments::SPACE_ARGUMENT, &minZoom,
+    "lowest zoom level (default 0)");
+  arg.AddArgument("-Z", vtksys::CommandLineArguments::SPACE_ARGUMENT, &maxZoom,
+    "highest zoom level");
+  arg.AddArgument("-j", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &numberOfThreads, "number of concurrent requests (default 8)");
+  arg.AddArgument("-r", vtksys::CommandLineArguments::SPACE_ARGUMENT, &rate,
+    "maximum number of requests per second, 0 for no limit (default 10)");
+  arg.AddArgument("--journal", vtksys::CommandLineArguments::SPACE_ARGUMENT,
+    &journalFile,
+    "progress journal (default seed-journal.txt in the cache directory)");
+  arg.AddArgument("-o", vtksys::CommandLineArguments::SPACE_ARGUMENT, &output,
+    "tile bundle file to pack the cache directory into");
+
+  if (!arg.Parse() || showHelp || (bounds.empty() == polygonFile.empty()) ||
+    maxZoom < minZoom || minZoom < 0 || maxZoom > 24)
+  {
+    std::cout << "\n"
+              << "Usage: seedTiles -b minlat,minlon,maxlat,maxlon | "
+              << "-g area.geojson -z minzoom -Z maxzoom [-o file.bundle]"
+              << "\n\n"
+              << arg.GetHelp() << std::endl;
+    return -1;
+  }
+  numberOfThreads = std::max(1, std::min(numberOfThreads, VTK_MAX_THREADS));
+
+  // Area to cover
+  std::vector<Ring> rings;
+  if (!bounds.empty())
+  {
+    double b[4];
+    int n = sscanf(bounds.c_str(), "%lf,%lf,%lf,%lf", b, b + 1, b + 2, b + 3);
+    if (n != 4 || b[0] > b[2])
+    {
+      std::cerr << "Invalid bounding box " << bounds << std::endl;
+      return 1;
+    }
+    // Split if it crosses the antimeridian (minlon > maxlon)
+    vtkMapTileCoverage::AddBoundingBox(b[0], b[1], b[2], b[3], rings);
+  }
+  else
+  {
+    std::ifstream in(polygonFile.c_str());
+    Json::Value root;
+    Json::Reader reader;
+    if (!in || !reader.parse(in, root))
+    {
+      std::cerr << "Cannot read GeoJSON file " << polygonFile << std::endl;
+      return 1;
+    }
+    AddGeoJSONRings(root, rings);
+    if (rings.empty())
+    {
+      std::cerr << "No polygon in " << polygonFile << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<vtkTypeUInt64> tiles;
+  for (int zoom = minZoom; zoom <= maxZoom; ++zoom)
+  {
+    vtkMapTileCoverage::AddCoveringTiles(rings, zoom, tiles);
+  }
+
+  // Layer, with the same cache directory as in applications
+  vtkNew<vtkRenderer> renderer;
+  vtkNew<vtkMap> map;
+  map->SetRenderer(renderer.GetPointer());
+  if (!storageDirectory.empty())
+  {
+    map->SetStorageDirectory(storageDirectory.c_str());
+  }
+  vtkNew<vtkSeedOsmLayer> layer;
+  map->AddLayer(layer.GetPointer());
+  layer->SetMapTileServer(server.c_str(), "", extension.c_str());
+  if (!layer->GetCacheDirectory())
+  {
+    return 1;
+  }
+  // No eviction while seeding
+  layer->GetDiskCache()->SetMaxSize(0);
+  layer->GetDiskCache()->SetMaxNumberOfFiles(0);
+
+  // Skip tiles completed by previous runs
+  if (journalFile.empty())
+  {
+    journalFile = std::string(layer->GetCacheDirectory()) + "/seed-journal.txt";
+  }
+  vtkMapTileIndex<bool> completed;
+  std::ifstream journalIn(journalFile.c_str());
+  unsigned long long key;
+  while (journalIn >> key)
+  {
+    completed.Insert(key, true);
+  }
+  journalIn.close();
+  std::size_t total = tiles.size();
+  tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                [&](vtkTypeUInt64 k) { return completed.Contains(k); }),
+    tiles.end());
+  std::cout << total << " tiles in zoom levels " << minZoom << " to "
+            << maxZoom << ", " << total - tiles.size()
+            << " completed by previous runs" << std::endl;
+
+  FILE* journal = fopen(journalFile.c_str(), "a");
+  if (!journal)
+  {
+    std::cerr << "Cannot write progress journal " << journalFile << std::endl;
+    return 1;
+  }
+  layer->Seed(tiles, numberOfThreads, rate, journal);
+  fclose(journal);
+  layer->PrintReport(std::cout, true);
+
+  if (!output.empty())
+  {
+    if (!vtkMapTileBundle::Pack(layer->GetCacheDirectory(), output))
+    {
+      std::cerr << "Failed to write " << output << std::endl;
+      return 1;
+    }
+    std::cout << "Wrote " << output << std::endl;
+  }
+  return 0;
+}
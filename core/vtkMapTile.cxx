@@ -13,12 +13,14 @@
 =========================================================================*/
 
 #include "vtkMapTile.h"
+#include "vtkMapTileImagePool.h"
+#include "vtkMapTileKey.h"
 #include "vtkOsmLayer.h"
 
 // VTK Includes
 #include <vtkActor.h>
+#include <vtkImageData.h>
 #include <vtkJPEGReader.h>
-#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPNGReader.h>
 #include <vtkPlaneSource.h>
@@ -28,23 +30,45 @@
 #include <vtkTextureMapToPlane.h>
 #include <vtksys/SystemTools.hxx>
 
+#include <fstream>
+#include <iterator>
+
 vtkStandardNewMacro(vtkMapTile)
+vtkCxxSetObjectMacro(vtkMapTile, ImagePool, vtkMapTileImagePool);
 
   //----------------------------------------------------------------------------
   vtkMapTile::vtkMapTile()
 {
   this->Visibility = 0;
+  ImageData = 0;
+  ImageFileMissing = false;
+  ImagePool = 0;
+  ContentHash = 0;
   Plane = 0;
   TexturePlane = 0;
+  Texture = 0;
   Actor = 0;
   Mapper = 0;
   this->Corners[0] = this->Corners[1] = this->Corners[2] = this->Corners[3] =
     0.0;
+  this->TextureRange[0] = this->TextureRange[2] = 0.0;
+  this->TextureRange[1] = this->TextureRange[3] = 1.0;
 }
 
 //----------------------------------------------------------------------------
 vtkMapTile::~vtkMapTile()
 {
+  if (ImageData)
+  {
+    ImageData->Delete();
+  }
+
+  if (ContentHash)
+  {
+    ImagePool->ReleaseImage(ContentHash);
+  }
+  this->SetImagePool(0);
+
   if (Plane)
   {
     Plane->Delete();
@@ -55,6 +79,11 @@ vtkMapTile::~vtkMapTile()
     TexturePlane->Delete();
   }
 
+  if (Texture)
+  {
+    Texture->Delete();
+  }
+
   if (Actor)
   {
     Actor->Delete();
@@ -67,55 +96,239 @@ vtkMapTile::~vtkMapTile()
 }
 
 //----------------------------------------------------------------------------
-void vtkMapTile::Build()
+void vtkMapTile::SetImageData(vtkImageData* image)
+{
+  if (image == this->ImageData)
+  {
+    return;
+  }
+  if (this->ImageData)
+  {
+    this->ImageData->UnRegister(this);
+  }
+  if (this->ContentHash)
+  {
+    this->ImagePool->ReleaseImage(this->ContentHash);
+    this->ContentHash = 0;
+  }
+  this->ImageData = image;
+  if (this->ImageData)
+  {
+    this->ImageData->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTile::Reset()
+{
+  this->SetImageData(0);
+  this->ImageFileMissing = false;
+  this->SetLayer(0);
+  this->Visibility = 0;
+  this->ImageSource.clear();
+  this->ImageFile.clear();
+  std::vector<unsigned char>().swap(this->ImageBuffer);
+  this->TextureRange[0] = this->TextureRange[2] = 0.0;
+  this->TextureRange[1] = this->TextureRange[3] = 1.0;
+
+  // Don't keep the image alive through the texture
+  if (this->Texture)
+  {
+    this->Texture->SetInputData(0);
+  }
+  if (this->Actor)
+  {
+    this->Actor->SetTexture(0);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+// Moves plane to the tile corners. Setting the points of a plane one by
+// one can go through a degenerate plane, which vtkPlaneSource reports as
+// an error, so the plane is first translated to its new origin.
+static void SetPlaneCorners(vtkPlaneSource* plane, const double corners[4])
+{
+  double origin[3], center[3];
+  plane->GetOrigin(origin);
+  plane->GetCenter(center);
+  plane->SetCenter(center[0] + corners[0] - origin[0],
+    center[1] + corners[1] - origin[1], 0.0);
+  plane->SetPoint1(corners[2], corners[1], 0.0);
+  plane->SetPoint2(corners[0], corners[3], 0.0);
+  plane->SetOrigin(corners[0], corners[1], 0.0);
+}
+
+//----------------------------------------------------------------------------
+static bool ReadImageFile(
+  const std::string& path, std::vector<unsigned char>& data)
 {
-  this->Plane = vtkPlaneSource::New();
-  this->Plane->SetPoint1(this->Corners[2], this->Corners[1], 0.0);
-  this->Plane->SetPoint2(this->Corners[0], this->Corners[3], 0.0);
-  this->Plane->SetOrigin(this->Corners[0], this->Corners[1], 0.0);
-  this->Plane->SetNormal(0, 0, 1);
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in)
+  {
+    return false;
+  }
+  data.assign(
+    std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !in.bad() && !data.empty();
+}
 
-  this->TexturePlane = vtkTextureMapToPlane::New();
+//----------------------------------------------------------------------------
+void vtkMapTile::LoadImage()
+{
+  // The geometry of a recycled tile (see Reset()) is moved in place
+  if (!this->Plane)
+  {
+    this->Plane = vtkPlaneSource::New();
+    this->TexturePlane = vtkTextureMapToPlane::New();
+    this->TexturePlane->SetInputConnection(Plane->GetOutputPort());
+  }
+  SetPlaneCorners(this->Plane, this->Corners);
+  this->TexturePlane->SetSRange(this->TextureRange[0], this->TextureRange[1]);
+  this->TexturePlane->SetTRange(this->TextureRange[2], this->TextureRange[3]);
+  this->TexturePlane->Update();
+
+  if (this->ImageData)
+  {
+    return;
+  }
+  this->ImageFileMissing = false;
+
+  // Tiles with identical images share them, see vtkMapTileImagePool.
+  // The image file is then read first, to compute its content hash.
+  vtkTypeUInt64 hash = 0;
+  if (this->ImagePool)
+  {
+    if (this->ImageBuffer.empty() &&
+      !ReadImageFile(this->ImageFile, this->ImageBuffer))
+    {
+      // The layer forgets the file and requests the tile again
+      this->ImageFileMissing = true;
+      vtkErrorMacro("Cannot read map-tile file " << this->ImageFile);
+      return;
+    }
+    hash = vtkMapTileKey::HashContent(
+      this->ImageBuffer.data(), this->ImageBuffer.size());
+    vtkImageData* image = this->ImagePool->AcquireImage(hash);
+    if (image)
+    {
+      std::vector<unsigned char>().swap(this->ImageBuffer);
+      this->ImageData = image;
+      this->ImageData->Register(this);
+      this->ContentHash = hash;
+      return;
+    }
+  }
 
   // Read the image which will be the texture
   vtkImageReader2* imageReader = NULL;
-  std::string fileExtension =
-    vtksys::SystemTools::GetFilenameLastExtension(this->ImageFile);
-  if (fileExtension == ".png")
+  if (!this->ImageBuffer.empty())
   {
-    vtkPNGReader* pngReader = vtkPNGReader::New();
-    imageReader = pngReader;
+    // Decode from memory, identifying the format by its signature
+    const std::vector<unsigned char>& buffer = this->ImageBuffer;
+    if (buffer.size() >= 8 && buffer[0] == 0x89 && buffer[1] == 'P')
+    {
+      imageReader = vtkPNGReader::New();
+    }
+    else if (buffer.size() >= 2 && buffer[0] == 0xff && buffer[1] == 0xd8)
+    {
+      imageReader = vtkJPEGReader::New();
+    }
+    else
+    {
+      vtkErrorMacro(
+        "Unsupported map-tile image data for " << this->ImageSource);
+      return;
+    }
+    imageReader->SetMemoryBuffer(buffer.data());
+    imageReader->SetMemoryBufferLength(static_cast<vtkIdType>(buffer.size()));
   }
-  else if (fileExtension == ".jpg")
+  else
   {
-    vtkJPEGReader* jpgReader = vtkJPEGReader::New();
-    imageReader = jpgReader;
+    if (vtksys::SystemTools::FileLength(this->ImageFile) == 0)
+    {
+      this->ImageFileMissing = true;
+      vtkErrorMacro("Cannot read map-tile file " << this->ImageFile);
+      return;
+    }
+    std::string fileExtension =
+      vtksys::SystemTools::GetFilenameLastExtension(this->ImageFile);
+    if (fileExtension == ".png")
+    {
+      vtkPNGReader* pngReader = vtkPNGReader::New();
+      imageReader = pngReader;
+    }
+    else if (fileExtension == ".jpg")
+    {
+      vtkJPEGReader* jpgReader = vtkJPEGReader::New();
+      imageReader = jpgReader;
+    }
+    else
+    {
+      vtkErrorMacro("Unsupported map-tile extension " << fileExtension);
+      return;
+    }
+    imageReader->SetFileName(this->ImageFile.c_str());
   }
-  else
+  imageReader->Update();
+
+  // Decoded image is now owned by the reader output
+  std::vector<unsigned char>().swap(this->ImageBuffer);
+
+  this->ImageData = imageReader->GetOutput();
+  if (hash)
+  {
+    // Another tile may have shared the same image in the meantime
+    this->ImageData = this->ImagePool->AddImage(hash, this->ImageData);
+    this->ContentHash = hash;
+  }
+  this->ImageData->Register(this);
+  imageReader->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTile::Build()
+{
+  this->LoadImage();
+  if (!this->ImageData)
   {
-    vtkErrorMacro("Unsupported map-tile extension " << fileExtension);
+    if (this->Actor)
+    {
+      this->Actor->VisibilityOff(); // recycled tile
+    }
     return;
   }
-  imageReader->SetFileName(this->ImageFile.c_str());
-  imageReader->Update();
 
-  // Apply the texture
-  vtkNew<vtkTexture> texture;
-  texture->SetInputConnection(imageReader->GetOutputPort());
-  texture->SetQualityTo32Bit();
-  texture->SetInterpolate(1);
-  this->TexturePlane->SetInputConnection(Plane->GetOutputPort());
+  // Apply the texture, shared with the tiles sharing the image
+  vtkTexture* texture =
+    this->ContentHash ? this->ImagePool->GetTexture(this->ContentHash) : 0;
+  if (!texture)
+  {
+    if (!this->Texture)
+    {
+      this->Texture = vtkTexture::New();
+      this->Texture->SetQualityTo32Bit();
+      this->Texture->SetInterpolate(1);
+    }
+    this->Texture->SetInputData(this->ImageData);
+    texture = this->Texture;
+  }
 
-  this->Mapper = vtkPolyDataMapper::New();
-  this->Mapper->SetInputConnection(this->TexturePlane->GetOutputPort());
+  // Rendering objects of a recycled tile are reused
+  if (!this->Actor)
+  {
+    this->Mapper = vtkPolyDataMapper::New();
+    this->Mapper->SetInputConnection(this->TexturePlane->GetOutputPort());
 
-  this->Actor = vtkActor::New();
-  this->Actor->SetMapper(Mapper);
-  this->Actor->SetTexture(texture.GetPointer());
-  this->Actor->PickableOff();
+    this->Actor = vtkActor::New();
+    this->Actor->SetMapper(Mapper);
+    this->Actor->PickableOff();
+  }
+  this->Actor->SetTexture(texture);
+  this->Actor->VisibilityOn();
 
   this->BuildTime.Modified();
-  imageReader->Delete();
 }
 
 //----------------------------------------------------------------------------
@@ -148,3 +361,12 @@ void vtkMapTile::Update()
   this->Actor->SetVisibility(this->IsVisible());
   this->UpdateTime.Modified();
 }
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTile::GetMemorySize()
+{
+  // GetActualMemorySize() is in kibibytes
+  return this->ImageData
+    ? vtkTypeUInt64(this->ImageData->GetActualMemorySize()) * 1024
+    : 0;
+}
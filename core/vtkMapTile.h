@@ -21,10 +21,15 @@
 #include "vtkFeature.h"
 #include "vtkmapcore_export.h"
 
+#include <vector>
+
 class vtkStdString;
+class vtkImageData;
+class vtkMapTileImagePool;
 class vtkPlaneSource;
 class vtkActor;
 class vtkPolyDataMapper;
+class vtkTexture;
 class vtkTextureMapToPlane;
 
 class VTKMAPCORE_EXPORT vtkMapTile : public vtkFeature
@@ -41,6 +46,14 @@ public:
     this->ImageFile = path;
   }
 
+  // Description:
+  // Set encoded (png or jpeg) image, used instead of the image file
+  // when not empty. The buffer is released once the tile is built.
+  void SetImageBuffer(const std::vector<unsigned char>& data)
+  {
+    this->ImageBuffer = data;
+  }
+
   // Set/Get URL to image on the map tile server
   // Note that, although this class stores the source URL, the *map layer* is
   // responsible for downloading the tile to the local filesystem.
@@ -61,6 +74,40 @@ public:
     void SetCenter(double* center);
   void SetCenter(double x, double y, double z);
 
+  // Description:
+  // Decode the image and compute the textured geometry, without
+  // creating any rendering object. Safe to call from a worker thread,
+  // in which case Init() only attaches the results. Called by Init()
+  // if it has not been called before.
+  void LoadImage();
+
+  // Description:
+  // Decoded image, or NULL before LoadImage() or if decoding failed.
+  // Setting it replaces loading, e.g. to share the image of another tile.
+  vtkGetMacro(ImageData, vtkImageData*);
+  void SetImageData(vtkImageData* image);
+
+  // Description:
+  // True if LoadImage() could not read the image file, e.g. because it
+  // was removed from the cache directory by another process.
+  vtkGetMacro(ImageFileMissing, bool);
+
+  // Description:
+  // Pool in which the decoded image and its texture are shared with the
+  // tiles having identical image content. Optional, must be set before
+  // the image is loaded. A shared image is counted in full by
+  // GetMemorySize().
+  void SetImagePool(vtkMapTileImagePool* pool);
+  vtkGetObjectMacro(ImagePool, vtkMapTileImagePool);
+
+  // Description:
+  // Part of the image used as texture, as normalized (smin, smax, tmin,
+  // tmax). Default is the whole image, (0, 1, 0, 1). Used to draw part
+  // of a lower-zoom tile in place of a tile that is not loaded yet.
+  // Must be set before the tile is loaded.
+  vtkGetVector4Macro(TextureRange, double);
+  vtkSetVector4Macro(TextureRange, double);
+
   // Description:
   // Create the geometry and download
   // the image if necessary
@@ -75,6 +122,17 @@ public:
   // Update the map tile
   void Update() override;
 
+  // Description:
+  // Release the image and return the tile to its initial state, keeping
+  // its rendering objects to draw another tile (see vtkMapTilePool).
+  // The tile must not be in the renderer.
+  void Reset();
+
+  // Description:
+  // Memory used by the decoded texture image, in bytes.
+  // Returns 0 if the image has not been loaded.
+  vtkTypeUInt64 GetMemorySize();
+
 protected:
   vtkMapTile();
   ~vtkMapTile();
@@ -87,13 +145,20 @@ protected:
   // Storing the remote and local paths
   std::string ImageSource;
   std::string ImageFile;
+  std::vector<unsigned char> ImageBuffer;
 
+  vtkImageData* ImageData; // decoded image, set by LoadImage()
+  bool ImageFileMissing;
+  vtkMapTileImagePool* ImagePool;
+  vtkTypeUInt64 ContentHash; // of ImageData if shared in ImagePool, or 0
   vtkPlaneSource* Plane;
   vtkTextureMapToPlane* TexturePlane;
+  vtkTexture* Texture; // unless the texture is shared in ImagePool
   vtkActor* Actor;
   vtkPolyDataMapper* Mapper;
 
   double Corners[4];
+  double TextureRange[4];
 
 private:
   vtkMapTile(const vtkMapTile&);            // Not implemented
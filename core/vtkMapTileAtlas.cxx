@@ -0,0 +1,348 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileAtlas.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileAtlas.h"
+#include "vtkMapTile.h"
+
+#include <vtkActor.h>
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataMapper.h>
+#include <vtkTexture.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <utility>
+
+vtkStandardNewMacro(vtkMapTileAtlas);
+
+//----------------------------------------------------------------------------
+class vtkMapTileAtlas::vtkInternals
+{
+public:
+  struct Page
+  {
+    vtkSmartPointer<vtkImageData> Image;
+    vtkSmartPointer<vtkPolyData> Mesh;
+    vtkSmartPointer<vtkActor> Actor;
+    std::vector<std::vector<vtkMapTile*> > Slots; // tiles drawn from slot
+    bool ImageModified;
+  };
+  std::vector<Page> Pages;
+
+  // Page and slot index of each tile in the atlas
+  typedef std::map<vtkMapTile*, std::pair<int, int> > LocationMap;
+  LocationMap Locations;
+
+  // Slot of each image drawn whole, shared by the tiles with this image
+  // (see vtkMapTileImagePool)
+  std::map<vtkImageData*, std::pair<int, int> > SharedSlots;
+
+  // Keeps tiles alive while they are referenced by Locations
+  std::vector<vtkSmartPointer<vtkMapTile> > Tiles;
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileAtlas::vtkMapTileAtlas()
+{
+  this->PageSize = 2048;
+  this->SlotSize = 256;
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileAtlas::~vtkMapTileAtlas()
+{
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileAtlas::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "PageSize: " << this->PageSize << "\n"
+     << indent << "SlotSize: " << this->SlotSize << "\n"
+     << indent << "NumberOfPages: " << this->Internals->Pages.size() << "\n"
+     << indent << "NumberOfTiles: " << this->Internals->Locations.size()
+     << std::endl;
+}
+
+//----------------------------------------------------------------------------
+// Returns true if the whole image of tile is drawn, so that its slot can
+// be shared with the other tiles having the same image
+static bool IsWholeImage(vtkMapTile* tile)
+{
+  double* range = tile->GetTextureRange();
+  return range[0] == 0.0 && range[1] == 1.0 && range[2] == 0.0 &&
+    range[3] == 1.0;
+}
+
+//----------------------------------------------------------------------------
+// Copies the TextureRange part of tile image into slot, converting to RGBA
+// and resampling (nearest neighbor) if its size differs from the slot size
+static void CopyTileImage(
+  vtkMapTile* tile, vtkImageData* page, int slotSize, int slotX, int slotY)
+{
+  vtkImageData* source = tile->GetImageData();
+  double* range = tile->GetTextureRange();
+  int dims[3];
+  source->GetDimensions(dims);
+  int numComp = source->GetNumberOfScalarComponents();
+  const unsigned char* src =
+    static_cast<const unsigned char*>(source->GetScalarPointer());
+  int pageDims[3];
+  page->GetDimensions(pageDims);
+  unsigned char* dst = static_cast<unsigned char*>(page->GetScalarPointer());
+
+  for (int row = 0; row < slotSize; ++row)
+  {
+    double t = range[2] + (row + 0.5) / slotSize * (range[3] - range[2]);
+    int srcRow = std::min(static_cast<int>(t * dims[1]), dims[1] - 1);
+    unsigned char* out =
+      dst + 4 * ((slotY * slotSize + row) * pageDims[0] + slotX * slotSize);
+    for (int col = 0; col < slotSize; ++col, out += 4)
+    {
+      double s = range[0] + (col + 0.5) / slotSize * (range[1] - range[0]);
+      int srcCol = std::min(static_cast<int>(s * dims[0]), dims[0] - 1);
+      const unsigned char* in = src + numComp * (srcRow * dims[0] + srcCol);
+      switch (numComp)
+      {
+        case 1: // luminance
+        case 2: // luminance + alpha
+          out[0] = out[1] = out[2] = in[0];
+          out[3] = numComp == 2 ? in[1] : 255;
+          break;
+        case 3:
+          out[0] = in[0];
+          out[1] = in[1];
+          out[2] = in[2];
+          out[3] = 255;
+          break;
+        default:
+          memcpy(out, in, 4);
+          break;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileAtlas::SetTiles(
+  const std::vector<vtkSmartPointer<vtkMapTile> >& tiles)
+{
+  vtkInternals::LocationMap& locations = this->Internals->Locations;
+  std::vector<vtkInternals::Page>& pages = this->Internals->Pages;
+  int slotsPerRow = this->PageSize / this->SlotSize;
+  int slotsPerPage = slotsPerRow * slotsPerRow;
+
+  // Keep tiles that have a decoded 8-bit image
+  std::vector<vtkSmartPointer<vtkMapTile> > newTiles;
+  std::set<vtkMapTile*> newTileSet;
+  for (std::size_t i = 0; i < tiles.size(); ++i)
+  {
+    vtkImageData* image = tiles[i]->GetImageData();
+    if (image && image->GetScalarType() == VTK_UNSIGNED_CHAR &&
+      image->GetNumberOfScalarComponents() <= 4 &&
+      newTileSet.insert(tiles[i]).second)
+    {
+      newTiles.push_back(tiles[i]);
+    }
+  }
+
+  // Release slots of tiles that are no longer displayed
+  for (auto iter = locations.begin(); iter != locations.end();)
+  {
+    if (newTileSet.count(iter->first))
+    {
+      ++iter;
+      continue;
+    }
+    std::vector<vtkMapTile*>& slot =
+      pages[iter->second.first].Slots[iter->second.second];
+    slot.erase(std::find(slot.begin(), slot.end(), iter->first));
+    if (slot.empty())
+    {
+      // Tile is still referenced by Internals->Tiles
+      auto shared = this->Internals->SharedSlots.find(
+        iter->first->GetImageData());
+      if (shared != this->Internals->SharedSlots.end() &&
+        shared->second == iter->second)
+      {
+        this->Internals->SharedSlots.erase(shared);
+      }
+    }
+    locations.erase(iter++);
+  }
+
+  // Copy images of new tiles to free slots
+  std::size_t freePage = 0;
+  int freeSlot = 0;
+  for (std::size_t i = 0; i < newTiles.size(); ++i)
+  {
+    vtkMapTile* tile = newTiles[i];
+    if (locations.count(tile))
+    {
+      continue;
+    }
+
+    // Draw from the slot of the same image, if any
+    bool whole = IsWholeImage(tile);
+    auto shared = whole
+      ? this->Internals->SharedSlots.find(tile->GetImageData())
+      : this->Internals->SharedSlots.end();
+    if (shared != this->Internals->SharedSlots.end())
+    {
+      pages[shared->second.first].Slots[shared->second.second].push_back(
+        tile);
+      locations[tile] = shared->second;
+      continue;
+    }
+
+    // Find next free slot, adding a page if needed
+    while (freePage < pages.size() && !pages[freePage].Slots[freeSlot].empty())
+    {
+      if (++freeSlot == slotsPerPage)
+      {
+        ++freePage;
+        freeSlot = 0;
+      }
+    }
+    if (freePage == pages.size())
+    {
+      vtkInternals::Page page;
+      page.Image = vtkSmartPointer<vtkImageData>::New();
+      page.Image->SetDimensions(this->PageSize, this->PageSize, 1);
+      page.Image->AllocateScalars(VTK_UNSIGNED_CHAR, 4);
+      memset(page.Image->GetScalarPointer(), 0,
+        4 * static_cast<std::size_t>(this->PageSize) * this->PageSize);
+
+      vtkSmartPointer<vtkTexture> texture = vtkSmartPointer<vtkTexture>::New();
+      texture->SetInputData(page.Image);
+      texture->SetQualityTo32Bit();
+      texture->SetInterpolate(1);
+      texture->EdgeClampOn();
+
+      page.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      vtkSmartPointer<vtkPolyDataMapper> mapper =
+        vtkSmartPointer<vtkPolyDataMapper>::New();
+      mapper->SetInputData(page.Mesh);
+
+      page.Actor = vtkSmartPointer<vtkActor>::New();
+      page.Actor->SetMapper(mapper);
+      page.Actor->SetTexture(texture);
+      page.Actor->PickableOff();
+
+      page.Slots.resize(slotsPerPage);
+      page.ImageModified = false;
+      pages.push_back(page);
+    }
+
+    vtkInternals::Page& page = pages[freePage];
+    page.Slots[freeSlot].push_back(tile);
+    page.ImageModified = true;
+    locations[tile] = std::make_pair(static_cast<int>(freePage), freeSlot);
+    if (whole)
+    {
+      this->Internals->SharedSlots[tile->GetImageData()] = locations[tile];
+    }
+    CopyTileImage(tile, page.Image, this->SlotSize,
+      freeSlot % slotsPerRow, freeSlot / slotsPerRow);
+  }
+
+  // Rebuild quad meshes. Texture coordinates are inset by half a texel,
+  // so that interpolation doesn't sample neighboring slots.
+  double texel = 1.0 / this->PageSize;
+  double slotExtent = static_cast<double>(this->SlotSize) / this->PageSize;
+  for (std::size_t p = 0; p < pages.size(); ++p)
+  {
+    vtkInternals::Page& page = pages[p];
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> quads;
+    vtkNew<vtkFloatArray> tcoords;
+    tcoords->SetNumberOfComponents(2);
+    tcoords->SetName("TextureCoordinates");
+
+    for (int s = 0; s < slotsPerPage; ++s)
+    {
+      double s0 = (s % slotsPerRow) * slotExtent + 0.5 * texel;
+      double t0 = (s / slotsPerRow) * slotExtent + 0.5 * texel;
+      double s1 = s0 + slotExtent - texel;
+      double t1 = t0 + slotExtent - texel;
+
+      for (std::size_t j = 0; j < page.Slots[s].size(); ++j)
+      {
+        double* corners = page.Slots[s][j]->GetCorners();
+        vtkIdType ids[4];
+        ids[0] = points->InsertNextPoint(corners[0], corners[1], 0.0);
+        ids[1] = points->InsertNextPoint(corners[2], corners[1], 0.0);
+        ids[2] = points->InsertNextPoint(corners[2], corners[3], 0.0);
+        ids[3] = points->InsertNextPoint(corners[0], corners[3], 0.0);
+        tcoords->InsertNextTuple2(s0, t0);
+        tcoords->InsertNextTuple2(s1, t0);
+        tcoords->InsertNextTuple2(s1, t1);
+        tcoords->InsertNextTuple2(s0, t1);
+        quads->InsertNextCell(4, ids);
+      }
+    }
+
+    page.Mesh->SetPoints(points.GetPointer());
+    page.Mesh->SetPolys(quads.GetPointer());
+    page.Mesh->GetPointData()->SetTCoords(tcoords.GetPointer());
+    page.Actor->SetVisibility(points->GetNumberOfPoints() > 0);
+
+    if (page.ImageModified)
+    {
+      page.Image->Modified();
+      page.ImageModified = false;
+    }
+  }
+
+  this->Internals->Tiles.swap(newTiles);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileAtlas::Clear()
+{
+  this->Internals->Pages.clear();
+  this->Internals->Locations.clear();
+  this->Internals->SharedSlots.clear();
+  this->Internals->Tiles.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMapTileAtlas::GetNumberOfActors()
+{
+  return static_cast<int>(this->Internals->Pages.size());
+}
+
+//----------------------------------------------------------------------------
+vtkActor* vtkMapTileAtlas::GetActor(int i)
+{
+  if (i < 0 || i >= this->GetNumberOfActors())
+  {
+    return nullptr;
+  }
+  return this->Internals->Pages[i].Actor;
+}
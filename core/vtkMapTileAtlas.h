@@ -0,0 +1,93 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileAtlas.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileAtlas - draws a set of map tiles with one actor per page
+// .SECTION Description
+// Packs the decoded images of map tiles into large RGBA atlas textures
+// ("pages") and draws all the tiles of a page as a single quad mesh,
+// instead of one actor, mapper and texture per tile. A page holds
+// (PageSize / SlotSize)^2 tiles; with the defaults, a 2048x2048 page
+// holds 64 tiles of 256x256 pixels, which covers a full-HD viewport,
+// and more pages are added as needed.
+//
+// Tiles keep their slot while they remain in the set passed to
+// SetTiles(), so only the images of new tiles are copied, and tiles
+// sharing an image (see vtkMapTileImagePool) share a slot. Tiles only
+// need to be loaded (vtkMapTile::LoadImage()), not built.
+// Used internally by vtkOsmLayer.
+
+#ifndef __vtkMapTileAtlas_h
+#define __vtkMapTileAtlas_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+#include <vector>
+
+class vtkActor;
+class vtkMapTile;
+
+class VTKMAPCORE_EXPORT vtkMapTileAtlas : public vtkObject
+{
+public:
+  static vtkMapTileAtlas* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileAtlas, vtkObject);
+
+  // Description:
+  // Size of a page texture in pixels. Default is 2048.
+  // Must be set before the first call to SetTiles().
+  vtkSetMacro(PageSize, int);
+  vtkGetMacro(PageSize, int);
+
+  // Description:
+  // Size of a tile slot in pixels. Tile images of a different size are
+  // resampled. Default is 256, the size of OSM tiles.
+  vtkSetMacro(SlotSize, int);
+  vtkGetMacro(SlotSize, int);
+
+  // Description:
+  // Set the tiles to draw, replacing the previous set.
+  // Tiles without a loaded image are skipped.
+  void SetTiles(const std::vector<vtkSmartPointer<vtkMapTile> >& tiles);
+
+  // Description:
+  // Remove all tiles and release the pages. The page actors must be
+  // removed from the renderer first.
+  void Clear();
+
+  // Description:
+  // Actors drawing the pages, one per page in use. The list may grow
+  // after SetTiles(); actors are not removed once created.
+  int GetNumberOfActors();
+  vtkActor* GetActor(int i);
+
+protected:
+  vtkMapTileAtlas();
+  ~vtkMapTileAtlas() override;
+
+  int PageSize;
+  int SlotSize;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileAtlas(const vtkMapTileAtlas&);            // Not implemented
+  vtkMapTileAtlas& operator=(const vtkMapTileAtlas&); // Not implemented
+};
+
+#endif // __vtkMapTileAtlas_h
@@ -0,0 +1,392 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileBundle.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileBundle.h"
+#include "vtkMapTileDiskCache.h"
+#include "vtkMapTileKey.h"
+
+#include <vtkObjectFactory.h>
+#include <vtksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+vtkStandardNewMacro(vtkMapTileBundle);
+
+namespace
+{
+const char BundleMagic[8] = { 'V', 'T', 'K', 'M', 'A', 'P', 'T', 'B' };
+const vtkTypeUInt32 BundleVersion = 1;
+
+struct BundleHeader
+{
+  char Magic[8];
+  vtkTypeUInt32 Version;
+  vtkTypeUInt32 Reserved;
+  vtkTypeUInt64 NumberOfTiles;
+};
+
+struct BundleEntry
+{
+  vtkTypeUInt64 Key;
+  vtkTypeUInt64 Offset;
+  vtkTypeUInt64 Size;
+
+  bool operator<(const BundleEntry& other) const
+  {
+    return this->Key < other.Key;
+  }
+};
+
+bool IsImage(const std::vector<unsigned char>& data)
+{
+  std::size_t n = data.size();
+  bool png = n >= 8 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' &&
+    data[3] == 'G';
+  bool jpeg = n >= 4 && data[0] == 0xff && data[1] == 0xd8 &&
+    data[n - 2] == 0xff && data[n - 1] == 0xd9;
+  return png || jpeg;
+}
+}
+
+//----------------------------------------------------------------------------
+class vtkMapTileBundle::vtkInternals
+{
+public:
+  const BundleEntry* Entries; // points into mapped file
+  vtkTypeUInt64 NumberOfEntries;
+#ifdef _WIN32
+  HANDLE File;
+  HANDLE Mapping;
+#endif
+
+  vtkInternals()
+    : Entries(nullptr)
+    , NumberOfEntries(0)
+#ifdef _WIN32
+    , File(INVALID_HANDLE_VALUE)
+    , Mapping(NULL)
+#endif
+  {
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileBundle::vtkMapTileBundle()
+{
+  this->Data = nullptr;
+  this->DataSize = 0;
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileBundle::~vtkMapTileBundle()
+{
+  this->Close();
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileBundle::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << this->FileName << "\n"
+     << indent << "DataSize: " << this->DataSize << "\n"
+     << indent << "NumberOfTiles: " << this->Internals->NumberOfEntries
+     << std::endl;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileBundle::Open(const std::string& fileName)
+{
+  this->Close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  LARGE_INTEGER fileSize;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+  {
+    vtkErrorMacro("Cannot open tile bundle " << fileName);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(file);
+    }
+    return false;
+  }
+  std::size_t size = static_cast<std::size_t>(fileSize.QuadPart);
+  HANDLE mapping =
+    size > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+  const void* data =
+    mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+  if (!data)
+  {
+    vtkErrorMacro("Cannot map tile bundle " << fileName);
+    if (mapping)
+    {
+      CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return false;
+  }
+  this->Internals->File = file;
+  this->Internals->Mapping = mapping;
+#else
+  int fd = open(fileName.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0)
+  {
+    vtkErrorMacro("Cannot open tile bundle " << fileName);
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+    return false;
+  }
+  std::size_t size = static_cast<std::size_t>(st.st_size);
+  void* data =
+    size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd); // the mapping keeps the file open
+  if (data == MAP_FAILED)
+  {
+    vtkErrorMacro("Cannot map tile bundle " << fileName);
+    return false;
+  }
+  // Lookups jump around the file, don't read ahead
+  madvise(data, size, MADV_RANDOM);
+#endif
+
+  this->Data = static_cast<const unsigned char*>(data);
+  this->DataSize = size;
+  this->FileName = fileName;
+
+  // Validate header and index bounds
+  const BundleHeader* header =
+    reinterpret_cast<const BundleHeader*>(this->Data);
+  bool valid = size >= sizeof(BundleHeader) &&
+    memcmp(header->Magic, BundleMagic, sizeof(BundleMagic)) == 0 &&
+    header->Version == BundleVersion &&
+    header->NumberOfTiles <=
+      (size - sizeof(BundleHeader)) / sizeof(BundleEntry);
+  if (!valid)
+  {
+    vtkErrorMacro("Not a valid tile bundle: " << fileName);
+    this->Close();
+    return false;
+  }
+
+  this->Internals->Entries =
+    reinterpret_cast<const BundleEntry*>(this->Data + sizeof(BundleHeader));
+  this->Internals->NumberOfEntries = header->NumberOfTiles;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileBundle::Close()
+{
+  if (!this->Data)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(this->Data);
+  CloseHandle(this->Internals->Mapping);
+  CloseHandle(this->Internals->File);
+  this->Internals->Mapping = NULL;
+  this->Internals->File = INVALID_HANDLE_VALUE;
+#else
+  munmap(const_cast<unsigned char*>(this->Data), this->DataSize);
+#endif
+
+  this->Data = nullptr;
+  this->DataSize = 0;
+  this->FileName.clear();
+  this->Internals->Entries = nullptr;
+  this->Internals->NumberOfEntries = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTileBundle::GetNumberOfTiles()
+{
+  return this->Internals->NumberOfEntries;
+}
+
+//----------------------------------------------------------------------------
+const unsigned char* vtkMapTileBundle::GetTileData(
+  int zoom, int x, int y, std::size_t& size)
+{
+  size = 0;
+  const BundleEntry* begin = this->Internals->Entries;
+  const BundleEntry* end = begin + this->Internals->NumberOfEntries;
+  if (begin == end)
+  {
+    return nullptr;
+  }
+
+  BundleEntry target;
+  target.Key = vtkMapTileKey::Make(zoom, x, y);
+  const BundleEntry* entry = std::lower_bound(begin, end, target);
+  if (entry == end || entry->Key != target.Key)
+  {
+    return nullptr;
+  }
+
+  // Guard against truncated files
+  if (entry->Offset > this->DataSize ||
+    entry->Size > this->DataSize - entry->Offset)
+  {
+    vtkErrorMacro("Tile " << zoom << "-" << x << "-" << y
+                          << " is out of bounds in " << this->FileName);
+    return nullptr;
+  }
+
+  size = static_cast<std::size_t>(entry->Size);
+  return this->Data + entry->Offset;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileBundle::HasTile(int zoom, int x, int y)
+{
+  std::size_t size;
+  return this->GetTileData(zoom, x, y, size) != nullptr;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileBundle::ReadTile(
+  int zoom, int x, int y, std::vector<unsigned char>& data)
+{
+  std::size_t size;
+  const unsigned char* tile = this->GetTileData(zoom, x, y, size);
+  if (!tile)
+  {
+    return false;
+  }
+  data.assign(tile, tile + size);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileBundle::WriteTile(
+  int vtkNotUsed(zoom), int vtkNotUsed(x), int vtkNotUsed(y),
+  const std::vector<unsigned char>& vtkNotUsed(data))
+{
+  return false;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileBundle::Pack(
+  const std::string& directory, const std::string& fileName)
+{
+  if (!vtksys::SystemTools::FileIsDirectory(directory))
+  {
+    vtkGenericWarningMacro("Cannot read directory " << directory);
+    return false;
+  }
+
+  // Collect tile files, in any layout of the cache directory
+  std::vector<std::pair<vtkTypeUInt64, std::string> > files;
+  vtkMapTileDiskCache::FindTileFiles(directory, files);
+  std::vector<BundleEntry> entries;
+  std::vector<std::string> paths;
+  for (std::size_t i = 0; i < files.size(); ++i)
+  {
+    const std::string& name = files[i].second;
+    std::string ext = vtksys::SystemTools::GetFilenameLastExtension(name);
+    if (ext != ".png" && ext != ".jpg" && ext != ".jpeg")
+    {
+      continue;
+    }
+    BundleEntry entry;
+    entry.Key = files[i].first;
+    entry.Offset = paths.size(); // index into paths until written
+    entry.Size = 0;
+    entries.push_back(entry);
+    paths.push_back(directory + "/" + name);
+  }
+  std::sort(entries.begin(), entries.end());
+
+  // Write data after a placeholder header and index, so that files are
+  // read only once, then rewrite header and index with final offsets.
+  std::string tempName = fileName + ".tmp";
+  std::ofstream out(tempName.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out)
+  {
+    vtkGenericWarningMacro("Cannot write " << tempName);
+    return false;
+  }
+  vtkTypeUInt64 offset =
+    sizeof(BundleHeader) + entries.size() * sizeof(BundleEntry);
+  out.seekp(static_cast<std::streamoff>(offset));
+
+  std::vector<BundleEntry> written;
+  std::vector<unsigned char> data;
+  for (std::size_t i = 0; i < entries.size(); ++i)
+  {
+    const std::string& path = paths[entries[i].Offset];
+    std::ifstream in(path.c_str(), std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+      std::istreambuf_iterator<char>());
+    if (!IsImage(data))
+    {
+      vtkGenericWarningMacro("Skipping invalid image " << path);
+      continue;
+    }
+    out.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+    BundleEntry entry = entries[i];
+    entry.Offset = offset;
+    entry.Size = data.size();
+    written.push_back(entry);
+    offset += data.size();
+  }
+
+  // The index was sized for all files; skipped ones leave unused
+  // space after the index, which is harmless.
+  BundleHeader header;
+  memcpy(header.Magic, BundleMagic, sizeof(BundleMagic));
+  header.Version = BundleVersion;
+  header.Reserved = 0;
+  header.NumberOfTiles = written.size();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (!written.empty())
+  {
+    out.write(reinterpret_cast<const char*>(written.data()),
+      written.size() * sizeof(BundleEntry));
+  }
+  out.close();
+  if (!out)
+  {
+    vtkGenericWarningMacro("Error writing " << tempName);
+    remove(tempName.c_str());
+    return false;
+  }
+
+  return vtksys::SystemTools::RenameFile(tempName.c_str(), fileName.c_str());
+}
@@ -0,0 +1,105 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileBundle.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileBundle - read-only, memory-mapped map-tile bundle file
+// .SECTION Description
+// A tile bundle is a single file holding a pre-seeded set of map tiles,
+// meant to be shipped to machines without network access. The file is
+// mapped into memory when opened, so looking up a tile performs no
+// system calls: the index is binary-searched in place and the image is
+// read directly from the mapping.
+//
+// File layout (native byte order, little endian on all supported
+// platforms):
+//   header: char[8] "VTKMAPTB", uint32 version (1), uint32 reserved,
+//           uint64 number of tiles
+//   index:  one entry per tile, sorted by key:
+//           uint64 key, uint64 offset (from start of file), uint64 size
+//   data:   concatenated png/jpeg images
+// Keys are vtkMapTileKey values of the OSM tile indices (zoom, column,
+// row), as used by vtkMapTileStore.
+//
+// Bundles are created with Pack(), e.g. from the cache directory of a
+// vtkOsmLayer (see applications/tools/packTileBundle). Lookups are thread
+// safe, but must not overlap with Open() or Close().
+
+#ifndef __vtkMapTileBundle_h
+#define __vtkMapTileBundle_h
+
+#include "vtkMapTileStore.h"
+#include "vtkmapcore_export.h"
+
+#include <cstddef>
+#include <string>
+
+class VTKMAPCORE_EXPORT vtkMapTileBundle : public vtkMapTileStore
+{
+public:
+  static vtkMapTileBundle* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileBundle, vtkMapTileStore);
+
+  // Description:
+  // Map a bundle file into memory.
+  // Returns false and reports an error if the file is not a valid bundle.
+  bool Open(const std::string& fileName);
+
+  // Description:
+  // Unmap the file. Pointers returned by GetTileData() become invalid.
+  void Close();
+
+  bool IsOpen() { return this->Data != nullptr; }
+
+  // Description:
+  // Number of tiles in the open bundle
+  vtkTypeUInt64 GetNumberOfTiles();
+
+  // Description:
+  // Returns a pointer to the encoded image of a tile inside the mapped
+  // file and sets size, or returns nullptr if the tile is not in the
+  // bundle.
+  const unsigned char* GetTileData(int zoom, int x, int y, std::size_t& size);
+
+  bool HasTile(int zoom, int x, int y) override;
+  bool ReadTile(
+    int zoom, int x, int y, std::vector<unsigned char>& data) override;
+
+  // Description:
+  // Bundles are read-only, always returns false.
+  bool WriteTile(
+    int zoom, int x, int y, const std::vector<unsigned char>& data) override;
+
+  // Description:
+  // Write a bundle containing the png/jpeg tile images of a vtkOsmLayer
+  // cache directory, in any layout (see vtkMapTileDiskCache::SetLayout()).
+  // Files that are not valid images are skipped.
+  static bool Pack(const std::string& directory, const std::string& fileName);
+
+protected:
+  vtkMapTileBundle();
+  ~vtkMapTileBundle() override;
+
+  std::string FileName;
+  const unsigned char* Data; // mapped file
+  std::size_t DataSize;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileBundle(const vtkMapTileBundle&);            // Not implemented
+  vtkMapTileBundle& operator=(const vtkMapTileBundle&); // Not implemented
+};
+
+#endif // __vtkMapTileBundle_h
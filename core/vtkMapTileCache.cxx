@@ -0,0 +1,193 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileCache.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileCache.h"
+#include "vtkMapTile.h"
+#include "vtkMapTileIndex.h"
+#include "vtkMapTileKey.h"
+#include "vtkMapTilePool.h"
+
+#include <vtkObjectFactory.h>
+
+#include <list>
+#include <set>
+
+vtkStandardNewMacro(vtkMapTileCache);
+vtkCxxSetObjectMacro(vtkMapTileCache, TilePool, vtkMapTilePool);
+
+//----------------------------------------------------------------------------
+class vtkMapTileCache::vtkInternals
+{
+public:
+  struct Entry
+  {
+    vtkTypeUInt64 TileKey;
+    vtkSmartPointer<vtkMapTile> Tile;
+    vtkTypeUInt64 Size;
+  };
+
+  // Most recently used entries are at the front
+  typedef std::list<Entry> EntryList;
+  EntryList Entries;
+  vtkMapTileIndex<EntryList::iterator> Index;
+  std::set<vtkMapTile*> Pinned;
+  vtkTypeUInt64 MemorySize;
+
+  vtkInternals()
+    : MemorySize(0)
+  {
+  }
+
+  void Erase(EntryList::iterator iter)
+  {
+    this->MemorySize -= iter->Size;
+    this->Index.Erase(iter->TileKey);
+    this->Entries.erase(iter);
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileCache::vtkMapTileCache()
+{
+  this->MemoryLimit = 256 << 20;
+  this->TileOverhead = 16 << 10;
+  this->TilePool = nullptr;
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileCache::~vtkMapTileCache()
+{
+  delete this->Internals;
+  this->SetTilePool(nullptr);
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MemoryLimit: " << this->MemoryLimit << "\n"
+     << indent << "TileOverhead: " << this->TileOverhead << "\n"
+     << indent << "NumberOfTiles: " << this->Internals->Entries.size() << "\n"
+     << indent << "MemorySize: " << this->Internals->MemorySize << std::endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileCache::AddTile(int zoom, int x, int y, vtkMapTile* tile)
+{
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zoom, x, y);
+  vtkInternals::EntryList::iterator* found = this->Internals->Index.Find(key);
+  if (found)
+  {
+    this->Internals->Erase(*found);
+  }
+
+  vtkInternals::Entry entry;
+  entry.TileKey = key;
+  entry.Tile = tile;
+  entry.Size = tile->GetMemorySize() + this->TileOverhead;
+  this->Internals->Entries.push_front(entry);
+  this->Internals->Index.Insert(key, this->Internals->Entries.begin());
+  this->Internals->MemorySize += entry.Size;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTile* vtkMapTileCache::GetTile(int zoom, int x, int y)
+{
+  vtkInternals::EntryList::iterator* found =
+    this->Internals->Index.Find(vtkMapTileKey::Make(zoom, x, y));
+  if (!found)
+  {
+    return nullptr;
+  }
+
+  // Move entry to front of the list (iterators remain valid)
+  vtkInternals::EntryList& entries = this->Internals->Entries;
+  entries.splice(entries.begin(), entries, *found);
+  return (*found)->Tile;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTile* vtkMapTileCache::FindTile(int zoom, int x, int y)
+{
+  vtkInternals::EntryList::iterator* found =
+    this->Internals->Index.Find(vtkMapTileKey::Make(zoom, x, y));
+  return found ? (*found)->Tile.GetPointer() : nullptr;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileCache::SetPinnedTiles(
+  const std::vector<vtkSmartPointer<vtkMapTile> >& tiles)
+{
+  this->Internals->Pinned.clear();
+  for (std::size_t i = 0; i < tiles.size(); ++i)
+  {
+    this->Internals->Pinned.insert(tiles[i].GetPointer());
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileCache::Trim()
+{
+  if (this->MemoryLimit == 0)
+  {
+    return;
+  }
+
+  vtkInternals::EntryList& entries = this->Internals->Entries;
+  auto iter = entries.end();
+  while (this->Internals->MemorySize > this->MemoryLimit &&
+    iter != entries.begin())
+  {
+    --iter;
+    if (this->Internals->Pinned.count(iter->Tile.GetPointer()))
+    {
+      continue;
+    }
+
+    // Erase current entry and continue from the next more recent one
+    auto evicted = iter++;
+    vtkDebugMacro("Evicting tile "
+      << vtkMapTileKey::Zoom(evicted->TileKey) << "-"
+      << vtkMapTileKey::X(evicted->TileKey) << "-"
+      << vtkMapTileKey::Y(evicted->TileKey));
+    if (this->TilePool)
+    {
+      this->TilePool->ReleaseTile(evicted->Tile);
+    }
+    this->Internals->Erase(evicted);
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileCache::Clear()
+{
+  this->Internals->Entries.clear();
+  this->Internals->Index.Clear();
+  this->Internals->Pinned.clear();
+  this->Internals->MemorySize = 0;
+}
+
+//----------------------------------------------------------------------------
+std::size_t vtkMapTileCache::GetNumberOfTiles()
+{
+  return this->Internals->Entries.size();
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTileCache::GetMemorySize()
+{
+  return this->Internals->MemorySize;
+}
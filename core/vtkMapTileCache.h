@@ -0,0 +1,113 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileCache.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileCache - bounded in-memory cache of built map tiles
+// .SECTION Description
+// Holds the vtkMapTile instances built by vtkOsmLayer, indexed by
+// (zoom, x, y). The cache has a memory budget, computed as the size of
+// each tile's decoded texture plus a fixed per-tile overhead for its
+// geometry and rendering pipeline. Trim() evicts least-recently-used
+// tiles until the cache fits the budget. Pinned tiles (the tiles
+// currently displayed) are never evicted, so the cache can temporarily
+// exceed its budget when the visible set alone is larger. Evicted tiles
+// are recycled by TilePool, if set.
+
+#ifndef __vtkMapTileCache_h
+#define __vtkMapTileCache_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+#include <vector>
+
+class vtkMapTile;
+class vtkMapTilePool;
+
+class VTKMAPCORE_EXPORT vtkMapTileCache : public vtkObject
+{
+public:
+  static vtkMapTileCache* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileCache, vtkObject);
+
+  // Description:
+  // Memory budget in bytes. A value of 0 disables eviction.
+  // Default is 256 MiB.
+  vtkSetMacro(MemoryLimit, vtkTypeUInt64);
+  vtkGetMacro(MemoryLimit, vtkTypeUInt64);
+
+  // Description:
+  // Estimated memory used by each tile in addition to its texture
+  // (plane source, texture mapping, mapper and actor).
+  // Default is 16 KiB.
+  vtkSetMacro(TileOverhead, vtkTypeUInt64);
+  vtkGetMacro(TileOverhead, vtkTypeUInt64);
+
+  // Description:
+  // Pool receiving the evicted tiles for reuse (see vtkMapTilePool).
+  // Optional.
+  void SetTilePool(vtkMapTilePool* pool);
+  vtkGetObjectMacro(TilePool, vtkMapTilePool);
+
+  // Description:
+  // Add tile to the cache, replacing any tile with the same indices.
+  // The tile should be initialized, so that its memory size is known.
+  void AddTile(int zoom, int x, int y, vtkMapTile* tile);
+
+  // Description:
+  // Returns cached tile or nullptr, and marks the tile as recently used.
+  vtkMapTile* GetTile(int zoom, int x, int y);
+
+  // Description:
+  // Returns cached tile or nullptr, without marking it as recently
+  // used, e.g. to look for a tile that may not be displayed.
+  vtkMapTile* FindTile(int zoom, int x, int y);
+
+  // Description:
+  // Replace the set of tiles protected from eviction.
+  void SetPinnedTiles(const std::vector<vtkSmartPointer<vtkMapTile> >& tiles);
+
+  // Description:
+  // Evict least-recently-used, unpinned tiles until the cache
+  // fits its memory budget.
+  void Trim();
+
+  // Description:
+  // Remove all tiles, including pinned ones.
+  void Clear();
+
+  // Description:
+  // Current number of tiles and estimated memory size (bytes).
+  std::size_t GetNumberOfTiles();
+  vtkTypeUInt64 GetMemorySize();
+
+protected:
+  vtkMapTileCache();
+  ~vtkMapTileCache() override;
+
+  vtkTypeUInt64 MemoryLimit;
+  vtkTypeUInt64 TileOverhead;
+  vtkMapTilePool* TilePool;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileCache(const vtkMapTileCache&);            // Not implemented
+  vtkMapTileCache& operator=(const vtkMapTileCache&); // Not implemented
+};
+
+#endif // __vtkMapTileCache_h
@@ -0,0 +1,165 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileCoverage.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileCoverage - map tiles covering an area
+// .SECTION Description
+// Lists the map tiles (vtkMapTileKey keys) of a zoom level that intersect
+// an area given as lon/lat rings, e.g. the rings of a GeoJSON polygon or
+// of a bounding box. Used to seed the tiles of an area into a cache.
+
+#ifndef __vtkMapTileCoverage_h
+#define __vtkMapTileCoverage_h
+
+#include "vtkMapTileKey.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+class vtkMapTileCoverage
+{
+public:
+  typedef std::vector<double> Ring; // lon, lat pairs
+
+  //----------------------------------------------------------------------------
+  // Appends the ring of a lat/lon bounding box. A box crossing the
+  // antimeridian (minLon > maxLon) is split into two rings, one on each
+  // side of it.
+  static void AddBoundingBox(double minLat, double minLon, double maxLat,
+    double maxLon, std::vector<Ring>& rings)
+  {
+    if (minLon > maxLon)
+    {
+      AddBoundingBox(minLat, minLon, maxLat, 180.0, rings);
+      AddBoundingBox(minLat, -180.0, maxLat, maxLon, rings);
+      return;
+    }
+    Ring ring = { minLon, minLat, maxLon, minLat, maxLon, maxLat, minLon,
+      maxLat };
+    rings.push_back(ring);
+  }
+
+  //----------------------------------------------------------------------------
+  // Appends the keys of the tiles at zoom intersecting the area of rings
+  // (even-odd rule, so that inner rings are holes)
+  static void AddCoveringTiles(const std::vector<Ring>& rings, int zoom,
+    std::vector<vtkTypeUInt64>& tiles)
+  {
+    // Convert to fractional tile coordinates, y from the north
+    const double pi = 3.14159265358979323846;
+    const double maxLat = 85.0511287798;
+    int numTiles = 1 << zoom;
+    std::vector<Ring> tileRings;
+    double yMin = numTiles;
+    double yMax = 0.0;
+    for (std::size_t r = 0; r < rings.size(); ++r)
+    {
+      Ring tileRing;
+      for (std::size_t i = 0; i + 1 < rings[r].size(); i += 2)
+      {
+        double lon = rings[r][i];
+        double lat = std::max(-maxLat, std::min(maxLat, rings[r][i + 1]));
+        double latRad = lat * pi / 180.0;
+        double mercator =
+          std::log(std::tan(latRad) + 1.0 / std::cos(latRad)) / pi;
+        double x = (lon + 180.0) / 360.0 * numTiles;
+        double y = (1.0 - mercator) / 2.0 * numTiles;
+        tileRing.push_back(x);
+        tileRing.push_back(y);
+        yMin = std::min(yMin, y);
+        yMax = std::max(yMax, y);
+      }
+      tileRings.push_back(tileRing);
+    }
+
+    int rowMin = std::max(0, static_cast<int>(std::floor(yMin)));
+    int rowMax = std::min(numTiles - 1, static_cast<int>(std::floor(yMax)));
+    for (int row = rowMin; row <= rowMax; ++row)
+    {
+      // Spans of the row: tiles crossed by the boundary, and tiles inside
+      // the area along the middle of the row
+      std::vector<std::pair<double, double> > spans;
+      std::vector<double> crossings;
+      double middle = row + 0.5;
+      for (std::size_t r = 0; r < tileRings.size(); ++r)
+      {
+        const Ring& ring = tileRings[r];
+        std::size_t n = ring.size() / 2;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+          double px = ring[2 * i];
+          double py = ring[2 * i + 1];
+          double qx = ring[2 * ((i + 1) % n)];
+          double qy = ring[2 * ((i + 1) % n) + 1];
+          if (std::max(py, qy) < row || std::min(py, qy) > row + 1)
+          {
+            continue;
+          }
+
+          double x0 = px;
+          double x1 = qx;
+          if (py != qy)
+          {
+            double t0 = (row - py) / (qy - py);
+            double t1 = (row + 1 - py) / (qy - py);
+            double tLow = std::max(0.0, std::min(t0, t1));
+            double tHigh = std::min(1.0, std::max(t0, t1));
+            x0 = px + tLow * (qx - px);
+            x1 = px + tHigh * (qx - px);
+          }
+          spans.push_back(
+            std::make_pair(std::min(x0, x1), std::max(x0, x1)));
+
+          if ((py > middle) != (qy > middle))
+          {
+            crossings.push_back(px + (middle - py) * (qx - px) / (qy - py));
+          }
+        }
+      }
+      std::sort(crossings.begin(), crossings.end());
+      for (std::size_t i = 0; i + 1 < crossings.size(); i += 2)
+      {
+        spans.push_back(std::make_pair(crossings[i], crossings[i + 1]));
+      }
+
+      // Merge spans into ranges of tile columns
+      std::vector<std::pair<int, int> > columns;
+      for (std::size_t i = 0; i < spans.size(); ++i)
+      {
+        int first =
+          std::max(0, static_cast<int>(std::floor(spans[i].first)));
+        int last = std::min(
+          numTiles - 1, static_cast<int>(std::floor(spans[i].second)));
+        if (first <= last)
+        {
+          columns.push_back(std::make_pair(first, last));
+        }
+      }
+      std::sort(columns.begin(), columns.end());
+      int next = 0; // first column not added yet
+      for (std::size_t i = 0; i < columns.size(); ++i)
+      {
+        for (int x = std::max(next, columns[i].first);
+             x <= columns[i].second; ++x)
+        {
+          tiles.push_back(vtkMapTileKey::Make(zoom, x, row));
+        }
+        next = std::max(next, columns[i].second + 1);
+      }
+    }
+  }
+};
+
+#endif // __vtkMapTileCoverage_h
@@ -0,0 +1,1575 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileDiskCache.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileDiskCache.h"
+#include "vtkMapTileIndex.h"
+#include "vtkMapTileKey.h"
+
+#include <vtkAtomic.h>
+#include <vtkConditionVariable.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtksys/Directory.hxx>
+#include <vtksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <process.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+vtkStandardNewMacro(vtkMapTileDiskCache);
+
+//----------------------------------------------------------------------------
+static VTK_THREAD_RETURN_TYPE StaticBackgroundThreadExecute(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  vtkMapTileDiskCache* self =
+    static_cast<vtkMapTileDiskCache*>(info->UserData);
+  self->BackgroundThreadExecute();
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+// Creates a hard link, fails if target exists or links are not supported
+static bool LinkFile(const std::string& source, const std::string& target)
+{
+#ifdef _WIN32
+  return CreateHardLinkA(target.c_str(), source.c_str(), NULL) != 0;
+#else
+  return link(source.c_str(), target.c_str()) == 0;
+#endif
+}
+
+//----------------------------------------------------------------------------
+class vtkMapTileDiskCache::vtkInternals
+{
+public:
+  struct Entry
+  {
+    vtkTypeUInt64 Size;
+    vtkTypeInt64 AccessTime;
+    std::string Name; // relative to Directory
+    vtkMapTileDiskCache::Metadata Meta;
+    vtkTypeUInt64 ContentHash; // 0 if unknown, see AddFile()
+
+    Entry()
+      : Size(0)
+      , AccessTime(0)
+      , ContentHash(0)
+    {
+    }
+  };
+
+  // Tile that the server failed to provide, see AddFailure()
+  struct Failure
+  {
+    vtkTypeInt64 RetryTime;
+    int Count; // consecutive failures
+
+    Failure()
+      : RetryTime(0)
+      , Count(0)
+    {
+    }
+  };
+
+  // All members are protected by Lock
+  std::string Directory;
+  vtkMapTileIndex<Entry> Entries;
+  vtkMapTileIndex<Failure> Failures;
+  // Keys of the entries by ContentHash
+  vtkMapTileIndex<std::vector<vtkTypeUInt64> > Contents;
+  vtkTypeUInt64 TotalSize;
+  FILE* Journal; // index file, opened for appending
+  std::size_t JournalRecords;
+  bool Dirty; // in-memory state differs from index file
+
+  // Other processes may share the directory. The index file is only
+  // accessed with IndexLockFile locked; records appended by the other
+  // processes are read from ReadOffset, unless the index was replaced
+  // by a snapshot with another SnapshotId. See CatchUp().
+  std::string SnapshotId;
+  std::streamoff ReadOffset;
+  int IndexLockDepth;
+#ifdef _WIN32
+  HANDLE IndexLockFile;
+#else
+  int IndexLockFile;
+#endif
+
+  // Downloads claimed by this process, see ClaimFile()
+  vtkMapTileIndex<bool> Claims;
+  std::string ProcessId;
+  std::string TempSuffix; // unique to this process
+
+  // Write-behind queue. Data is kept in PendingWrites until the file
+  // is in place; a key is queued once however often it is rewritten.
+  struct PendingWrite
+  {
+    std::string Path;
+    std::vector<unsigned char> Data;
+    vtkMapTileDiskCache::Metadata Meta;
+    unsigned int Sequence; // incremented for each rewrite
+
+    PendingWrite()
+      : Sequence(0)
+    {
+    }
+  };
+  vtkMapTileIndex<PendingWrite> PendingWrites;
+  std::deque<vtkTypeUInt64> WriteQueue;
+  bool WriteInProgress;
+
+  // Keys of files to move to the current layout, see MigrateFiles()
+  std::vector<vtkTypeUInt64> MigrationQueue;
+
+  vtkMutexLock* Lock;
+  vtkConditionVariable* Condition; // broadcast on any state change
+  bool CompactionRequested;
+  bool MigrationRequested;
+  vtkAtomic<vtkTypeInt32> ThreadingEnabled;
+  vtkMultiThreader* Threader;
+  int ThreadId;
+
+  vtkInternals()
+    : TotalSize(0)
+    , Journal(nullptr)
+    , JournalRecords(0)
+    , Dirty(false)
+    , ReadOffset(0)
+    , IndexLockDepth(0)
+#ifdef _WIN32
+    , IndexLockFile(INVALID_HANDLE_VALUE)
+#else
+    , IndexLockFile(-1)
+#endif
+    , WriteInProgress(false)
+    , CompactionRequested(false)
+    , MigrationRequested(false)
+    , ThreadId(-1)
+  {
+  }
+
+  std::string IndexPath() const
+  {
+    return this->Directory + "/" + vtkMapTileDiskCache::IndexFileName();
+  }
+
+  std::string ClaimPath(vtkTypeUInt64 key) const
+  {
+    std::ostringstream path;
+    path << this->Directory << "/claims/" << key;
+    return path.str();
+  }
+
+  void OpenIndexLock()
+  {
+    std::string path = this->IndexPath() + ".lock";
+#ifdef _WIN32
+    this->IndexLockFile = CreateFileA(path.c_str(),
+      GENERIC_READ | GENERIC_WRITE,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+      OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+    this->IndexLockFile = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+  }
+
+  void CloseIndexLock()
+  {
+#ifdef _WIN32
+    if (this->IndexLockFile != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(this->IndexLockFile);
+      this->IndexLockFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (this->IndexLockFile >= 0)
+    {
+      close(this->IndexLockFile);
+      this->IndexLockFile = -1;
+    }
+#endif
+  }
+
+  // Advisory lock of the index file among processes, reentrant.
+  // Without a lock file (e.g. read-only directory) nothing is locked.
+  void LockIndex()
+  {
+    if (this->IndexLockDepth++ > 0)
+    {
+      return;
+    }
+#ifdef _WIN32
+    if (this->IndexLockFile != INVALID_HANDLE_VALUE)
+    {
+      OVERLAPPED overlapped = {};
+      LockFileEx(this->IndexLockFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0,
+        &overlapped);
+    }
+#else
+    if (this->IndexLockFile >= 0)
+    {
+      while (flock(this->IndexLockFile, LOCK_EX) != 0 && errno == EINTR)
+      {
+      }
+    }
+#endif
+  }
+
+  void UnlockIndex()
+  {
+    if (--this->IndexLockDepth > 0)
+    {
+      return;
+    }
+#ifdef _WIN32
+    if (this->IndexLockFile != INVALID_HANDLE_VALUE)
+    {
+      OVERLAPPED overlapped = {};
+      UnlockFileEx(this->IndexLockFile, 0, 1, 0, &overlapped);
+    }
+#else
+    if (this->IndexLockFile >= 0)
+    {
+      flock(this->IndexLockFile, LOCK_UN);
+    }
+#endif
+  }
+
+  void Set(vtkTypeUInt64 key, const Entry& entry)
+  {
+    Entry* existing = this->Entries.Find(key);
+    if (existing)
+    {
+      this->TotalSize -= existing->Size;
+      this->ForgetContent(key, *existing);
+    }
+    // The content hash is linked by SetContentHash()
+    this->Entries.Insert(key, entry).ContentHash = 0;
+    this->TotalSize += entry.Size;
+    this->SetContentHash(key, entry.ContentHash);
+  }
+
+  bool Remove(vtkTypeUInt64 key, std::string* name = nullptr)
+  {
+    Entry* existing = this->Entries.Find(key);
+    if (!existing)
+    {
+      return false;
+    }
+    if (name)
+    {
+      *name = existing->Name;
+    }
+    this->TotalSize -= existing->Size;
+    this->ForgetContent(key, *existing);
+    this->Entries.Erase(key);
+    return true;
+  }
+
+  void SetContentHash(vtkTypeUInt64 key, vtkTypeUInt64 hash)
+  {
+    Entry* entry = this->Entries.Find(key);
+    if (!entry || hash == 0 || hash == vtkMapTileKey::Invalid() ||
+      entry->ContentHash == hash)
+    {
+      return;
+    }
+    this->ForgetContent(key, *entry);
+    entry->ContentHash = hash;
+    std::vector<vtkTypeUInt64>* keys = this->Contents.Find(hash);
+    if (!keys)
+    {
+      keys = &this->Contents.Insert(hash, std::vector<vtkTypeUInt64>());
+    }
+    keys->push_back(key);
+  }
+
+  // The content remains found through the other entries having it
+  void ForgetContent(vtkTypeUInt64 key, const Entry& entry)
+  {
+    std::vector<vtkTypeUInt64>* keys = entry.ContentHash != 0
+      ? this->Contents.Find(entry.ContentHash)
+      : nullptr;
+    if (!keys)
+    {
+      return;
+    }
+    std::vector<vtkTypeUInt64>::iterator it =
+      std::find(keys->begin(), keys->end(), key);
+    if (it != keys->end())
+    {
+      *it = keys->back();
+      keys->pop_back();
+    }
+    if (keys->empty())
+    {
+      this->Contents.Erase(entry.ContentHash);
+    }
+  }
+
+  // Returns the path of a file holding data, or an empty string. The
+  // hash only selects a candidate, whose content is then compared.
+  std::string FindContent(
+    vtkTypeUInt64 hash, const std::vector<unsigned char>& data)
+  {
+    this->Lock->Lock();
+    std::vector<vtkTypeUInt64>* keys = this->Contents.Find(hash);
+    Entry* entry = keys ? this->Entries.Find(keys->front()) : nullptr;
+    std::string path;
+    if (entry && entry->Size == data.size())
+    {
+      path = this->Directory + "/" + entry->Name;
+    }
+    this->Lock->Unlock();
+
+    if (!path.empty())
+    {
+      std::vector<char> content(data.size() + 1);
+      std::ifstream in(path.c_str(), std::ios::binary);
+      in.read(content.data(), static_cast<std::streamsize>(content.size()));
+      if (static_cast<std::size_t>(in.gcount()) != data.size() ||
+        memcmp(content.data(), data.data(), data.size()) != 0)
+      {
+        path.clear();
+      }
+    }
+    return path;
+  }
+
+  void WriteRecord(std::ostream& os, vtkTypeUInt64 key, const Entry& entry)
+  {
+    os << "A " << key << " " << entry.Size << " " << entry.AccessTime << " "
+       << entry.Name << "\n";
+    const vtkMapTileDiskCache::Metadata& meta = entry.Meta;
+    if (meta.Expires != 0 || meta.LastModified != 0 || !meta.ETag.empty())
+    {
+      this->WriteMetadataRecord(os, key, meta);
+    }
+    if (entry.ContentHash != 0)
+    {
+      os << "H " << key << " " << entry.ContentHash << "\n";
+    }
+  }
+
+  // Metadata follows the entry it belongs to, the ETag is last as it
+  // may contain spaces
+  void WriteMetadataRecord(std::ostream& os, vtkTypeUInt64 key,
+    const vtkMapTileDiskCache::Metadata& meta)
+  {
+    os << "M " << key << " " << meta.Expires << " " << meta.LastModified
+       << " " << meta.ETag << "\n";
+  }
+
+  void WriteFailureRecord(
+    std::ostream& os, vtkTypeUInt64 key, const Failure& failure)
+  {
+    os << "F " << key << " " << failure.Count << " " << failure.RetryTime
+       << "\n";
+  }
+
+  // Number of records in a snapshot of the index
+  std::size_t NumberOfRecords() const
+  {
+    return this->Entries.Size() + this->Failures.Size();
+  }
+
+  // The record is read back with those appended by other processes, so
+  // that it is applied again if catching up reloaded the index
+  void AppendToJournal(const std::string& record)
+  {
+    this->LockIndex();
+    this->CatchUp();
+    if (this->Journal)
+    {
+      fputs(record.c_str(), this->Journal);
+      fflush(this->Journal);
+      this->CatchUp();
+    }
+    this->UnlockIndex();
+  }
+
+  void CloseJournal()
+  {
+    if (this->Journal)
+    {
+      fclose(this->Journal);
+      this->Journal = nullptr;
+    }
+  }
+
+  // Replays records from in, up to the last complete line, and advances
+  // ReadOffset past them
+  void ReadRecords(std::istream& in)
+  {
+    std::string line;
+    while (std::getline(in, line) && !in.eof())
+    {
+      this->ReadOffset += static_cast<std::streamoff>(line.size() + 1);
+      std::istringstream iss(line);
+      char op = 0;
+      vtkTypeUInt64 key = 0;
+      iss >> op;
+      if (op == 'V')
+      {
+        iss.ignore(1);
+        std::getline(iss, this->SnapshotId);
+        continue;
+      }
+      iss >> key;
+      if (op == 'A')
+      {
+        Entry entry;
+        iss >> entry.Size >> entry.AccessTime;
+        iss.ignore(1);
+        std::getline(iss, entry.Name);
+        if (!iss.fail() && !entry.Name.empty())
+        {
+          this->Set(key, entry);
+        }
+      }
+      else if (op == 'M')
+      {
+        Entry* entry = this->Entries.Find(key);
+        vtkMapTileDiskCache::Metadata meta;
+        iss >> meta.Expires >> meta.LastModified;
+        bool valid = !iss.fail();
+        iss.ignore(1);
+        std::getline(iss, meta.ETag); // may be empty
+        if (entry && valid)
+        {
+          entry->Meta = meta;
+        }
+      }
+      else if (op == 'H')
+      {
+        vtkTypeUInt64 hash = 0;
+        iss >> hash;
+        if (!iss.fail())
+        {
+          this->SetContentHash(key, hash);
+        }
+      }
+      else if (op == 'R')
+      {
+        this->Remove(key);
+      }
+      else if (op == 'F')
+      {
+        Failure failure;
+        iss >> failure.Count >> failure.RetryTime;
+        if (!iss.fail())
+        {
+          this->Failures.Insert(key, failure);
+        }
+      }
+      else if (op == 'C')
+      {
+        this->Failures.Erase(key);
+      }
+      // Metadata and content hash are counted with their entry
+      this->JournalRecords += op == 'M' || op == 'H' ? 0 : 1;
+    }
+  }
+
+  // Replays snapshot + journal, returns false if there is no index file
+  bool Load()
+  {
+    std::ifstream in(this->IndexPath().c_str(), std::ios::binary);
+    if (!in)
+    {
+      return false;
+    }
+    this->SnapshotId.clear();
+    this->ReadOffset = 0;
+    this->ReadRecords(in);
+    return true;
+  }
+
+  // Applies the records appended by other processes since the last
+  // read, or reloads the index if another process replaced it with a
+  // snapshot (access times recorded since the last snapshot are then
+  // lost). The index lock must be held.
+  void CatchUp()
+  {
+    std::ifstream in(this->IndexPath().c_str(), std::ios::binary);
+    std::string line;
+    if (!in || !std::getline(in, line))
+    {
+      return;
+    }
+    std::string id = line.compare(0, 2, "V ") == 0 ? line.substr(2) : "";
+    if (id != this->SnapshotId)
+    {
+      this->Entries.Clear();
+      this->Failures.Clear();
+      this->Contents.Clear();
+      this->TotalSize = 0;
+      this->JournalRecords = 0;
+      in.seekg(0);
+      this->SnapshotId.clear();
+      this->ReadOffset = 0;
+      this->ReadRecords(in);
+      // The journal was replaced with the index file
+      this->CloseJournal();
+      this->Journal = fopen(this->IndexPath().c_str(), "ab");
+      return;
+    }
+    in.seekg(this->ReadOffset);
+    this->ReadRecords(in);
+  }
+
+  // Builds index from the files in the directory (one-time migration)
+  void Scan()
+  {
+    std::vector<std::pair<vtkTypeUInt64, std::string> > files;
+    vtkMapTileDiskCache::FindTileFiles(this->Directory, files);
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+      std::string path = this->Directory + "/" + files[i].second;
+      Entry entry;
+      entry.Name = files[i].second;
+      entry.Size = vtksys::SystemTools::FileLength(path);
+      entry.AccessTime = vtksys::SystemTools::ModifiedTime(path);
+      this->Set(files[i].first, entry);
+    }
+    this->Dirty = true;
+  }
+
+  // Rewrites index file with current entries, then reopens journal
+  void WriteSnapshot()
+  {
+    this->LockIndex();
+    this->CatchUp();
+    this->CloseJournal();
+    std::string indexPath = this->IndexPath();
+    std::string tempPath = indexPath + this->TempSuffix;
+    // Counted across instances, that may share the directory
+    static vtkAtomic<vtkTypeInt32> snapshotCount;
+    std::ostringstream id;
+    id << this->ProcessId << "-" << time(nullptr) << "-" << ++snapshotCount;
+    this->SnapshotId = id.str();
+    {
+      std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+      out << "V " << this->SnapshotId << "\n";
+      this->Entries.ForEach([&](vtkTypeUInt64 key, const Entry& entry) {
+        this->WriteRecord(out, key, entry);
+      });
+      this->Failures.ForEach([&](vtkTypeUInt64 key, const Failure& failure) {
+        this->WriteFailureRecord(out, key, failure);
+      });
+    }
+    if (!vtksys::SystemTools::RenameFile(tempPath.c_str(), indexPath.c_str()))
+    {
+      // E.g. held open by another process on Windows, keep the journal
+      remove(tempPath.c_str());
+      this->SnapshotId.clear();
+      this->Journal = fopen(indexPath.c_str(), "ab");
+      this->CatchUp();
+      this->UnlockIndex();
+      return;
+    }
+    this->Journal = fopen(indexPath.c_str(), "ab");
+    if (this->Journal)
+    {
+      fseek(this->Journal, 0, SEEK_END);
+      this->ReadOffset = ftell(this->Journal);
+    }
+    this->JournalRecords = this->NumberOfRecords();
+    this->Dirty = false;
+    this->UnlockIndex();
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileDiskCache::vtkMapTileDiskCache()
+{
+  this->MaxSize = vtkTypeUInt64(1) << 30;
+  this->MaxNumberOfFiles = 100000;
+  this->DefaultMaxAge = 7 * 24 * 3600;
+  this->MinRetryDelay = 3600;
+  this->MaxRetryDelay = 30 * 24 * 3600;
+  this->Layout = ShardedLayout;
+  this->ClaimTimeout = 60;
+  this->Internals = new vtkInternals;
+  std::ostringstream pid;
+#ifdef _WIN32
+  pid << _getpid();
+#else
+  pid << getpid();
+#endif
+  this->Internals->ProcessId = pid.str();
+  this->Internals->TempSuffix = "." + pid.str() + ".tmp";
+  this->Internals->Lock = vtkMutexLock::New();
+  this->Internals->Condition = vtkConditionVariable::New();
+  this->Internals->ThreadingEnabled = 1;
+  this->Internals->Threader = vtkMultiThreader::New();
+  this->Internals->ThreadId = this->Internals->Threader->SpawnThread(
+    StaticBackgroundThreadExecute, this);
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileDiskCache::~vtkMapTileDiskCache()
+{
+  this->Internals->Lock->Lock();
+  this->Internals->ThreadingEnabled = 0;
+  this->Internals->Condition->Broadcast();
+  this->Internals->Lock->Unlock();
+  // Thread completes queued writes before exiting
+  this->Internals->Threader->TerminateThread(this->Internals->ThreadId);
+
+  // Persist access times
+  this->Compact();
+
+  this->ReleaseClaims();
+  this->Internals->CloseJournal();
+  this->Internals->CloseIndexLock();
+  this->Internals->Threader->Delete();
+  this->Internals->Condition->Delete();
+  this->Internals->Lock->Delete();
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Directory: " << this->Internals->Directory << "\n"
+     << indent << "MaxSize: " << this->MaxSize << "\n"
+     << indent << "MaxNumberOfFiles: " << this->MaxNumberOfFiles << "\n"
+     << indent << "DefaultMaxAge: " << this->DefaultMaxAge << "\n"
+     << indent << "MinRetryDelay: " << this->MinRetryDelay << "\n"
+     << indent << "MaxRetryDelay: " << this->MaxRetryDelay << "\n"
+     << indent << "Layout: " << this->Layout << "\n"
+     << indent << "ClaimTimeout: " << this->ClaimTimeout << "\n"
+     << indent << "Size: " << this->Internals->TotalSize << "\n"
+     << indent << "NumberOfFiles: " << this->Internals->Entries.Size() << "\n"
+     << indent << "NumberOfFailures: " << this->Internals->Failures.Size()
+     << std::endl;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkMapTileDiskCache::IndexFileName()
+{
+  return "tile-index.txt";
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::SetDirectory(const std::string& path)
+{
+  if (path == this->GetDirectory())
+  {
+    return;
+  }
+
+  // Flush previous directory
+  this->FlushWrites();
+  this->Compact();
+  this->ReleaseClaims();
+
+  this->Internals->Lock->Lock();
+  this->Internals->CloseJournal();
+  this->Internals->CloseIndexLock();
+  this->Internals->Entries.Clear();
+  this->Internals->Failures.Clear();
+  this->Internals->Contents.Clear();
+  this->Internals->MigrationQueue.clear();
+  this->Internals->TotalSize = 0;
+  this->Internals->JournalRecords = 0;
+  this->Internals->Directory = path;
+  if (!path.empty())
+  {
+    // Other processes may open the directory at the same time
+    this->Internals->OpenIndexLock();
+    this->Internals->LockIndex();
+    if (!this->Internals->Load())
+    {
+      vtkDebugMacro("Building tile index for " << path);
+      this->Internals->Scan();
+    }
+    this->Internals->WriteSnapshot();
+    this->Internals->UnlockIndex();
+    vtksys::SystemTools::MakeDirectory((path + "/claims").c_str());
+
+    // Move files of another layout, if any
+    this->Internals->MigrationRequested = true;
+    this->Internals->Condition->Broadcast();
+  }
+  this->Internals->Lock->Unlock();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+std::string vtkMapTileDiskCache::GetDirectory()
+{
+  this->Internals->Lock->Lock();
+  std::string path = this->Internals->Directory;
+  this->Internals->Lock->Unlock();
+  return path;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::SetLayout(int layout)
+{
+  layout = std::max(static_cast<int>(FlatLayout),
+    std::min(layout, static_cast<int>(HashedLayout)));
+  this->Internals->Lock->Lock();
+  if (layout == this->Layout)
+  {
+    this->Internals->Lock->Unlock();
+    return;
+  }
+  this->Layout = layout;
+  this->Internals->MigrationQueue.clear();
+  this->Internals->MigrationRequested = true;
+  this->Internals->Condition->Broadcast();
+  this->Internals->Lock->Unlock();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+// Removes a directory if it is empty
+static bool RemoveEmptyDirectory(const std::string& path)
+{
+#ifdef _WIN32
+  return RemoveDirectoryA(path.c_str()) != 0;
+#else
+  return rmdir(path.c_str()) == 0;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// MakeFileName() in layout, which is read with the lock held
+static std::string MakeLayoutFileName(
+  int layout, vtkTypeUInt64 key, const std::string& extension)
+{
+  int zoom = vtkMapTileKey::Zoom(key);
+  int x = vtkMapTileKey::X(key);
+  int y = vtkMapTileKey::Y(key);
+  char name[128];
+  switch (layout)
+  {
+    case vtkMapTileDiskCache::FlatLayout:
+      snprintf(name, sizeof(name), "%d-%d-%d.", zoom, x, y);
+      break;
+    case vtkMapTileDiskCache::HashedLayout:
+    {
+      unsigned int hash =
+        static_cast<unsigned int>(vtkMapTileKey::Hash(key) >> 48);
+      snprintf(name, sizeof(name), "%02x/%02x/%d-%d-%d.", hash >> 8,
+        hash & 0xff, zoom, x, y);
+      break;
+    }
+    default:
+      snprintf(name, sizeof(name), "%d/%d/%d.", zoom, x, y);
+      break;
+  }
+  return name + extension;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkMapTileDiskCache::MakeFileName(
+  vtkTypeUInt64 key, const std::string& extension)
+{
+  this->Internals->Lock->Lock();
+  int layout = this->Layout;
+  this->Internals->Lock->Unlock();
+  return MakeLayoutFileName(layout, key, extension);
+}
+
+//----------------------------------------------------------------------------
+// Parses a tile index, which must be the whole string
+static bool ParseTileIndex(const std::string& s, int& value)
+{
+  if (s.empty() || s.size() > 9 ||
+    s.find_first_not_of("0123456789") != std::string::npos)
+  {
+    return false;
+  }
+  value = atoi(s.c_str());
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::ParseFileName(
+  const std::string& name, vtkTypeUInt64& key)
+{
+  std::vector<std::string> parts;
+  std::size_t start = 0;
+  for (std::size_t slash = name.find('/'); slash != std::string::npos;
+       slash = name.find('/', start))
+  {
+    parts.push_back(name.substr(start, slash - start));
+    start = slash + 1;
+  }
+  std::string leaf = name.substr(start);
+
+  // Single extension, which excludes temporary files
+  std::size_t dot = leaf.find('.');
+  if (dot == std::string::npos || dot + 1 == leaf.size() ||
+    leaf.find('.', dot + 1) != std::string::npos ||
+    leaf.compare(dot, std::string::npos, ".tmp") == 0)
+  {
+    return false;
+  }
+  std::string stem = leaf.substr(0, dot);
+
+  // z-x-y.ext (flat and hashed layouts), else z/x/y.ext
+  int zoom, x, y;
+  std::size_t dash1 = stem.find('-');
+  std::size_t dash2 =
+    dash1 == std::string::npos ? dash1 : stem.find('-', dash1 + 1);
+  bool ok = dash2 != std::string::npos
+    ? ParseTileIndex(stem.substr(0, dash1), zoom) &&
+      ParseTileIndex(stem.substr(dash1 + 1, dash2 - dash1 - 1), x) &&
+      ParseTileIndex(stem.substr(dash2 + 1), y)
+    : parts.size() >= 2 && ParseTileIndex(parts[parts.size() - 2], zoom) &&
+      ParseTileIndex(parts[parts.size() - 1], x) && ParseTileIndex(stem, y);
+  if (!ok || zoom > 29)
+  {
+    return false;
+  }
+  key = vtkMapTileKey::Make(zoom, x, y);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Appends the tile files of directory/subdirectory, up to depth levels
+// of subdirectories
+static void FindTileFilesRecursive(const std::string& directory,
+  const std::string& subdirectory, int depth,
+  std::vector<std::pair<vtkTypeUInt64, std::string> >& files)
+{
+  vtksys::Directory dir;
+  std::string path =
+    subdirectory.empty() ? directory : directory + "/" + subdirectory;
+  if (!dir.Load(path))
+  {
+    return;
+  }
+  for (unsigned long i = 0; i < dir.GetNumberOfFiles(); ++i)
+  {
+    std::string name = dir.GetFile(i);
+    if (name == "." || name == "..")
+    {
+      continue;
+    }
+    std::string relative =
+      subdirectory.empty() ? name : subdirectory + "/" + name;
+    vtkTypeUInt64 key;
+    if (vtkMapTileDiskCache::ParseFileName(relative, key))
+    {
+      files.push_back(std::make_pair(key, relative));
+    }
+    else if (depth > 0 &&
+      vtksys::SystemTools::FileIsDirectory(directory + "/" + relative))
+    {
+      FindTileFilesRecursive(directory, relative, depth - 1, files);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::FindTileFiles(const std::string& directory,
+  std::vector<std::pair<vtkTypeUInt64, std::string> >& files)
+{
+  FindTileFilesRecursive(directory, "", 2, files);
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTileDiskCache::MigrateFiles(vtkTypeUInt64 maxFiles)
+{
+  vtkInternals* internals = this->Internals;
+  internals->Lock->Lock();
+  if (internals->MigrationQueue.empty())
+  {
+    internals->Entries.ForEach(
+      [&](vtkTypeUInt64 key, const vtkInternals::Entry& entry) {
+        std::size_t dot = entry.Name.rfind('.');
+        if (dot == std::string::npos ||
+          entry.Name !=
+            MakeLayoutFileName(this->Layout, key, entry.Name.substr(dot + 1)))
+        {
+          internals->MigrationQueue.push_back(key);
+        }
+      });
+  }
+  internals->Lock->Unlock();
+
+  // The lock is taken for each file, so that lookups are not blocked
+  // for the whole migration. A file is found at its old path until its
+  // entry is updated.
+  vtkTypeUInt64 moved = 0;
+  for (;;)
+  {
+    internals->Lock->Lock();
+    if (internals->MigrationQueue.empty() ||
+      (maxFiles > 0 && moved >= maxFiles))
+    {
+      internals->Lock->Unlock();
+      break;
+    }
+    vtkTypeUInt64 key = internals->MigrationQueue.back();
+    internals->MigrationQueue.pop_back();
+    vtkInternals::Entry* entry = internals->Entries.Find(key);
+    std::size_t dot = entry ? entry->Name.rfind('.') : std::string::npos;
+    if (dot != std::string::npos)
+    {
+      std::string name =
+        MakeLayoutFileName(this->Layout, key, entry->Name.substr(dot + 1));
+      std::string oldPath = internals->Directory + "/" + entry->Name;
+      std::string newPath = internals->Directory + "/" + name;
+      std::string newDirectory =
+        vtksys::SystemTools::GetFilenamePath(newPath);
+      // An existing file at the new path is more recent, and its entry
+      // is being added
+      if (name != entry->Name &&
+        !vtksys::SystemTools::FileExists(newPath.c_str(), true) &&
+        vtksys::SystemTools::MakeDirectory(newDirectory.c_str()) &&
+        vtksys::SystemTools::RenameFile(oldPath.c_str(), newPath.c_str()))
+      {
+        entry->Name = name;
+        std::ostringstream record;
+        internals->WriteRecord(record, key, *entry);
+        internals->AppendToJournal(record.str());
+        ++moved;
+
+        // Directories of the old layout are removed once emptied
+        std::string oldDirectory =
+          vtksys::SystemTools::GetFilenamePath(oldPath);
+        while (oldDirectory.size() > internals->Directory.size() &&
+          RemoveEmptyDirectory(oldDirectory))
+        {
+          oldDirectory = vtksys::SystemTools::GetFilenamePath(oldDirectory);
+        }
+      }
+    }
+    internals->Lock->Unlock();
+  }
+
+  if (moved > 0)
+  {
+    vtkDebugMacro("Moved " << moved << " tiles to the cache layout");
+    internals->Lock->Lock();
+    internals->CompactionRequested = true;
+    internals->Condition->Broadcast();
+    internals->Lock->Unlock();
+  }
+  return moved;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::AddFile(vtkTypeUInt64 key, const std::string& path,
+  vtkTypeUInt64 size, const Metadata& metadata, vtkTypeUInt64 contentHash)
+{
+  this->Internals->Lock->Lock();
+  const std::string& dir = this->Internals->Directory;
+
+  vtkInternals::Entry entry;
+  entry.Size = size;
+  entry.AccessTime = static_cast<vtkTypeInt64>(time(nullptr));
+  entry.Meta = metadata;
+  if (entry.Meta.Expires == 0)
+  {
+    // The file was just written, resolve now rather than with a stat
+    // in GetMetadata()
+    entry.Meta.Expires = entry.AccessTime + this->DefaultMaxAge;
+  }
+  entry.Name = path;
+  if (path.compare(0, dir.size() + 1, dir + "/") == 0)
+  {
+    entry.Name = path.substr(dir.size() + 1);
+  }
+  entry.ContentHash = contentHash;
+  this->Internals->Set(key, entry);
+
+  std::ostringstream record;
+  this->Internals->WriteRecord(record, key, entry);
+  this->Internals->AppendToJournal(record.str());
+
+  // Request compaction when over quota or when the journal
+  // has grown larger than the index itself
+  vtkTypeUInt64 count = this->Internals->Entries.Size();
+  if ((this->MaxSize > 0 && this->Internals->TotalSize > this->MaxSize) ||
+    (this->MaxNumberOfFiles > 0 && count > this->MaxNumberOfFiles) ||
+    this->Internals->JournalRecords >
+      2 * this->Internals->NumberOfRecords() + 1024)
+  {
+    this->Internals->CompactionRequested = true;
+    this->Internals->Condition->Broadcast();
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::AddFailure(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Failure* previous = this->Internals->Failures.Find(key);
+  vtkInternals::Failure failure;
+  failure.Count = previous ? previous->Count + 1 : 1;
+  vtkTypeInt64 delay = this->MinRetryDelay;
+  for (int i = 1; i < failure.Count && delay < this->MaxRetryDelay; ++i)
+  {
+    delay *= 2;
+  }
+  delay = std::min(delay, this->MaxRetryDelay);
+  failure.RetryTime = static_cast<vtkTypeInt64>(time(nullptr)) + delay;
+  this->Internals->Failures.Insert(key, failure);
+
+  std::ostringstream record;
+  this->Internals->WriteFailureRecord(record, key, failure);
+  this->Internals->AppendToJournal(record.str());
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::RemoveFailure(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  if (this->Internals->Failures.Erase(key))
+  {
+    std::ostringstream record;
+    record << "C " << key << "\n";
+    this->Internals->AppendToJournal(record.str());
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::IsFailed(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Failure* failure = this->Internals->Failures.Find(key);
+  bool failed = failure &&
+    failure->RetryTime > static_cast<vtkTypeInt64>(time(nullptr));
+  this->Internals->Lock->Unlock();
+  return failed;
+}
+
+//----------------------------------------------------------------------------
+vtkTypeInt64 vtkMapTileDiskCache::GetRetryTime(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Failure* failure = this->Internals->Failures.Find(key);
+  vtkTypeInt64 retryTime = failure ? failure->RetryTime : 0;
+  this->Internals->Lock->Unlock();
+  return retryTime;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::WriteFileAsync(vtkTypeUInt64 key,
+  const std::string& path, const std::vector<unsigned char>& data,
+  const Metadata& metadata)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::PendingWrite* pending =
+    this->Internals->PendingWrites.Find(key);
+  if (pending)
+  {
+    // Already queued, replace data
+    pending->Path = path;
+    pending->Data = data;
+    pending->Meta = metadata;
+    ++pending->Sequence;
+  }
+  else
+  {
+    vtkInternals::PendingWrite write;
+    write.Path = path;
+    write.Data = data;
+    write.Meta = metadata;
+    this->Internals->PendingWrites.Insert(key, write);
+    this->Internals->WriteQueue.push_back(key);
+  }
+  this->Internals->Condition->Broadcast();
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::ReadPendingFile(
+  vtkTypeUInt64 key, std::vector<unsigned char>& data)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::PendingWrite* pending =
+    this->Internals->PendingWrites.Find(key);
+  if (pending)
+  {
+    data = pending->Data;
+  }
+  this->Internals->Lock->Unlock();
+  return pending != nullptr;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::GetMetadata(vtkTypeUInt64 key, Metadata& metadata)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(key);
+  if (entry && entry->Meta.Expires == 0)
+  {
+    // Resolved once, and saved with the next snapshot
+    std::string path = this->Internals->Directory + "/" + entry->Name;
+    entry->Meta.Expires =
+      static_cast<vtkTypeInt64>(vtksys::SystemTools::ModifiedTime(path)) +
+      this->DefaultMaxAge;
+    this->Internals->Dirty = true;
+  }
+  if (entry)
+  {
+    metadata = entry->Meta;
+  }
+  this->Internals->Lock->Unlock();
+  return entry != nullptr;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::SetMetadata(
+  vtkTypeUInt64 key, const Metadata& metadata)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(key);
+  if (entry)
+  {
+    entry->Meta = metadata;
+    std::ostringstream record;
+    this->Internals->WriteMetadataRecord(record, key, metadata);
+    this->Internals->AppendToJournal(record.str());
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::FlushWrites()
+{
+  this->Internals->Lock->Lock();
+  while (!this->Internals->WriteQueue.empty() ||
+    this->Internals->WriteInProgress)
+  {
+    this->Internals->Condition->Wait(this->Internals->Lock);
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::Touch(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(key);
+  if (entry)
+  {
+    entry->AccessTime = static_cast<vtkTypeInt64>(time(nullptr));
+    this->Internals->Dirty = true;
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::FindFile(vtkTypeUInt64 key, std::string& path)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(key);
+  if (!entry && !this->Internals->Directory.empty())
+  {
+    // May have been added by another process
+    this->Internals->LockIndex();
+    this->Internals->CatchUp();
+    this->Internals->UnlockIndex();
+    entry = this->Internals->Entries.Find(key);
+  }
+  if (entry)
+  {
+    entry->AccessTime = static_cast<vtkTypeInt64>(time(nullptr));
+    this->Internals->Dirty = true;
+    path = this->Internals->Directory + "/" + entry->Name;
+  }
+  this->Internals->Lock->Unlock();
+  return entry != nullptr;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::ClaimFile(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  if (this->Internals->Directory.empty() ||
+    this->Internals->Claims.Contains(key))
+  {
+    this->Internals->Lock->Unlock();
+    return true;
+  }
+
+  // Creating the claim file fails if it exists
+  std::string path = this->Internals->ClaimPath(key);
+  FILE* fp = fopen(path.c_str(), "wx");
+  bool exists = !fp && errno == EEXIST;
+  if (exists && this->IsClaimAbandoned(path))
+  {
+    remove(path.c_str());
+    fp = fopen(path.c_str(), "wx");
+    exists = !fp && errno == EEXIST;
+  }
+  if (fp)
+  {
+    fputs(this->Internals->ProcessId.c_str(), fp);
+    fclose(fp);
+    this->Internals->Claims.Insert(key, true);
+  }
+  this->Internals->Lock->Unlock();
+  // Downloads are not coordinated if claims cannot be created at all,
+  // e.g. in a read-only directory
+  return !exists;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::ReleaseFile(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  if (this->Internals->Claims.Erase(key))
+  {
+    remove(this->Internals->ClaimPath(key).c_str());
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::WaitForFile(vtkTypeUInt64 key, int timeout,
+  const vtkAtomic<vtkTypeInt32>* cancel)
+{
+  this->Internals->Lock->Lock();
+  bool open = !this->Internals->Directory.empty();
+  std::string path = this->Internals->ClaimPath(key);
+  this->Internals->Lock->Unlock();
+  if (!open)
+  {
+    return false;
+  }
+
+  // Only the claim file is polled, without the lock, so that lookups
+  // are not blocked. The index is read once the claim is released.
+  std::chrono::steady_clock::time_point deadline =
+    std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+  while (vtksys::SystemTools::FileExists(path.c_str(), true) &&
+    !this->IsClaimAbandoned(path))
+  {
+    if (std::chrono::steady_clock::now() >= deadline || (cancel && *cancel))
+    {
+      return false;
+    }
+    vtksys::SystemTools::Delay(100);
+  }
+
+  this->Internals->Lock->Lock();
+  bool found = this->Internals->Entries.Contains(key);
+  if (!found && !this->Internals->Directory.empty())
+  {
+    this->Internals->LockIndex();
+    this->Internals->CatchUp();
+    this->Internals->UnlockIndex();
+    found = this->Internals->Entries.Contains(key);
+  }
+  this->Internals->Lock->Unlock();
+  return found;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::IsClaimAbandoned(const std::string& path)
+{
+  // A process that crashed or hung doesn't release its claims
+  vtkTypeInt64 claimTime = vtksys::SystemTools::ModifiedTime(path);
+  return claimTime + this->ClaimTimeout <
+    static_cast<vtkTypeInt64>(time(nullptr));
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::ReleaseClaims()
+{
+  this->Internals->Lock->Lock();
+  this->Internals->Claims.ForEach([&](vtkTypeUInt64 key, bool) {
+    remove(this->Internals->ClaimPath(key).c_str());
+  });
+  this->Internals->Claims.Clear();
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::RemoveFile(vtkTypeUInt64 key)
+{
+  this->Internals->Lock->Lock();
+  std::string name;
+  if (this->Internals->Remove(key, &name))
+  {
+    std::ostringstream record;
+    record << "R " << key << "\n";
+    this->Internals->AppendToJournal(record.str());
+    remove((this->Internals->Directory + "/" + name).c_str());
+  }
+  this->Internals->Lock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDiskCache::ForgetFile(
+  vtkTypeUInt64 key, const std::string& path)
+{
+  this->Internals->Lock->Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(key);
+  bool forget =
+    entry && this->Internals->Directory + "/" + entry->Name == path;
+  if (forget)
+  {
+    this->Internals->Remove(key);
+    std::ostringstream record;
+    record << "R " << key << "\n";
+    this->Internals->AppendToJournal(record.str());
+  }
+  this->Internals->Lock->Unlock();
+  return forget;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::Compact()
+{
+  this->Internals->Lock->Lock();
+  if (this->Internals->Directory.empty())
+  {
+    this->Internals->Lock->Unlock();
+    return;
+  }
+
+  // Evict from the index shared with the other processes
+  this->Internals->LockIndex();
+  this->Internals->CatchUp();
+
+  // Evict least recently accessed files down to 90% of the quotas,
+  // so that compaction doesn't run again for every new file.
+  vtkTypeUInt64 count = this->Internals->Entries.Size();
+  vtkTypeUInt64 sizeTarget = this->MaxSize - this->MaxSize / 10;
+  vtkTypeUInt64 countTarget =
+    this->MaxNumberOfFiles - this->MaxNumberOfFiles / 10;
+  bool overSize =
+    this->MaxSize > 0 && this->Internals->TotalSize > this->MaxSize;
+  bool overCount = this->MaxNumberOfFiles > 0 && count > this->MaxNumberOfFiles;
+  std::size_t evicted = 0;
+  if (overSize || overCount)
+  {
+    std::vector<std::pair<vtkTypeInt64, vtkTypeUInt64> > byAge;
+    byAge.reserve(count);
+    this->Internals->Entries.ForEach(
+      [&](vtkTypeUInt64 key, const vtkInternals::Entry& entry) {
+        byAge.push_back(std::make_pair(entry.AccessTime, key));
+      });
+    std::sort(byAge.begin(), byAge.end());
+
+    for (std::size_t i = 0; i < byAge.size(); ++i)
+    {
+      bool sizeOk =
+        this->MaxSize == 0 || this->Internals->TotalSize <= sizeTarget;
+      bool countOk = this->MaxNumberOfFiles == 0 ||
+        this->Internals->Entries.Size() <= countTarget;
+      if (sizeOk && countOk)
+      {
+        break;
+      }
+
+      std::string name;
+      if (this->Internals->Remove(byAge[i].second, &name))
+      {
+        remove((this->Internals->Directory + "/" + name).c_str());
+        ++evicted;
+      }
+    }
+    this->Internals->Dirty = true;
+  }
+
+  // Forget failures retried long ago, the backoff starts over
+  vtkTypeInt64 forgetTime =
+    static_cast<vtkTypeInt64>(time(nullptr)) - this->MaxRetryDelay;
+  std::vector<vtkTypeUInt64> forgotten;
+  this->Internals->Failures.ForEach(
+    [&](vtkTypeUInt64 key, const vtkInternals::Failure& failure) {
+      if (failure.RetryTime < forgetTime)
+      {
+        forgotten.push_back(key);
+      }
+    });
+  for (std::size_t i = 0; i < forgotten.size(); ++i)
+  {
+    this->Internals->Failures.Erase(forgotten[i]);
+    this->Internals->Dirty = true;
+  }
+
+  if (this->Internals->Dirty ||
+    this->Internals->JournalRecords > this->Internals->NumberOfRecords())
+  {
+    this->Internals->WriteSnapshot();
+  }
+  this->Internals->UnlockIndex();
+  this->Internals->Lock->Unlock();
+
+  if (evicted > 0)
+  {
+    vtkDebugMacro("Evicted " << evicted << " tiles from disk cache");
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTileDiskCache::GetSize()
+{
+  this->Internals->Lock->Lock();
+  vtkTypeUInt64 size = this->Internals->TotalSize;
+  this->Internals->Lock->Unlock();
+  return size;
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTileDiskCache::GetNumberOfFiles()
+{
+  this->Internals->Lock->Lock();
+  vtkTypeUInt64 count = this->Internals->Entries.Size();
+  this->Internals->Lock->Unlock();
+  return count;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDiskCache::BackgroundThreadExecute()
+{
+  vtkInternals* internals = this->Internals;
+  internals->Lock->Lock();
+  // Queued writes are completed before exiting
+  while (internals->ThreadingEnabled || !internals->WriteQueue.empty())
+  {
+    if (!internals->WriteQueue.empty())
+    {
+      vtkTypeUInt64 key = internals->WriteQueue.front();
+      internals->WriteQueue.pop_front();
+      vtkInternals::PendingWrite write = *internals->PendingWrites.Find(key);
+      internals->WriteInProgress = true;
+      internals->Lock->Unlock();
+
+      // Identical content already in the cache (sea, "not available"
+      // tiles...) is linked to, otherwise data is written. Either way
+      // to a temporary file, then renamed into place. The directory of
+      // the file is created on first use.
+      vtkTypeUInt64 hash =
+        vtkMapTileKey::HashContent(write.Data.data(), write.Data.size());
+      std::string sourcePath = internals->FindContent(hash, write.Data);
+      std::string directory = vtksys::SystemTools::GetFilenamePath(write.Path);
+      std::string tempPath = write.Path + internals->TempSuffix;
+      bool ok = false;
+      if (!sourcePath.empty())
+      {
+        ok = LinkFile(sourcePath, tempPath) ||
+          (vtksys::SystemTools::MakeDirectory(directory.c_str()) &&
+               LinkFile(sourcePath, tempPath));
+        if (ok &&
+          !vtksys::SystemTools::RenameFile(
+            tempPath.c_str(), write.Path.c_str()))
+        {
+          ok = false;
+        }
+      }
+
+      // A leftover temporary file may be a link, never write through it
+      remove(tempPath.c_str());
+      FILE* fp = nullptr;
+      if (!ok)
+      {
+        fp = fopen(tempPath.c_str(), "wb");
+        if (!fp && vtksys::SystemTools::MakeDirectory(directory.c_str()))
+        {
+          fp = fopen(tempPath.c_str(), "wb");
+        }
+      }
+      if (fp)
+      {
+        std::size_t n = fwrite(write.Data.data(), 1, write.Data.size(), fp);
+        ok = fclose(fp) == 0 && n == write.Data.size();
+        ok = ok && vtksys::SystemTools::RenameFile(
+                     tempPath.c_str(), write.Path.c_str());
+      }
+      if (ok)
+      {
+        this->AddFile(key, write.Path, write.Data.size(), write.Meta, hash);
+      }
+      else
+      {
+        remove(tempPath.c_str());
+        vtkErrorMacro("Cannot write map-tile file " << write.Path);
+      }
+      this->ReleaseFile(key);
+
+      internals->Lock->Lock();
+      internals->WriteInProgress = false;
+      vtkInternals::PendingWrite* pending = internals->PendingWrites.Find(key);
+      if (pending->Sequence == write.Sequence)
+      {
+        internals->PendingWrites.Erase(key);
+      }
+      else
+      {
+        // Rewritten in the meantime, write again
+        internals->WriteQueue.push_back(key);
+      }
+      internals->Condition->Broadcast();
+      continue;
+    }
+
+    if (internals->CompactionRequested)
+    {
+      internals->CompactionRequested = false;
+      internals->Lock->Unlock();
+      this->Compact();
+      internals->Lock->Lock();
+      continue;
+    }
+
+    // Migrate in small batches, so that queued writes are not delayed
+    if (internals->MigrationRequested && internals->ThreadingEnabled)
+    {
+      internals->MigrationRequested = false;
+      internals->Lock->Unlock();
+      this->MigrateFiles(256);
+      internals->Lock->Lock();
+      if (!internals->MigrationQueue.empty())
+      {
+        internals->MigrationRequested = true;
+      }
+      continue;
+    }
+
+    internals->Condition->Wait(internals->Lock);
+  }
+  internals->Lock->Unlock();
+}
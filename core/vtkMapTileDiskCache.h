@@ -0,0 +1,314 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileDiskCache.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileDiskCache - quota management for the map-tile file cache
+// .SECTION Description
+// Keeps an index of the image files stored in a map-tile cache directory,
+// with the size and last access time of each file, so that the directory
+// can be held within a byte quota and a file-count quota.
+//
+// The index is stored in the cache directory as a text file: a snapshot
+// of all entries followed by a journal of additions and removals made
+// since. The journal is folded back into the snapshot by a compaction
+// pass, which runs on a background thread and also evicts the least
+// recently accessed files when a quota is exceeded. Access times are
+// only kept in memory between compactions.
+//
+// Files can also be written through the cache with WriteFileAsync():
+// the data is queued and written by the background thread to a
+// temporary file that is then renamed, so that readers never see a
+// partial file. Queued data remains available from ReadPendingFile()
+// until the file is in place. Tiles are often byte-identical (open sea,
+// "tile not available" images), so the index also records the content
+// hash of each file written, and data already in the cache is stored as
+// a hard link to the existing file instead of another copy, where the
+// file system supports it. The quotas still count each file in full.
+//
+// Each file also has http caching metadata (see Metadata), so that
+// expired files can be revalidated with conditional requests instead of
+// being downloaded again.
+//
+// The index also serves as a negative cache: tiles that the server
+// failed to provide are recorded with a retry time, so that they are not
+// requested again before it. The retry delay doubles with each
+// consecutive failure of a tile (exponential backoff).
+//
+// Tiles are identified by vtkMapTileKey values built from the OSM tile
+// indices (vtkMapTileSpecInternal::ZoomRowCol). When a directory without
+// an index is opened, it is scanned once to build the index.
+//
+// Several processes can share a cache directory. Changes to the index
+// file are made under an advisory lock (flock, LockFileEx), and each
+// process reads the changes of the others from the journal. Files are
+// written to a temporary file unique to the process, then renamed into
+// place, and a process downloading a tile can claim it (see ClaimFile())
+// so that the others wait for the file instead of downloading it too.
+//
+// Files are stored in subdirectories (see SetLayout()), so that the
+// number of entries per directory stays bounded as the cache grows.
+// Files of another layout, e.g. of a cache written by an earlier version
+// in a single directory, are found through the index and are moved to
+// the current layout by the background thread.
+// All public methods are thread safe.
+
+#ifndef __vtkMapTileDiskCache_h
+#define __vtkMapTileDiskCache_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkAtomic.h>
+#include <vtkObject.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class VTKMAPCORE_EXPORT vtkMapTileDiskCache : public vtkObject
+{
+public:
+  static vtkMapTileDiskCache* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileDiskCache, vtkObject);
+
+  // Description:
+  // Maximum total size of cached files, in bytes. 0 means no limit.
+  // Default is 1 GiB.
+  vtkSetMacro(MaxSize, vtkTypeUInt64);
+  vtkGetMacro(MaxSize, vtkTypeUInt64);
+
+  // Description:
+  // Maximum number of cached files. 0 means no limit.
+  // Default is 100000.
+  vtkSetMacro(MaxNumberOfFiles, vtkTypeUInt64);
+  vtkGetMacro(MaxNumberOfFiles, vtkTypeUInt64);
+
+  // Description:
+  // Lifetime of files whose server gave no expiry time, in seconds,
+  // counted from the file modification time. Default is 7 days.
+  vtkSetMacro(DefaultMaxAge, vtkTypeInt64);
+  vtkGetMacro(DefaultMaxAge, vtkTypeInt64);
+
+  // Description:
+  // Http caching metadata of a file: the validators of a conditional
+  // request (see vtkMapTileDownloader::Request) and the expiry time,
+  // in seconds since the epoch. Zero values are unknown.
+  class Metadata
+  {
+  public:
+    std::string ETag;
+    vtkTypeInt64 LastModified;
+    vtkTypeInt64 Expires;
+
+    Metadata()
+      : LastModified(0)
+      , Expires(0)
+    {
+    }
+  };
+
+  // Description:
+  // Retry delay after the first failure of a tile, in seconds. It doubles
+  // with each consecutive failure, up to MaxRetryDelay. Defaults are
+  // 1 hour and 30 days.
+  vtkSetMacro(MinRetryDelay, vtkTypeInt64);
+  vtkGetMacro(MinRetryDelay, vtkTypeInt64);
+  vtkSetMacro(MaxRetryDelay, vtkTypeInt64);
+  vtkGetMacro(MaxRetryDelay, vtkTypeInt64);
+
+  // Description:
+  // Layout of the files in the cache directory:
+  // FlatLayout: z-x-y.ext, all in the cache directory.
+  // ShardedLayout: z/x/y.ext, the default.
+  // HashedLayout: hh/hh/z-x-y.ext, where hh are hexadecimal digits of a
+  // hash of the tile key, which spreads the files evenly over 65536
+  // directories whatever the zoom levels.
+  // Changing the layout moves the indexed files in the background.
+  enum
+  {
+    FlatLayout = 0,
+    ShardedLayout,
+    HashedLayout
+  };
+  void SetLayout(int layout);
+  vtkGetMacro(Layout, int);
+  void SetLayoutToFlat() { this->SetLayout(FlatLayout); }
+  void SetLayoutToSharded() { this->SetLayout(ShardedLayout); }
+  void SetLayoutToHashed() { this->SetLayout(HashedLayout); }
+
+  // Description:
+  // Path of the file of a tile in the current layout, relative to the
+  // cache directory. The extension is given without the dot.
+  std::string MakeFileName(vtkTypeUInt64 key, const std::string& extension);
+
+  // Description:
+  // Parses the path of a tile file relative to a cache directory, in any
+  // layout. Returns false if it is not the name of a tile file.
+  static bool ParseFileName(const std::string& name, vtkTypeUInt64& key);
+
+  // Description:
+  // Lists the tile files found in a cache directory, in any layout, as
+  // keys and paths relative to the directory.
+  static void FindTileFiles(const std::string& directory,
+    std::vector<std::pair<vtkTypeUInt64, std::string> >& files);
+
+  // Description:
+  // Move indexed files that are not in the current layout, at most
+  // maxFiles of them (all if 0), on the calling thread. Returns the
+  // number of files moved. This is normally done on the background
+  // thread, after the directory is opened or the layout changed.
+  vtkTypeUInt64 MigrateFiles(vtkTypeUInt64 maxFiles = 0);
+
+  // Description:
+  // Set the cache directory, loading (or building) its index.
+  // Any pending changes to the previous directory are written first.
+  void SetDirectory(const std::string& path);
+  std::string GetDirectory();
+
+  // Description:
+  // Record a file written to the cache directory. The path can be
+  // absolute or relative to the cache directory. The content hash of the
+  // file (vtkMapTileKey::HashContent()), if given, lets WriteFileAsync()
+  // link later files with the same content to this one.
+  void AddFile(vtkTypeUInt64 key, const std::string& path, vtkTypeUInt64 size,
+    const Metadata& metadata = Metadata(), vtkTypeUInt64 contentHash = 0);
+
+  // Description:
+  // Record that the server failed to provide a tile, e.g. with a 404
+  // response, or clear the failures of a tile.
+  void AddFailure(vtkTypeUInt64 key);
+  void RemoveFailure(vtkTypeUInt64 key);
+
+  // Description:
+  // Returns true if a tile failed and its retry time is not reached.
+  bool IsFailed(vtkTypeUInt64 key);
+
+  // Description:
+  // Time after which a failed tile is requested again, in seconds since
+  // the epoch, 0 if the tile has no failure.
+  vtkTypeInt64 GetRetryTime(vtkTypeUInt64 key);
+
+  // Description:
+  // Queue data to be written to path (which must be in the cache
+  // directory) on the background thread. The file is recorded with
+  // AddFile() once written.
+  void WriteFileAsync(vtkTypeUInt64 key, const std::string& path,
+    const std::vector<unsigned char>& data,
+    const Metadata& metadata = Metadata());
+
+  // Description:
+  // Get the metadata of a cached file, returns false if there is none.
+  // An unknown expiry time is derived from DefaultMaxAge.
+  bool GetMetadata(vtkTypeUInt64 key, Metadata& metadata);
+
+  // Description:
+  // Replace the metadata of a cached file, e.g. after its server
+  // confirmed with a 304 response that the file is current.
+  void SetMetadata(vtkTypeUInt64 key, const Metadata& metadata);
+
+  // Description:
+  // Copies data queued by WriteFileAsync() and not yet written.
+  // Returns false if there is no queued data for key.
+  bool ReadPendingFile(vtkTypeUInt64 key, std::vector<unsigned char>& data);
+
+  // Description:
+  // Block until all queued writes are complete.
+  void FlushWrites();
+
+  // Description:
+  // Record an access to a cached file.
+  void Touch(vtkTypeUInt64 key);
+
+  // Description:
+  // Look up a cached file in the index and record the access, like
+  // Touch(). Returns false if key is not indexed, else sets path to the
+  // full path of the file. The file system is not accessed: the index
+  // is loaded once by SetDirectory() and kept up to date as files are
+  // written and evicted.
+  bool FindFile(vtkTypeUInt64 key, std::string& path);
+
+  // Description:
+  // Coordinate downloads with the other processes sharing the directory.
+  // ClaimFile() returns false if another process has claimed the file of
+  // key, which it is then downloading; otherwise the file is claimed by
+  // this process until written by WriteFileAsync() or until
+  // ReleaseFile() is called, e.g. if the download failed.
+  bool ClaimFile(vtkTypeUInt64 key);
+  void ReleaseFile(vtkTypeUInt64 key);
+
+  // Description:
+  // Block until the file claimed by another process is in the index, or
+  // the claim is released or abandoned, for at most timeout seconds (the
+  // claim is checked once if 0) or until *cancel is set. Returns true if
+  // the file is then in the index.
+  bool WaitForFile(vtkTypeUInt64 key, int timeout,
+    const vtkAtomic<vtkTypeInt32>* cancel = nullptr);
+
+  // Description:
+  // Age in seconds after which a claim is considered abandoned, e.g. by
+  // a process that crashed. Default is 60.
+  vtkSetMacro(ClaimTimeout, int);
+  vtkGetMacro(ClaimTimeout, int);
+
+  // Description:
+  // Remove entry from the index and delete its file.
+  void RemoveFile(vtkTypeUInt64 key);
+
+  // Description:
+  // Remove entry from the index if its file is path, without deleting
+  // the file, e.g. after the file could not be read because another
+  // process removed it. Returns false if key is not indexed with path.
+  bool ForgetFile(vtkTypeUInt64 key, const std::string& path);
+
+  // Description:
+  // Evict files over quota and rewrite the index, on the calling thread.
+  // This is normally done on the background thread.
+  void Compact();
+
+  // Description:
+  // Current totals
+  vtkTypeUInt64 GetSize();
+  vtkTypeUInt64 GetNumberOfFiles();
+
+  // Description:
+  // Name of the index file in the cache directory.
+  static const char* IndexFileName();
+
+  // Description:
+  // Background thread method (writes and compaction), for internal use.
+  void BackgroundThreadExecute();
+
+protected:
+  vtkMapTileDiskCache();
+  ~vtkMapTileDiskCache() override;
+
+  bool IsClaimAbandoned(const std::string& path);
+  void ReleaseClaims();
+
+  vtkTypeUInt64 MaxSize;
+  vtkTypeUInt64 MaxNumberOfFiles;
+  vtkTypeInt64 DefaultMaxAge;
+  vtkTypeInt64 MinRetryDelay;
+  vtkTypeInt64 MaxRetryDelay;
+  int Layout;
+  int ClaimTimeout;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileDiskCache(const vtkMapTileDiskCache&);            // Not implemented
+  vtkMapTileDiskCache& operator=(const vtkMapTileDiskCache&); // Not implemented
+};
+
+#endif // __vtkMapTileDiskCache_h
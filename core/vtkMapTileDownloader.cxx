@@ -0,0 +1,610 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileDownloader.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileDownloader.h"
+
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+
+vtkStandardNewMacro(vtkMapTileDownloader);
+
+//----------------------------------------------------------------------------
+namespace
+{
+// Per-transfer state, attached to the easy handle as CURLOPT_PRIVATE
+struct Transfer
+{
+  vtkMapTileDownloader::Request* Req;
+  CURL* Handle;
+  curl_slist* Headers; // conditional request headers
+  long MaxAge;         // from Cache-Control, -1 if not given
+  std::string ETag;    // validators sent with the request
+  vtkTypeInt64 LastModified;
+  char ErrorBuffer[CURL_ERROR_SIZE];
+};
+
+//----------------------------------------------------------------------------
+// Returns true if header line starts with name, case insensitive, and
+// sets value to the rest of the line, trimmed
+bool MatchHeader(const std::string& line, const char* name, std::string& value)
+{
+  std::size_t n = strlen(name);
+  if (line.size() <= n || line[n] != ':')
+  {
+    return false;
+  }
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    if (tolower(static_cast<unsigned char>(line[i])) != name[i])
+    {
+      return false;
+    }
+  }
+  std::size_t first = line.find_first_not_of(" \t", n + 1);
+  std::size_t last = line.find_last_not_of(" \t\r\n");
+  value = first <= last ? line.substr(first, last - first + 1) : "";
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Collects the caching metadata of the response
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+  Transfer* transfer = static_cast<Transfer*>(userdata);
+  std::string line(buffer, size * nitems);
+  std::string value;
+  if (MatchHeader(line, "etag", value))
+  {
+    transfer->Req->ETag = value;
+  }
+  else if (MatchHeader(line, "cache-control", value))
+  {
+    std::size_t pos = value.find("max-age=");
+    if (value.find("no-cache") != std::string::npos ||
+      value.find("no-store") != std::string::npos)
+    {
+      transfer->MaxAge = 0;
+    }
+    else if (pos != std::string::npos)
+    {
+      transfer->MaxAge = strtol(value.c_str() + pos + 8, nullptr, 10);
+    }
+  }
+  else if (MatchHeader(line, "expires", value))
+  {
+    time_t expires = curl_getdate(value.c_str(), nullptr);
+    transfer->Req->Expires = expires > 0 ? expires : 0;
+  }
+  return size * nitems;
+}
+
+//----------------------------------------------------------------------------
+size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+  std::vector<unsigned char>* data =
+    static_cast<std::vector<unsigned char>*>(userdata);
+  size_t n = size * nmemb;
+  data->insert(data->end(), ptr, ptr + n);
+  return n;
+}
+
+//----------------------------------------------------------------------------
+// Aborts the transfer, with CURLE_ABORTED_BY_CALLBACK, once cancelled
+int ProgressCallback(
+  void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+  const vtkMapTileDownloader::CancelFlag* cancel =
+    static_cast<const vtkMapTileDownloader::CancelFlag*>(userdata);
+  return cancel->load() != 0 ? 1 : 0;
+}
+
+#if LIBCURL_VERSION_NUM < 0x072000
+// CURLOPT_PROGRESSFUNCTION signature, before libcurl 7.32.0
+int LegacyProgressCallback(void* userdata, double, double, double, double)
+{
+  return ProgressCallback(userdata, 0, 0, 0, 0);
+}
+#endif
+}
+
+//----------------------------------------------------------------------------
+class vtkMapTileDownloader::vtkInternals
+{
+public:
+  CURLSH* Share;
+  vtkSimpleMutexLock ShareLocks[CURL_LOCK_DATA_LAST];
+
+  // Idle handles, reused between requests so that curl can keep
+  // connections alive. Connections are cached by the multi handle they
+  // were opened with, the last returned one is checked out first.
+  std::vector<CURL*> EasyPool;
+  std::vector<CURLM*> MultiPool;
+  vtkSimpleMutexLock PoolLock;
+
+  // Adaptive concurrency of each host, protected by HostsLock
+  struct HostState
+  {
+    double Limit;
+    int Active; // slots reserved with BeginRequest()
+    bool SlowStart;
+    double MinLatency;
+    double AverageLatency;
+    std::chrono::steady_clock::time_point LastDecrease;
+  };
+  std::map<std::string, HostState> Hosts;
+  std::map<std::string, int> HostCaps;
+  vtkSimpleMutexLock HostsLock;
+
+  HostState& GetHostState(const std::string& host)
+  {
+    std::map<std::string, HostState>::iterator iter = this->Hosts.find(host);
+    if (iter == this->Hosts.end())
+    {
+      HostState state;
+      state.Limit = 2.0;
+      state.Active = 0;
+      state.SlowStart = true;
+      state.MinLatency = 0.0;
+      state.AverageLatency = 0.0;
+      iter = this->Hosts.insert(std::make_pair(host, state)).first;
+    }
+    return iter->second;
+  }
+
+  int GetHostCap(const std::string& host, int defaultCap)
+  {
+    std::map<std::string, int>::iterator iter = this->HostCaps.find(host);
+    return iter != this->HostCaps.end() ? iter->second : defaultCap;
+  }
+
+  static void LockShare(
+    CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+  {
+    static_cast<vtkInternals*>(userptr)->ShareLocks[data].Lock();
+  }
+
+  static void UnlockShare(CURL*, curl_lock_data data, void* userptr)
+  {
+    static_cast<vtkInternals*>(userptr)->ShareLocks[data].Unlock();
+  }
+
+  CURL* CheckoutEasy()
+  {
+    CURL* handle = nullptr;
+    this->PoolLock.Lock();
+    if (!this->EasyPool.empty())
+    {
+      handle = this->EasyPool.back();
+      this->EasyPool.pop_back();
+    }
+    this->PoolLock.Unlock();
+    return handle ? handle : curl_easy_init();
+  }
+
+  void ReturnEasy(CURL* handle)
+  {
+    // Reset options but keep the handle (and its caches) alive
+    curl_easy_reset(handle);
+    this->PoolLock.Lock();
+    this->EasyPool.push_back(handle);
+    this->PoolLock.Unlock();
+  }
+
+  CURLM* CheckoutMulti()
+  {
+    CURLM* handle = nullptr;
+    this->PoolLock.Lock();
+    if (!this->MultiPool.empty())
+    {
+      handle = this->MultiPool.back();
+      this->MultiPool.pop_back();
+    }
+    this->PoolLock.Unlock();
+    return handle ? handle : curl_multi_init();
+  }
+
+  void ReturnMulti(CURLM* handle)
+  {
+    this->PoolLock.Lock();
+    this->MultiPool.push_back(handle);
+    this->PoolLock.Unlock();
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileDownloader::Request::Request()
+  : Cancel(nullptr)
+  , HttpStatus(0)
+  , Success(false)
+  , Cancelled(false)
+  , Duration(0.0)
+  , LastModified(0)
+  , Expires(0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileDownloader::vtkMapTileDownloader()
+{
+  this->MaxConnectionsPerHost = 6;
+  this->MinimumConcurrency = 1;
+  this->LatencyThreshold = 4.0;
+  this->Internals = new vtkInternals;
+
+  // Reference counted by libcurl, balanced in the destructor
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  CURLSH* share = curl_share_init();
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, vtkInternals::LockShare);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, vtkInternals::UnlockShare);
+  curl_share_setopt(share, CURLSHOPT_USERDATA, this->Internals);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  // Not the connection cache: libcurl does not support using it from
+  // concurrent transfers in different threads, even with the locks.
+  // Each multi handle keeps its own (see MultiPool).
+  this->Internals->Share = share;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileDownloader::~vtkMapTileDownloader()
+{
+  // Easy handles must be released before the share they are attached to
+  for (CURLM* multi : this->Internals->MultiPool)
+  {
+    curl_multi_cleanup(multi);
+  }
+  for (CURL* easy : this->Internals->EasyPool)
+  {
+    curl_easy_cleanup(easy);
+  }
+  curl_share_cleanup(this->Internals->Share);
+  delete this->Internals;
+
+  curl_global_cleanup();
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDownloader::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MaxConnectionsPerHost: " << this->MaxConnectionsPerHost
+     << "\n"
+     << indent << "MinimumConcurrency: " << this->MinimumConcurrency << "\n"
+     << indent << "LatencyThreshold: " << this->LatencyThreshold << "\n"
+     << indent << "Idle handles: " << this->Internals->EasyPool.size()
+     << std::endl;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDownloader::SetHostConcurrencyCap(
+  const std::string& host, int limit)
+{
+  this->Internals->HostsLock.Lock();
+  if (limit > 0)
+  {
+    this->Internals->HostCaps[host] = limit;
+  }
+  else
+  {
+    this->Internals->HostCaps.erase(host);
+  }
+  this->Internals->HostsLock.Unlock();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMapTileDownloader::GetHostConcurrencyCap(const std::string& host)
+{
+  this->Internals->HostsLock.Lock();
+  int cap = this->Internals->GetHostCap(host, this->MaxConnectionsPerHost);
+  this->Internals->HostsLock.Unlock();
+  return cap;
+}
+
+//----------------------------------------------------------------------------
+// Clamps limit to [MinimumConcurrency, cap], cap taking precedence
+static double ClampLimit(double limit, int minimum, int cap)
+{
+  return std::min<double>(cap, std::max<double>(minimum, limit));
+}
+
+//----------------------------------------------------------------------------
+int vtkMapTileDownloader::GetConcurrencyLimit(const std::string& host)
+{
+  this->Internals->HostsLock.Lock();
+  int cap = this->Internals->GetHostCap(host, this->MaxConnectionsPerHost);
+  vtkInternals::HostState& state = this->Internals->GetHostState(host);
+  int limit = static_cast<int>(
+    ClampLimit(state.Limit, this->MinimumConcurrency, cap));
+  this->Internals->HostsLock.Unlock();
+  return limit;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDownloader::BeginRequest(const std::string& host)
+{
+  this->Internals->HostsLock.Lock();
+  int cap = this->Internals->GetHostCap(host, this->MaxConnectionsPerHost);
+  vtkInternals::HostState& state = this->Internals->GetHostState(host);
+  bool reserved = state.Active <
+    static_cast<int>(ClampLimit(state.Limit, this->MinimumConcurrency, cap));
+  if (reserved)
+  {
+    ++state.Active;
+  }
+  this->Internals->HostsLock.Unlock();
+  return reserved;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDownloader::EndRequest(const std::string& host)
+{
+  this->Internals->HostsLock.Lock();
+  vtkInternals::HostState& state = this->Internals->GetHostState(host);
+  state.Active = std::max(0, state.Active - 1);
+  this->Internals->HostsLock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+std::string vtkMapTileDownloader::GetHost(const std::string& url)
+{
+  std::string::size_type begin = url.find("://");
+  begin = begin == std::string::npos ? 0 : begin + 3;
+  std::string::size_type end = url.find_first_of("/?#", begin);
+  return url.substr(begin, end == std::string::npos ? end : end - begin);
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDownloader::UpdateConcurrencyLimit(const Request& request)
+{
+  if (request.Cancelled)
+  {
+    return;
+  }
+
+  std::string host = GetHost(request.Url);
+  bool congested = !request.Success || request.HttpStatus == 429 ||
+    request.HttpStatus >= 500;
+
+  this->Internals->HostsLock.Lock();
+  int cap = this->Internals->GetHostCap(host, this->MaxConnectionsPerHost);
+  vtkInternals::HostState& state = this->Internals->GetHostState(host);
+  if (!congested)
+  {
+    // The lowest latency drifts up slowly, so that it follows lasting
+    // changes of the network path
+    double latency = std::max(request.Duration, 0.001);
+    state.MinLatency = state.MinLatency > 0.0
+      ? std::min(latency, 1.01 * state.MinLatency)
+      : latency;
+    state.AverageLatency = state.AverageLatency > 0.0
+      ? 0.875 * state.AverageLatency + 0.125 * latency
+      : latency;
+    congested =
+      state.AverageLatency > this->LatencyThreshold * state.MinLatency;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (congested)
+  {
+    // Requests started before the last decrease report the same
+    // congestion, ignore them
+    double elapsed =
+      std::chrono::duration<double>(now - state.LastDecrease).count();
+    if (elapsed > state.AverageLatency)
+    {
+      state.Limit = 0.5 * state.Limit;
+      state.SlowStart = false;
+      state.LastDecrease = now;
+      vtkDebugMacro("Concurrency limit of " << host << " decreased to "
+                                            << state.Limit);
+    }
+  }
+  else
+  {
+    state.Limit += state.SlowStart ? 1.0 : 1.0 / state.Limit;
+  }
+  state.Limit = ClampLimit(state.Limit, this->MinimumConcurrency, cap);
+  this->Internals->HostsLock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileDownloader::Download(Request& request)
+{
+  std::vector<Request*> requests(1, &request);
+  this->Download(requests);
+  return request.Success;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileDownloader::Download(std::vector<Request*>& requests)
+{
+  if (requests.empty())
+  {
+    return;
+  }
+
+  CURLM* multi = this->Internals->CheckoutMulti();
+  if (!multi)
+  {
+    vtkErrorMacro(<< "curl_multi_init() failed");
+    return;
+  }
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+    long(this->GetConcurrencyLimit(GetHost(requests[0]->Url))));
+
+  // Vector is sized once so that ErrorBuffer addresses remain valid
+  std::vector<Transfer> transfers(requests.size());
+  for (std::size_t i = 0; i < requests.size(); ++i)
+  {
+    Transfer& transfer = transfers[i];
+    transfer.Req = requests[i];
+    transfer.Req->Data.clear();
+    transfer.Req->HttpStatus = 0;
+    transfer.Req->Success = false;
+    transfer.Req->Cancelled = false;
+    transfer.Req->Duration = 0.0;
+    transfer.Req->Error.clear();
+    transfer.Req->Expires = 0;
+    // Validators of the response replace those of the request, so that a
+    // stale one is never stored against a new body
+    transfer.ETag.swap(transfer.Req->ETag);
+    transfer.Req->ETag.clear();
+    transfer.LastModified = transfer.Req->LastModified;
+    transfer.Req->LastModified = 0;
+    transfer.Headers = nullptr;
+    transfer.MaxAge = -1;
+    transfer.ErrorBuffer[0] = '\0';
+
+    transfer.Handle = this->Internals->CheckoutEasy();
+    if (!transfer.Handle)
+    {
+      transfer.Req->Error = "curl_easy_init() failed";
+      continue;
+    }
+
+    CURL* curl = transfer.Handle;
+#ifdef DISABLE_CURL_SIGNALS
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+#endif
+    curl_easy_setopt(curl, CURLOPT_SHARE, this->Internals->Share);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, transfer.ErrorBuffer);
+    curl_easy_setopt(curl, CURLOPT_URL, transfer.Req->Url.c_str());
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer.Req->Data);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    if (!transfer.ETag.empty())
+    {
+      std::string header = "If-None-Match: " + transfer.ETag;
+      transfer.Headers = curl_slist_append(nullptr, header.c_str());
+      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer.Headers);
+    }
+    if (transfer.LastModified > 0)
+    {
+      curl_easy_setopt(curl, CURLOPT_TIMECONDITION, CURL_TIMECOND_IFMODSINCE);
+      curl_easy_setopt(
+        curl, CURLOPT_TIMEVALUE, static_cast<long>(transfer.LastModified));
+    }
+    if (transfer.Req->Cancel)
+    {
+      void* cancel = const_cast<CancelFlag*>(transfer.Req->Cancel);
+#if LIBCURL_VERSION_NUM >= 0x072000
+      curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+      curl_easy_setopt(curl, CURLOPT_XFERINFODATA, cancel);
+#else
+      curl_easy_setopt(
+        curl, CURLOPT_PROGRESSFUNCTION, LegacyProgressCallback);
+      curl_easy_setopt(curl, CURLOPT_PROGRESSDATA, cancel);
+#endif
+      curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+    curl_multi_add_handle(multi, curl);
+  }
+
+  // Run all transfers to completion
+  int running = 0;
+  do
+  {
+    CURLMcode mc = curl_multi_perform(multi, &running);
+    if (mc == CURLM_OK && running)
+    {
+      mc = curl_multi_wait(multi, nullptr, 0, 1000, nullptr);
+    }
+    if (mc != CURLM_OK)
+    {
+      vtkErrorMacro(<< "curl multi interface failed, code " << mc);
+      break;
+    }
+
+    int queued = 0;
+    CURLMsg* msg;
+    while ((msg = curl_multi_info_read(multi, &queued)))
+    {
+      if (msg->msg != CURLMSG_DONE)
+      {
+        continue;
+      }
+      Transfer* transfer = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
+        &transfer->Req->HttpStatus);
+      transfer->Req->Success = msg->data.result == CURLE_OK;
+      transfer->Req->Cancelled =
+        msg->data.result == CURLE_ABORTED_BY_CALLBACK;
+      curl_easy_getinfo(
+        msg->easy_handle, CURLINFO_TOTAL_TIME, &transfer->Req->Duration);
+      long fileTime = -1;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_FILETIME, &fileTime);
+      if (fileTime > 0)
+      {
+        transfer->Req->LastModified = fileTime;
+      }
+      if (transfer->Req->HttpStatus == 304)
+      {
+        // Cached copy is current; keep its validators unless resent
+        if (transfer->Req->ETag.empty())
+        {
+          transfer->Req->ETag = transfer->ETag;
+        }
+        if (transfer->Req->LastModified <= 0)
+        {
+          transfer->Req->LastModified = transfer->LastModified;
+        }
+      }
+      if (transfer->MaxAge >= 0)
+      {
+        // Cache-Control takes precedence over Expires
+        transfer->Req->Expires =
+          static_cast<vtkTypeInt64>(time(nullptr)) + transfer->MaxAge;
+      }
+      if (!transfer->Req->Success)
+      {
+        transfer->Req->Error = transfer->ErrorBuffer[0] != '\0'
+          ? transfer->ErrorBuffer
+          : curl_easy_strerror(msg->data.result);
+      }
+      vtkDebugMacro("Download " << transfer->Req->Url
+                                << " status: " << transfer->Req->HttpStatus);
+      this->UpdateConcurrencyLimit(*transfer->Req);
+    }
+  } while (running);
+
+  // Return handles to the pools
+  for (std::size_t i = 0; i < transfers.size(); ++i)
+  {
+    if (transfers[i].Handle)
+    {
+      curl_multi_remove_handle(multi, transfers[i].Handle);
+      this->Internals->ReturnEasy(transfers[i].Handle);
+    }
+    curl_slist_free_all(transfers[i].Headers);
+  }
+  this->Internals->ReturnMulti(multi);
+}
@@ -0,0 +1,166 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileDownloader.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileDownloader - http engine for map-tile requests
+// .SECTION Description
+// Performs map-tile requests with libcurl's multi interface. Curl easy
+// and multi handles are pooled and reused between requests, so that
+// each multi handle keeps its connections open for the next requests.
+// DNS lookups and TLS sessions are shared, through a curl share object,
+// by every request issued through the same downloader instance; open
+// connections are not, as libcurl does not support sharing them between
+// concurrent threads. The Download() methods are thread safe and can be
+// called concurrently, e.g. from the request threads of
+// vtkMultiThreadedOsmLayer.
+//
+// The downloader also adapts the number of concurrent requests to each
+// host to the latency and errors measured on completed requests, in the
+// manner of TCP congestion control (see GetConcurrencyLimit()).
+
+#ifndef __vtkMapTileDownloader_h
+#define __vtkMapTileDownloader_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkAtomic.h>
+#include <vtkObject.h>
+
+#include <string>
+#include <vector>
+
+class VTKMAPCORE_EXPORT vtkMapTileDownloader : public vtkObject
+{
+public:
+  static vtkMapTileDownloader* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileDownloader, vtkObject);
+
+  // Description:
+  // Cancellation flag of a request, set to non-zero by another thread to
+  // abort the transfer. It is checked by curl's progress callback, which
+  // is called at least once per second, and between transfer steps.
+  typedef vtkAtomic<vtkTypeInt32> CancelFlag;
+
+  // Description:
+  // A single http request and its result.
+  // The response body is stored in memory; nothing is written to disk.
+  class Request
+  {
+  public:
+    std::string Url;
+    const CancelFlag* Cancel; // optional, not owned
+    std::vector<unsigned char> Data; // response body
+    long HttpStatus;
+    bool Success;   // transfer completed without curl error
+    bool Cancelled; // transfer aborted through Cancel
+    double Duration; // transfer time, in seconds
+    std::string Error;
+
+    // Http caching metadata. If ETag or LastModified (seconds since the
+    // epoch) are set, the request is conditional: the server responds
+    // 304 without data if the cached copy is current. They are replaced
+    // by the validators of the response, and cleared if it has none
+    // (except for a 304, which keeps those of the request). Expires is set
+    // from the Cache-Control or Expires response headers, 0 if unknown.
+    std::string ETag;
+    vtkTypeInt64 LastModified;
+    vtkTypeInt64 Expires;
+
+    Request();
+  };
+
+  // Description:
+  // Maximum number of connections opened to the same host, unless the
+  // host has its own cap (see SetHostConcurrencyCap()). Additional
+  // transfers in a batch are queued by curl until a connection becomes
+  // available. Default is 6.
+  vtkSetMacro(MaxConnectionsPerHost, int);
+  vtkGetMacro(MaxConnectionsPerHost, int);
+
+  // Description:
+  // Lower bound of the adaptive concurrency limit of each host.
+  // Default is 1.
+  vtkSetClampMacro(MinimumConcurrency, int, 1, VTK_INT_MAX);
+  vtkGetMacro(MinimumConcurrency, int);
+
+  // Description:
+  // Ratio of the average to the lowest request latency measured for a
+  // host above which the server is considered overloaded, and its
+  // concurrency limit is decreased. Default is 4.
+  vtkSetClampMacro(LatencyThreshold, double, 1.0, VTK_DOUBLE_MAX);
+  vtkGetMacro(LatencyThreshold, double);
+
+  // Description:
+  // Upper bound of the adaptive concurrency limit of a host, e.g. 32 for
+  // a private tile mirror and 2 for a server that throttles clients.
+  // Hosts without a cap use MaxConnectionsPerHost; a limit of 0 removes
+  // the cap of host.
+  void SetHostConcurrencyCap(const std::string& host, int limit);
+  int GetHostConcurrencyCap(const std::string& host);
+
+  // Description:
+  // Current concurrency limit of host. It starts at 2 and grows by one
+  // with every successful request, until the first sign of congestion;
+  // from then on it grows by one for each limit's worth of successful
+  // requests (additive increase). It is halved (multiplicative decrease)
+  // when a request fails, when the server responds with status 429 or
+  // 5xx, or when the average latency exceeds LatencyThreshold times the
+  // lowest latency, at most once per average latency. The limit stays
+  // between MinimumConcurrency and the host cap.
+  int GetConcurrencyLimit(const std::string& host);
+
+  // Description:
+  // Reserves a request slot for host, for callers that issue requests
+  // from several threads. Returns false if the concurrency limit of
+  // host is reached. Slots are released with EndRequest().
+  bool BeginRequest(const std::string& host);
+  void EndRequest(const std::string& host);
+
+  // Description:
+  // Returns the host part, including the port, of a url or server name,
+  // e.g. "a.tile.org" for "http://a.tile.org/1/0/0.png" or "a.tile.org/".
+  static std::string GetHost(const std::string& url);
+
+  // Description:
+  // Perform one request, blocking until it completes.
+  // Returns the value of request.Success.
+  bool Download(Request& request);
+
+  // Description:
+  // Perform a set of requests concurrently, blocking until all of
+  // them complete.
+  void Download(std::vector<Request*>& requests);
+
+protected:
+  vtkMapTileDownloader();
+  ~vtkMapTileDownloader() override;
+
+  // Description:
+  // Updates the concurrency limit of the host of a completed request
+  void UpdateConcurrencyLimit(const Request& request);
+
+  int MaxConnectionsPerHost;
+  int MinimumConcurrency;
+  double LatencyThreshold;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileDownloader(const vtkMapTileDownloader&); // Not implemented
+  vtkMapTileDownloader& operator=(
+    const vtkMapTileDownloader&); // Not implemented
+};
+
+#endif // __vtkMapTileDownloader_h
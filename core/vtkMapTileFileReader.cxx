@@ -0,0 +1,313 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileFileReader.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileFileReader.h"
+
+#include <vtkObjectFactory.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#ifdef VTKMAP_USE_IO_URING
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <liburing.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+vtkStandardNewMacro(vtkMapTileFileReader);
+
+//----------------------------------------------------------------------------
+class vtkMapTileFileReader::vtkInternals
+{
+public:
+#ifdef VTKMAP_USE_IO_URING
+  // Opening a file takes 2 queue entries (openat and statx)
+  enum
+  {
+    QueueDepth = 64,
+    FilesPerBatch = QueueDepth / 2,
+    MaxBusyRetries = 10
+  };
+
+  struct io_uring Ring;
+  bool RingInitialized;
+  bool RingReady; // false once an operation failed
+
+  vtkInternals()
+  {
+    this->RingInitialized =
+      io_uring_queue_init(QueueDepth, &this->Ring, 0) == 0;
+    this->RingReady = false;
+    if (this->RingInitialized)
+    {
+      // Operations used by ReadBatch(), from Linux 5.6
+      struct io_uring_probe* probe = io_uring_get_probe_ring(&this->Ring);
+      this->RingReady = probe &&
+        io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+        io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+        io_uring_opcode_supported(probe, IORING_OP_READ) &&
+        io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+      io_uring_free_probe(probe);
+    }
+  }
+
+  ~vtkInternals()
+  {
+    if (this->RingInitialized)
+    {
+      io_uring_queue_exit(&this->Ring);
+    }
+  }
+
+  // Submits the queued operations and waits for count completions,
+  // passing the user data and result of each to f. Returns false if the
+  // ring failed, it is then not used anymore. The operations submitted
+  // before are completed even then, as they write to the buffers and
+  // results of the caller.
+  template <class F>
+  bool Complete(unsigned count, F f)
+  {
+    unsigned submitted = 0;
+    unsigned done = 0;
+    int busy = 0; // submissions refused in a row
+    while (done < submitted || (submitted < count && this->RingReady))
+    {
+      if (done == submitted)
+      {
+        // Nothing in flight to free resources of the kernel if it refuses
+        // the submission: back off, then give up to blocking reads
+        int ret = io_uring_submit(&this->Ring);
+        if (ret > 0)
+        {
+          submitted += static_cast<unsigned>(ret);
+          busy = 0;
+        }
+        else if (ret == 0 || ret == -EAGAIN || ret == -EBUSY)
+        {
+          if (++busy > MaxBusyRetries)
+          {
+            this->RingReady = false;
+          }
+          else
+          {
+            std::this_thread::sleep_for(std::chrono::milliseconds(busy));
+          }
+        }
+        else if (ret != -EINTR)
+        {
+          this->RingReady = false;
+        }
+      }
+      while (done < submitted)
+      {
+        struct io_uring_cqe* cqe = this->WaitCompletion();
+        f(reinterpret_cast<std::size_t>(io_uring_cqe_get_data(cqe)),
+          cqe->res);
+        io_uring_cqe_seen(&this->Ring, cqe);
+        ++done;
+      }
+    }
+    return this->RingReady;
+  }
+
+  // Waits for the next completion of an operation in flight. If waiting
+  // fails, the ring is not used anymore, and completions are polled
+  // from the completion queue, without system calls, until they come.
+  struct io_uring_cqe* WaitCompletion()
+  {
+    struct io_uring_cqe* cqe = nullptr;
+    while (this->RingReady)
+    {
+      int ret = io_uring_wait_cqe(&this->Ring, &cqe);
+      if (ret == 0)
+      {
+        return cqe;
+      }
+      if (ret != -EINTR)
+      {
+        this->RingReady = false;
+      }
+    }
+    while (io_uring_peek_cqe(&this->Ring, &cqe) != 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return cqe;
+  }
+
+  // Reads count files of paths from first, with one submission for the
+  // opens, one for the reads and one for the closes. Data of files that
+  // cannot be read, or are read short, is left empty.
+  void ReadBatch(const std::vector<std::string>& paths,
+    std::vector<std::vector<unsigned char> >& data, std::size_t first,
+    std::size_t count)
+  {
+    std::vector<int> fds(count, -1);
+    std::vector<struct statx> stats(count);
+    std::vector<bool> sized(count, false);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const char* path = paths[first + i].c_str();
+      struct io_uring_sqe* sqe = io_uring_get_sqe(&this->Ring);
+      io_uring_prep_openat(sqe, AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0);
+      io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(2 * i));
+      sqe = io_uring_get_sqe(&this->Ring);
+      io_uring_prep_statx(sqe, AT_FDCWD, path, 0, STATX_SIZE, &stats[i]);
+      io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(2 * i + 1));
+    }
+    bool ok = this->Complete(
+      static_cast<unsigned>(2 * count), [&](std::size_t id, int res) {
+        if (id % 2 == 0)
+        {
+          fds[id / 2] = res >= 0 ? res : -1;
+        }
+        else
+        {
+          sized[id / 2] = res == 0;
+        }
+      });
+
+    unsigned reads = 0;
+    for (std::size_t i = 0; i < count && ok; ++i)
+    {
+      if (fds[i] >= 0 && sized[i] && stats[i].stx_size > 0)
+      {
+        std::vector<unsigned char>& buffer = data[first + i];
+        buffer.resize(static_cast<std::size_t>(stats[i].stx_size));
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&this->Ring);
+        io_uring_prep_read(sqe, fds[i], buffer.data(),
+          static_cast<unsigned>(buffer.size()), 0);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+        ++reads;
+      }
+    }
+    ok = ok && this->Complete(reads, [&](std::size_t i, int res) {
+      std::vector<unsigned char>& buffer = data[first + i];
+      if (res < 0 || static_cast<std::size_t>(res) != buffer.size())
+      {
+        std::vector<unsigned char>().swap(buffer);
+      }
+    });
+    if (!ok)
+    {
+      // Buffers of failed reads may be partially filled
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        std::vector<unsigned char>().swap(data[first + i]);
+      }
+    }
+
+    unsigned closes = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      if (fds[i] >= 0 && ok)
+      {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&this->Ring);
+        io_uring_prep_close(sqe, fds[i]);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void*>(i));
+        ++closes;
+      }
+      else if (fds[i] >= 0)
+      {
+        close(fds[i]);
+      }
+    }
+    if (ok)
+    {
+      this->Complete(closes, [](std::size_t, int) {});
+    }
+  }
+#endif
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileFileReader::vtkMapTileFileReader()
+{
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileFileReader::~vtkMapTileFileReader()
+{
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileFileReader::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "UseIoUring: " << this->GetUseIoUring() << std::endl;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileFileReader::GetUseIoUring()
+{
+#ifdef VTKMAP_USE_IO_URING
+  return this->Internals->RingReady;
+#else
+  return false;
+#endif
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileFileReader::ReadFiles(const std::vector<std::string>& paths,
+  std::vector<std::vector<unsigned char> >& data)
+{
+  data.assign(paths.size(), std::vector<unsigned char>());
+  std::size_t first = 0;
+#ifdef VTKMAP_USE_IO_URING
+  while (first < paths.size() && this->Internals->RingReady)
+  {
+    std::size_t count = std::min(paths.size() - first,
+      static_cast<std::size_t>(vtkInternals::FilesPerBatch));
+    this->Internals->ReadBatch(paths, data, first, count);
+    if (this->Internals->RingReady)
+    {
+      first += count;
+    }
+  }
+#endif
+
+  // Without io_uring, or from the batch where it failed
+  for (; first < paths.size(); ++first)
+  {
+    ReadFile(paths[first], data[first]);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTileFileReader::ReadFile(
+  const std::string& path, std::vector<unsigned char>& data)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in)
+  {
+    data.clear();
+    return false;
+  }
+  data.assign(
+    std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  if (in.bad())
+  {
+    data.clear();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileFileReader.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileFileReader - reads batches of map-tile files
+// .SECTION Description
+// Reads the whole content of a batch of files, e.g. the cached image
+// files of the tiles of a viewport, ahead of decoding.
+//
+// When vtkMap is built with USE_IO_URING (Linux, requires liburing),
+// the batch is read through an io_uring queue: the opens (with the file
+// sizes), then the reads, then the closes of all the files are each
+// submitted with a single system call, and run concurrently by the
+// kernel, instead of several blocking system calls per file. Otherwise,
+// or if the kernel does not provide io_uring, files are read one after
+// the other. Used internally by vtkMultiThreadedOsmLayer, with one
+// reader per request thread. Not thread safe.
+
+#ifndef __vtkMapTileFileReader_h
+#define __vtkMapTileFileReader_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+
+#include <string>
+#include <vector>
+
+class VTKMAPCORE_EXPORT vtkMapTileFileReader : public vtkObject
+{
+public:
+  static vtkMapTileFileReader* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileFileReader, vtkObject);
+
+  // Description:
+  // Reads the files at paths into data, in the same order. The data of
+  // a file that cannot be read is left empty.
+  void ReadFiles(const std::vector<std::string>& paths,
+    std::vector<std::vector<unsigned char> >& data);
+
+  // Description:
+  // Returns true if files are read through io_uring.
+  bool GetUseIoUring();
+
+protected:
+  vtkMapTileFileReader();
+  ~vtkMapTileFileReader() override;
+
+  // Description:
+  // Reads a single file with blocking calls, returns false on failure
+  static bool ReadFile(
+    const std::string& path, std::vector<unsigned char>& data);
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileFileReader(const vtkMapTileFileReader&) VTK_DELETE_FUNCTION;
+  vtkMapTileFileReader& operator=(
+    const vtkMapTileFileReader&) VTK_DELETE_FUNCTION;
+};
+
+#endif // __vtkMapTileFileReader_h
@@ -0,0 +1,160 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileImagePool.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileImagePool.h"
+#include "vtkMapTileIndex.h"
+
+#include <vtkImageData.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkTexture.h>
+
+vtkStandardNewMacro(vtkMapTileImagePool);
+
+//----------------------------------------------------------------------------
+class vtkMapTileImagePool::vtkInternals
+{
+public:
+  struct Entry
+  {
+    vtkSmartPointer<vtkImageData> Image;
+    vtkSmartPointer<vtkTexture> Texture; // created by GetTexture()
+    std::size_t Users;
+
+    Entry()
+      : Users(0)
+    {
+    }
+  };
+
+  vtkMapTileIndex<Entry> Entries; // by content hash
+  std::size_t Users;              // sum of Entry::Users
+  vtkSimpleMutexLock Lock;
+
+  vtkInternals()
+    : Users(0)
+  {
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTileImagePool::vtkMapTileImagePool()
+{
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTileImagePool::~vtkMapTileImagePool()
+{
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileImagePool::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfImages: " << this->GetNumberOfImages() << "\n"
+     << indent << "NumberOfUsers: " << this->GetNumberOfUsers() << std::endl;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkMapTileImagePool::AcquireImage(vtkTypeUInt64 hash)
+{
+  this->Internals->Lock.Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(hash);
+  vtkImageData* image = nullptr;
+  if (entry)
+  {
+    ++entry->Users;
+    ++this->Internals->Users;
+    image = entry->Image;
+  }
+  this->Internals->Lock.Unlock();
+  return image;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkMapTileImagePool::AddImage(
+  vtkTypeUInt64 hash, vtkImageData* image)
+{
+  this->Internals->Lock.Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(hash);
+  if (!entry)
+  {
+    vtkInternals::Entry newEntry;
+    newEntry.Image = image;
+    entry = &this->Internals->Entries.Insert(hash, newEntry);
+  }
+  ++entry->Users;
+  ++this->Internals->Users;
+  image = entry->Image;
+  this->Internals->Lock.Unlock();
+  return image;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTileImagePool::ReleaseImage(vtkTypeUInt64 hash)
+{
+  // The entry is destroyed outside the lock
+  vtkInternals::Entry released;
+  this->Internals->Lock.Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(hash);
+  if (entry)
+  {
+    --this->Internals->Users;
+    if (--entry->Users == 0)
+    {
+      released = *entry;
+      this->Internals->Entries.Erase(hash);
+    }
+  }
+  this->Internals->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+vtkTexture* vtkMapTileImagePool::GetTexture(vtkTypeUInt64 hash)
+{
+  this->Internals->Lock.Lock();
+  vtkInternals::Entry* entry = this->Internals->Entries.Find(hash);
+  if (entry && !entry->Texture)
+  {
+    entry->Texture = vtkSmartPointer<vtkTexture>::New();
+    entry->Texture->SetInputData(entry->Image);
+    entry->Texture->SetQualityTo32Bit();
+    entry->Texture->SetInterpolate(1);
+  }
+  vtkTexture* texture = entry ? entry->Texture.GetPointer() : nullptr;
+  this->Internals->Lock.Unlock();
+  return texture;
+}
+
+//----------------------------------------------------------------------------
+std::size_t vtkMapTileImagePool::GetNumberOfImages()
+{
+  this->Internals->Lock.Lock();
+  std::size_t count = this->Internals->Entries.Size();
+  this->Internals->Lock.Unlock();
+  return count;
+}
+
+//----------------------------------------------------------------------------
+std::size_t vtkMapTileImagePool::GetNumberOfUsers()
+{
+  this->Internals->Lock.Lock();
+  std::size_t count = this->Internals->Users;
+  this->Internals->Lock.Unlock();
+  return count;
+}
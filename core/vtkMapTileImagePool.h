@@ -0,0 +1,84 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileImagePool.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileImagePool - decoded map-tile images shared by content
+// .SECTION Description
+// Large parts of a map are byte-identical tiles (open sea, desert, the
+// "tile not available" image). vtkMapTile looks up its encoded image by
+// content hash (vtkMapTileKey::HashContent()) before decoding it, so
+// that tiles with the same content share a single vtkImageData and a
+// single vtkTexture, hence a single texture in graphics memory.
+//
+// Images are counted by the tiles using them, and released with their
+// texture when the last one releases it. Used internally by vtkOsmLayer.
+// All methods are thread safe; textures must only be used from the
+// rendering thread.
+
+#ifndef __vtkMapTileImagePool_h
+#define __vtkMapTileImagePool_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+
+#include <cstddef>
+
+class vtkImageData;
+class vtkTexture;
+
+class VTKMAPCORE_EXPORT vtkMapTileImagePool : public vtkObject
+{
+public:
+  static vtkMapTileImagePool* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTileImagePool, vtkObject);
+
+  // Description:
+  // Returns the image shared for a content hash, adding a user,
+  // or nullptr if there is none.
+  vtkImageData* AcquireImage(vtkTypeUInt64 hash);
+
+  // Description:
+  // Shares an image decoded from content with the given hash, adding a
+  // user. Returns the image to use, which is the image shared by another
+  // tile if it was added in the meantime.
+  vtkImageData* AddImage(vtkTypeUInt64 hash, vtkImageData* image);
+
+  // Description:
+  // Removes a user of the image shared for a content hash.
+  void ReleaseImage(vtkTypeUInt64 hash);
+
+  // Description:
+  // Texture of the image shared for a content hash, created on first
+  // call, or nullptr if there is no such image.
+  vtkTexture* GetTexture(vtkTypeUInt64 hash);
+
+  // Description:
+  // Number of shared images, and of tiles using them.
+  std::size_t GetNumberOfImages();
+  std::size_t GetNumberOfUsers();
+
+protected:
+  vtkMapTileImagePool();
+  ~vtkMapTileImagePool() override;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTileImagePool(const vtkMapTileImagePool&); // Not implemented
+  vtkMapTileImagePool& operator=(const vtkMapTileImagePool&); // Not implemented
+};
+
+#endif // __vtkMapTileImagePool_h
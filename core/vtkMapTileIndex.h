@@ -0,0 +1,194 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileIndex.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileIndex - open-addressing hash table keyed by vtkMapTileKey
+// .SECTION Description
+// Flat hash table mapping packed tile keys to values of type T.
+// Slots are stored contiguously and collisions are resolved by linear
+// probing; erased slots are filled by shifting back the following entries,
+// so lookups never have to skip tombstones. Used internally by
+// vtkOsmLayer and its subclasses. Not thread safe.
+
+#ifndef __vtkMapTileIndex_h
+#define __vtkMapTileIndex_h
+
+#include "vtkMapTileKey.h"
+
+#include <cstddef>
+#include <vector>
+
+template <class T>
+class vtkMapTileIndex
+{
+public:
+  vtkMapTileIndex()
+    : Count(0)
+  {
+  }
+
+  // Description:
+  // Returns pointer to value stored for key, or nullptr.
+  // The pointer is invalidated by the next Insert() or Erase().
+  T* Find(vtkTypeUInt64 key)
+  {
+    if (this->Count == 0)
+    {
+      return nullptr;
+    }
+    std::size_t mask = this->Slots.size() - 1;
+    for (std::size_t i = this->Home(key);; i = (i + 1) & mask)
+    {
+      if (this->Slots[i].Key == key)
+      {
+        return &this->Slots[i].Value;
+      }
+      if (this->Slots[i].Key == vtkMapTileKey::Invalid())
+      {
+        return nullptr;
+      }
+    }
+  }
+
+  bool Contains(vtkTypeUInt64 key) { return this->Find(key) != nullptr; }
+
+  // Description:
+  // Set value for key, replacing any existing value.
+  // Returns reference to the stored value.
+  T& Insert(vtkTypeUInt64 key, const T& value)
+  {
+    // Keep load factor at or below 1/2
+    if (2 * (this->Count + 1) > this->Slots.size())
+    {
+      this->Rehash(this->Slots.empty() ? 16 : 2 * this->Slots.size());
+    }
+
+    std::size_t mask = this->Slots.size() - 1;
+    std::size_t i = this->Home(key);
+    while (this->Slots[i].Key != vtkMapTileKey::Invalid() &&
+      this->Slots[i].Key != key)
+    {
+      i = (i + 1) & mask;
+    }
+    if (this->Slots[i].Key != key)
+    {
+      this->Slots[i].Key = key;
+      ++this->Count;
+    }
+    this->Slots[i].Value = value;
+    return this->Slots[i].Value;
+  }
+
+  // Description:
+  // Remove key, returns false if it was not present.
+  bool Erase(vtkTypeUInt64 key)
+  {
+    if (this->Count == 0)
+    {
+      return false;
+    }
+    std::size_t mask = this->Slots.size() - 1;
+    std::size_t i = this->Home(key);
+    while (this->Slots[i].Key != key)
+    {
+      if (this->Slots[i].Key == vtkMapTileKey::Invalid())
+      {
+        return false;
+      }
+      i = (i + 1) & mask;
+    }
+
+    // Backward-shift deletion: move up entries whose probe sequence
+    // passes through the freed slot.
+    std::size_t hole = i;
+    for (std::size_t j = (i + 1) & mask;
+         this->Slots[j].Key != vtkMapTileKey::Invalid(); j = (j + 1) & mask)
+    {
+      std::size_t home = this->Home(this->Slots[j].Key);
+      // Entry at j may fill the hole if its home is not in (hole, j]
+      bool movable = hole <= j ? (home <= hole || home > j)
+                               : (home <= hole && home > j);
+      if (movable)
+      {
+        this->Slots[hole] = this->Slots[j];
+        hole = j;
+      }
+    }
+    this->Slots[hole].Key = vtkMapTileKey::Invalid();
+    this->Slots[hole].Value = T();
+    --this->Count;
+    return true;
+  }
+
+  void Clear()
+  {
+    this->Slots.clear();
+    this->Count = 0;
+  }
+
+  std::size_t Size() const { return this->Count; }
+  bool Empty() const { return this->Count == 0; }
+
+  // Description:
+  // Calls f(key, value) for each entry, in unspecified order.
+  // The table must not be modified from f.
+  template <class F>
+  void ForEach(F f)
+  {
+    for (std::size_t i = 0; i < this->Slots.size(); ++i)
+    {
+      if (this->Slots[i].Key != vtkMapTileKey::Invalid())
+      {
+        f(this->Slots[i].Key, this->Slots[i].Value);
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    vtkTypeUInt64 Key;
+    T Value;
+
+    Slot()
+      : Key(vtkMapTileKey::Invalid())
+      , Value()
+    {
+    }
+  };
+
+  std::size_t Home(vtkTypeUInt64 key) const
+  {
+    return std::size_t(vtkMapTileKey::Hash(key)) & (this->Slots.size() - 1);
+  }
+
+  void Rehash(std::size_t capacity)
+  {
+    std::vector<Slot> old;
+    old.swap(this->Slots);
+    this->Slots.resize(capacity);
+    this->Count = 0;
+    for (std::size_t i = 0; i < old.size(); ++i)
+    {
+      if (old[i].Key != vtkMapTileKey::Invalid())
+      {
+        this->Insert(old[i].Key, old[i].Value);
+      }
+    }
+  }
+
+  std::vector<Slot> Slots; // size is zero or a power of two
+  std::size_t Count;
+};
+
+#endif // __vtkMapTileIndex_h
@@ -0,0 +1,108 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileKey.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileKey - packed 64-bit (zoom, x, y) map-tile key
+// .SECTION Description
+// Packs tile indices into a single 64-bit integer, quadkey style:
+// the zoom level is stored in the 6 high bits and the x/y indices are
+// bit-interleaved (Morton order) in the 58 low bits. Neighbouring tiles
+// therefore have close keys, and a parent key is obtained by dropping
+// the two lowest interleaved bits. Supports zoom levels up to 29.
+// HashContent() makes keys of the same tables from image content.
+
+#ifndef __vtkMapTileKey_h
+#define __vtkMapTileKey_h
+
+#include <vtkType.h>
+
+#include <cstddef>
+
+class vtkMapTileKey
+{
+public:
+  // Description:
+  // Value that is never produced by Make(), used to mark empty slots
+  static vtkTypeUInt64 Invalid() { return ~vtkTypeUInt64(0); }
+
+  //----------------------------------------------------------------------------
+  static vtkTypeUInt64 Make(int zoom, int x, int y)
+  {
+    return (vtkTypeUInt64(zoom) << 58) | Spread(vtkTypeUInt32(x)) |
+      (Spread(vtkTypeUInt32(y)) << 1);
+  }
+
+  //----------------------------------------------------------------------------
+  static int Zoom(vtkTypeUInt64 key) { return int(key >> 58); }
+
+  //----------------------------------------------------------------------------
+  static int X(vtkTypeUInt64 key) { return int(Compact(key)); }
+
+  //----------------------------------------------------------------------------
+  static int Y(vtkTypeUInt64 key) { return int(Compact(key >> 1)); }
+
+  //----------------------------------------------------------------------------
+  // Mixes key bits for use as a hash-table index
+  static vtkTypeUInt64 Hash(vtkTypeUInt64 key)
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+  }
+
+  //----------------------------------------------------------------------------
+  // Content key of an encoded tile image (FNV-1a of its bytes, mixed),
+  // used to find identical images. Never 0 nor Invalid().
+  static vtkTypeUInt64 HashContent(const unsigned char* data, std::size_t size)
+  {
+    vtkTypeUInt64 h = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+      h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    h = Hash(h ^ size);
+    return h == 0 || h == Invalid() ? 1 : h;
+  }
+
+private:
+  //----------------------------------------------------------------------------
+  // Inserts a zero bit between each of the 29 low bits of v
+  static vtkTypeUInt64 Spread(vtkTypeUInt32 v)
+  {
+    vtkTypeUInt64 x = v & 0x1fffffff;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+    x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x;
+  }
+
+  //----------------------------------------------------------------------------
+  // Inverse of Spread(), ignoring the zoom bits
+  static vtkTypeUInt32 Compact(vtkTypeUInt64 x)
+  {
+    x &= 0x0155555555555555ULL;
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+    x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+    x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+    return vtkTypeUInt32(x);
+  }
+};
+
+#endif // __vtkMapTileKey_h
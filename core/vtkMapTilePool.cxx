@@ -0,0 +1,140 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTilePool.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTilePool.h"
+#include "vtkMapTile.h"
+
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+
+#include <vector>
+
+vtkStandardNewMacro(vtkMapTilePool);
+
+//----------------------------------------------------------------------------
+class vtkMapTilePool::vtkInternals
+{
+public:
+  std::vector<vtkSmartPointer<vtkMapTile> > Tiles;
+  vtkTypeUInt64 NumberOfReusedTiles;
+  vtkSimpleMutexLock Lock;
+
+  vtkInternals()
+    : NumberOfReusedTiles(0)
+  {
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkMapTilePool::vtkMapTilePool()
+{
+  this->MaxSize = 64;
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMapTilePool::~vtkMapTilePool()
+{
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTilePool::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MaxSize: " << this->MaxSize << "\n"
+     << indent << "NumberOfTiles: " << this->GetNumberOfTiles() << "\n"
+     << indent << "NumberOfReusedTiles: " << this->GetNumberOfReusedTiles()
+     << std::endl;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkMapTile> vtkMapTilePool::NewTile()
+{
+  vtkSmartPointer<vtkMapTile> tile;
+  this->Internals->Lock.Lock();
+  if (!this->Internals->Tiles.empty())
+  {
+    tile = this->Internals->Tiles.back();
+    this->Internals->Tiles.pop_back();
+    ++this->Internals->NumberOfReusedTiles;
+  }
+  this->Internals->Lock.Unlock();
+
+  if (!tile)
+  {
+    tile = vtkSmartPointer<vtkMapTile>::New();
+  }
+  return tile;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMapTilePool::ReleaseTile(vtkMapTile* tile)
+{
+  // Tiles still displayed, or drawn by the atlas, are referenced
+  if (!tile || tile->GetReferenceCount() > 1)
+  {
+    return false;
+  }
+
+  this->Internals->Lock.Lock();
+  bool full =
+    this->Internals->Tiles.size() >= static_cast<std::size_t>(this->MaxSize);
+  this->Internals->Lock.Unlock();
+  if (full)
+  {
+    return false;
+  }
+
+  // Reset before NewTile() can hand it out. Other threads may have
+  // filled the pool meanwhile.
+  tile->Reset();
+  this->Internals->Lock.Lock();
+  full =
+    this->Internals->Tiles.size() >= static_cast<std::size_t>(this->MaxSize);
+  if (!full)
+  {
+    this->Internals->Tiles.push_back(tile);
+  }
+  this->Internals->Lock.Unlock();
+  return !full;
+}
+
+//----------------------------------------------------------------------------
+void vtkMapTilePool::Clear()
+{
+  std::vector<vtkSmartPointer<vtkMapTile> > tiles;
+  this->Internals->Lock.Lock();
+  tiles.swap(this->Internals->Tiles);
+  this->Internals->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+std::size_t vtkMapTilePool::GetNumberOfTiles()
+{
+  this->Internals->Lock.Lock();
+  std::size_t count = this->Internals->Tiles.size();
+  this->Internals->Lock.Unlock();
+  return count;
+}
+
+//----------------------------------------------------------------------------
+vtkTypeUInt64 vtkMapTilePool::GetNumberOfReusedTiles()
+{
+  this->Internals->Lock.Lock();
+  vtkTypeUInt64 count = this->Internals->NumberOfReusedTiles;
+  this->Internals->Lock.Unlock();
+  return count;
+}
@@ -0,0 +1,85 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTilePool.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTilePool - recycles the tiles evicted from the tile cache
+// .SECTION Description
+// Building a tile creates a plane source, a texture mapping filter, a
+// mapper, an actor and a texture, which are all deleted when the tile is
+// evicted from vtkMapTileCache. While panning, tiles are evicted and
+// created at the same rate, so the pool keeps evicted tiles, reset (see
+// vtkMapTile::Reset()) but with their rendering objects, and hands them
+// out in place of new tiles, which then only move their geometry and
+// replace their image. Used internally by vtkOsmLayer.
+// All methods are thread safe.
+
+#ifndef __vtkMapTilePool_h
+#define __vtkMapTilePool_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+#include <cstddef>
+
+class vtkMapTile;
+
+class VTKMAPCORE_EXPORT vtkMapTilePool : public vtkObject
+{
+public:
+  static vtkMapTilePool* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMapTilePool, vtkObject);
+
+  // Description:
+  // Maximum number of tiles kept for reuse, 0 disables the pool.
+  // Default is 64, a few rows of tiles of a full-HD viewport.
+  vtkSetMacro(MaxSize, int);
+  vtkGetMacro(MaxSize, int);
+
+  // Description:
+  // Returns a recycled tile, or a new one if the pool is empty.
+  vtkSmartPointer<vtkMapTile> NewTile();
+
+  // Description:
+  // Resets a tile and keeps it for reuse, unless the pool is full or the
+  // tile is referenced elsewhere, i.e. the caller does not hold its only
+  // reference. Returns true if the tile was kept.
+  bool ReleaseTile(vtkMapTile* tile);
+
+  // Description:
+  // Remove all tiles from the pool.
+  void Clear();
+
+  // Description:
+  // Number of tiles in the pool, and number of tiles reused by
+  // NewTile() since the pool was created.
+  std::size_t GetNumberOfTiles();
+  vtkTypeUInt64 GetNumberOfReusedTiles();
+
+protected:
+  vtkMapTilePool();
+  ~vtkMapTilePool() override;
+
+  int MaxSize;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMapTilePool(const vtkMapTilePool&);            // Not implemented
+  vtkMapTilePool& operator=(const vtkMapTilePool&); // Not implemented
+};
+
+#endif // __vtkMapTilePool_h
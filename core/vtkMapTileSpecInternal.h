@@ -29,6 +29,7 @@ public:
   double Corners[4]; // world coordinates
   int ZoomRowCol[3]; // OSM tile indices
   int ZoomXY[3];     // local cache indices
+  double Priority;   // request order, lowest first
   vtkSmartPointer<vtkMapTile> Tile;
 
   vtkMapTileSpecInternal();
@@ -38,6 +39,7 @@ inline vtkMapTileSpecInternal::vtkMapTileSpecInternal()
   : Corners{ 0., 0., 0., 0. }
   , ZoomRowCol{ 0, 0, 0 }
   , ZoomXY{ 0, 0, 0 }
+  , Priority(0.)
 {
 }
 
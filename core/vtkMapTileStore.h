@@ -0,0 +1,70 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMapTileStore.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMapTileStore - abstract storage backend for map-tile images
+// .SECTION Description
+// Interface for storing encoded (png/jpeg) map-tile images somewhere
+// other than one file per tile in the layer's cache directory.
+// When a store is set on vtkOsmLayer, tiles are read from and written
+// to the store, and decoded from memory.
+//
+// Tiles are addressed by their OSM indices (zoom, column, row), i.e.
+// vtkMapTileSpecInternal::ZoomRowCol. Implementations must be thread
+// safe, since vtkMultiThreadedOsmLayer calls them from its request
+// threads.
+
+#ifndef __vtkMapTileStore_h
+#define __vtkMapTileStore_h
+
+#include "vtkmapcore_export.h"
+
+#include <vtkObject.h>
+
+#include <vector>
+
+class VTKMAPCORE_EXPORT vtkMapTileStore : public vtkObject
+{
+public:
+  vtkTypeMacro(vtkMapTileStore, vtkObject);
+
+  // Description:
+  // Returns true if the store contains an image for the tile
+  virtual bool HasTile(int zoom, int x, int y) = 0;
+
+  // Description:
+  // Copies the encoded image of the tile into data.
+  // Returns false if the tile is not in the store.
+  virtual bool ReadTile(
+    int zoom, int x, int y, std::vector<unsigned char>& data) = 0;
+
+  // Description:
+  // Stores the encoded image of the tile, replacing any previous one.
+  // Writes may be deferred until Flush().
+  virtual bool WriteTile(
+    int zoom, int x, int y, const std::vector<unsigned char>& data) = 0;
+
+  // Description:
+  // Commits deferred writes
+  virtual void Flush() {}
+
+protected:
+  vtkMapTileStore() {}
+  ~vtkMapTileStore() override {}
+
+private:
+  vtkMapTileStore(const vtkMapTileStore&);            // Not implemented
+  vtkMapTileStore& operator=(const vtkMapTileStore&); // Not implemented
+};
+
+#endif // __vtkMapTileStore_h
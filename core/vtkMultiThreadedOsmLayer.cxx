@@ -15,22 +15,25 @@
 
 #include "vtkMultiThreadedOsmLayer.h"
 #include "vtkMapTile.h"
+#include "vtkMapTileFileReader.h"
+#include "vtkMapTileIndex.h"
+#include "vtkMapTileKey.h"
 
 #include <vtkAtomic.h>
 #include <vtkCallbackCommand.h>
 #include <vtkConditionVariable.h>
 #include <vtkMultiThreader.h>
 #include <vtkMutexLock.h>
+#include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkRenderWindow.h>
 #include <vtkRenderWindowInteractor.h>
 #include <vtksys/SystemTools.hxx>
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <sstream>
-#include <stack>
-
-// Limit the number of concurrent http requests
-#define NUMBER_OF_REQUEST_THREADS 6
 
 vtkStandardNewMacro(vtkMultiThreadedOsmLayer)
 
@@ -38,45 +41,277 @@ vtkStandardNewMacro(vtkMultiThreadedOsmLayer)
   class vtkMultiThreadedOsmLayer::vtkMultiThreadedOsmLayerInternals
 {
 public:
-  vtkMultiThreader* BackgroundThreader; // for BackgroundThreadExecute()
-  vtkMultiThreader* RequestThreader;    // for RequestThreadExecute()
-  int BackgroundThreadId;
-  bool DownloadMode; // sets RequestThreader behavior
+  // Request threads, running WorkerThreadExecute() until stopped
+  vtkMultiThreader* Threader;
+  std::vector<int> WorkerThreadIds;
 
   vtkAtomic<vtkTypeInt32> ThreadingEnabled;
   vtkConditionVariable* ThreadingCondition;
 
-  std::stack<TileSpecList> ScheduledTiles;
-  vtkAtomic<vtkTypeInt32> ScheduledStackSize;
+  // Tiles waiting for the image lookup (pass 1) and for download (pass 2),
+  // sorted by decreasing Priority so that the most urgent tile is last.
+  // Protected by ScheduledTilesLock.
+  TileSpecList ScheduledTiles;
+  TileSpecList DownloadTiles;
+  vtkAtomic<vtkTypeInt32> ScheduledCount; // see UpdateScheduledCount()
   vtkMutexLock* ScheduledTilesLock;
 
+  // Copy of vtkOsmLayer::VisibleTiles, and points around which tiles are
+  // requested first, in tile units of the current zoom level (see
+  // UpdateFocusPoints()). Protected by ScheduledTilesLock.
+  int VisibleTiles[5];
+  double FocusPoints[2][2];
+  int NumberOfFocusPoints;
+
+  // Tiles scheduled but not yet added to the tile cache, so that they
+  // are not scheduled again. Protected by ScheduledTilesLock.
+  vtkMapTileIndex<char> InFlightTiles;
+
+  void RemoveInFlight(const TileSpecList& specs)
+  {
+    for (std::size_t i = 0; i < specs.size(); ++i)
+    {
+      this->RemoveInFlight(specs[i]);
+    }
+  }
+
+  void RemoveInFlight(const vtkMapTileSpecInternal& spec)
+  {
+    const int* zxy = spec.ZoomXY;
+    this->InFlightTiles.Erase(vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]));
+  }
+
+  // Cancellation flags of the downloads in progress, and of the waits
+  // for downloads by other processes, by ZoomXY key.
+  // Protected by ScheduledTilesLock.
+  vtkMapTileIndex<vtkMapTileDownloader::CancelFlag*> ActiveDownloads;
+  bool CancelDownloads; // set on destruction, later downloads are cancelled
+
+  // Registers the cancellation flag of a download, so that AddTiles()
+  // can cancel it
+  void AddActiveDownload(const vtkMapTileSpecInternal& spec,
+    vtkMapTileDownloader::CancelFlag* cancel)
+  {
+    const int* zxy = spec.ZoomXY;
+    *cancel = 0;
+    this->ScheduledTilesLock->Lock();
+    this->ActiveDownloads.Insert(
+      vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]), cancel);
+    if (this->CancelDownloads)
+    {
+      *cancel = 1;
+    }
+    this->ScheduledTilesLock->Unlock();
+  }
+
+  void RemoveActiveDownload(const vtkMapTileSpecInternal& spec)
+  {
+    const int* zxy = spec.ZoomXY;
+    this->ScheduledTilesLock->Lock();
+    this->ActiveDownloads.Erase(vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]));
+    this->ScheduledTilesLock->Unlock();
+  }
+
+  // Returns true if a tile, given by its ZoomXY indices, covers part of
+  // VisibleTiles or of the ring of tiles around it
+  bool IsTileWanted(int zoom, int x, int y)
+  {
+    // Tile extent, in tile units of the current zoom level
+    double scale = std::ldexp(1.0, this->VisibleTiles[0] - zoom);
+    return (x + 1) * scale >= this->VisibleTiles[1] - 1 &&
+      x * scale <= this->VisibleTiles[2] + 2 &&
+      (y + 1) * scale >= this->VisibleTiles[3] - 1 &&
+      y * scale <= this->VisibleTiles[4] + 2;
+  }
+
+  // Predicted tiles, requested when no visible tile is waiting, most
+  // likely at the back. Protected by ScheduledTilesLock.
+  TileSpecList PrefetchTiles;
+
+  // Tiles drawn from expired image files, revalidated with the server
+  // when no visible tile is waiting, most urgent at the back.
+  // Protected by ScheduledTilesLock.
+  TileSpecList RevalidateTiles;
+
+  // A tile request processed by one request thread
+  struct Job
+  {
+    vtkMapTileSpecInternal Spec;
+    bool Download; // pass 2, otherwise pass 1
+    bool Prefetch; // predicted tile, otherwise visible
+    bool Revalidate; // conditional request for an expired image file
+    std::string Host; // request slot reserved for downloads
+
+    // Whether the job counts in ScheduledCount
+    bool IsVisible() const { return !this->Prefetch && !this->Revalidate; }
+  };
+
+  // Request slots are reserved from the layer's downloader, which adapts
+  // the number of concurrent requests to Host, the server of the tiles.
+  // Protected by ScheduledTilesLock.
+  vtkMapTileDownloader* Downloader;
+  std::string Host;
+
+  // Reserves a request slot for a download job, returns false if the
+  // concurrency limit of the server is reached
+  bool BeginDownload(Job& job)
+  {
+    if (!this->Downloader->BeginRequest(this->Host))
+    {
+      return false;
+    }
+    job.Host = this->Host;
+    return true;
+  }
+
+  // Jobs taken by each request thread from the shared lists, in order.
+  // Idle threads steal jobs from the back of the other threads' lists.
+  // Protected by ScheduledTilesLock.
+  std::vector<std::deque<Job> > LocalJobs;
+  int ActiveJobs; // visible tiles being processed
+
+  // Lookups of the share of a thread whose image files are read ahead at
+  // once, at most. Files of lookups stolen by other threads, or of tiles
+  // cancelled meanwhile, are read for nothing.
+  enum
+  {
+    ReadAheadFiles = 32
+  };
+
+  // Takes the next job of a request thread, returns false if there is none.
+  // Download jobs are skipped while the concurrency limit is reached.
+  bool TakeJob(std::size_t workerId, Job& job)
+  {
+    std::deque<Job>& local = this->LocalJobs[workerId];
+    job.Host.clear();
+    if (!local.empty() && !local.front().Prefetch)
+    {
+      job = local.front();
+      local.pop_front();
+      return true;
+    }
+    if (!this->ScheduledTiles.empty())
+    {
+      // Image lookups are quick, take a share of them at once. They are
+      // queued before predicted tiles, most urgent first.
+      std::size_t count = std::min(this->ScheduledTiles.size(),
+        this->ScheduledTiles.size() / this->LocalJobs.size() + 1);
+      std::size_t first = this->ScheduledTiles.size() - count;
+      for (std::size_t i = first; i < this->ScheduledTiles.size(); ++i)
+      {
+        Job lookup = { this->ScheduledTiles[i], false, false, false };
+        local.push_front(lookup);
+      }
+      this->ScheduledTiles.resize(first);
+      job = local.front();
+      local.pop_front();
+      return true;
+    }
+    bool canDownload = true;
+    if (!this->DownloadTiles.empty())
+    {
+      // One download at a time, so that no tile waits for another one
+      canDownload = this->BeginDownload(job);
+      if (canDownload)
+      {
+        job.Spec = this->DownloadTiles.back();
+        job.Download = true;
+        job.Prefetch = false;
+        job.Revalidate = false;
+        this->DownloadTiles.pop_back();
+        return true;
+      }
+    }
+    for (std::size_t i = 0; i < this->LocalJobs.size(); ++i)
+    {
+      // Own jobs are taken from the front, other jobs are stolen from the
+      // back of their list
+      bool own = i == 0;
+      std::deque<Job>& jobs =
+        this->LocalJobs[(workerId + i) % this->LocalJobs.size()];
+      if (jobs.empty())
+      {
+        continue;
+      }
+      const Job& next = own ? jobs.front() : jobs.back();
+      if (next.Download)
+      {
+        canDownload = canDownload && this->BeginDownload(job);
+        if (!canDownload)
+        {
+          continue;
+        }
+      }
+      job.Spec = next.Spec;
+      job.Download = next.Download;
+      job.Prefetch = next.Prefetch;
+      job.Revalidate = false;
+      if (own)
+      {
+        jobs.pop_front();
+      }
+      else
+      {
+        jobs.pop_back();
+      }
+      return true;
+    }
+    if (!this->RevalidateTiles.empty() && canDownload &&
+      this->BeginDownload(job))
+    {
+      job.Spec = this->RevalidateTiles.back();
+      job.Download = false;
+      job.Prefetch = false;
+      job.Revalidate = true;
+      this->RevalidateTiles.pop_back();
+      return true;
+    }
+    if (!this->PrefetchTiles.empty())
+    {
+      // Idle, request a few predicted tiles
+      std::size_t count = std::min(
+        this->PrefetchTiles.size(), this->PrefetchTiles.size() / 4 + 1);
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        Job lookup = { this->PrefetchTiles.back(), false, true, false };
+        this->PrefetchTiles.pop_back();
+        local.push_back(lookup);
+      }
+      job = local.front();
+      local.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  // Number of visible tiles scheduled and not yet requested
+  void UpdateScheduledCount()
+  {
+    std::size_t count = this->ScheduledTiles.size() +
+      this->DownloadTiles.size() + this->ActiveJobs;
+    for (std::size_t i = 0; i < this->LocalJobs.size(); ++i)
+    {
+      for (std::size_t j = 0; j < this->LocalJobs[i].size(); ++j)
+      {
+        count += this->LocalJobs[i][j].IsVisible() ? 1 : 0;
+      }
+    }
+    this->ScheduledCount = static_cast<vtkTypeInt32>(count);
+  }
+
   TileSpecList NewTiles;
   vtkMutexLock* NewTilesLock;
-
-  // Allocate tile-spec list for each request thread
-  TileSpecList ThreadTileSpecs[NUMBER_OF_REQUEST_THREADS];
 };
 
 //----------------------------------------------------------------------------
-static VTK_THREAD_RETURN_TYPE StaticBackgroundThreadExecute(void* arg)
-{
-  vtkMultiThreadedOsmLayer* self;
-  vtkMultiThreader::ThreadInfo* info =
-    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
-  self = static_cast<vtkMultiThreadedOsmLayer*>(info->UserData);
-  self->BackgroundThreadExecute();
-  return VTK_THREAD_RETURN_VALUE;
-}
-
-//----------------------------------------------------------------------------
-static VTK_THREAD_RETURN_TYPE StaticRequestThreadExecute(void* arg)
+static VTK_THREAD_RETURN_TYPE StaticWorkerThreadExecute(void* arg)
 {
   vtkMultiThreadedOsmLayer* self;
   vtkMultiThreader::ThreadInfo* info =
     static_cast<vtkMultiThreader::ThreadInfo*>(arg);
   self = static_cast<vtkMultiThreadedOsmLayer*>(info->UserData);
   int threadId = info->ThreadID;
-  self->RequestThreadExecute(threadId);
+  self->WorkerThreadExecute(threadId);
   return VTK_THREAD_RETURN_VALUE;
 }
 
@@ -84,40 +319,44 @@ static VTK_THREAD_RETURN_TYPE StaticRequestThreadExecute(void* arg)
 vtkMultiThreadedOsmLayer::vtkMultiThreadedOsmLayer()
 {
   this->AsyncMode = true;
+  this->NumberOfRequestThreads = 6;
+  this->PrefetchBudget = 32;
   this->Internals = new vtkMultiThreadedOsmLayerInternals;
 
-  this->Internals->BackgroundThreader = vtkMultiThreader::New();
-  this->Internals->ThreadingEnabled = 1;
+  this->Internals->Threader = vtkMultiThreader::New();
+  this->Internals->ThreadingEnabled = 0;
   this->Internals->ThreadingCondition = vtkConditionVariable::New();
-  this->Internals->ScheduledStackSize = 0;
+  this->Internals->ScheduledCount = 0;
+  this->Internals->NumberOfFocusPoints = 0;
+  this->Internals->ActiveJobs = 0;
+  this->Internals->CancelDownloads = false;
+  this->Internals->Downloader = this->Downloader;
+  this->Internals->Host = vtkMapTileDownloader::GetHost(this->MapTileServer);
   this->Internals->ScheduledTilesLock = vtkMutexLock::New();
   this->Internals->NewTilesLock = vtkMutexLock::New();
 
-  this->Internals->RequestThreader = vtkMultiThreader::New();
-  this->Internals->RequestThreader->SetNumberOfThreads(
-    NUMBER_OF_REQUEST_THREADS);
-  this->Internals->RequestThreader->SetSingleMethod(
-    StaticRequestThreadExecute, this);
-
-  // Start the background thread
-  this->Internals->BackgroundThreadId =
-    this->Internals->BackgroundThreader->SpawnThread(
-      StaticBackgroundThreadExecute, this);
+  this->StartRequestThreads();
 }
 
 //----------------------------------------------------------------------------
 vtkMultiThreadedOsmLayer::~vtkMultiThreadedOsmLayer()
 {
+  // Stop taking jobs, then abort downloads in progress. A thread that
+  // took a job before starts its download already cancelled, so that
+  // joining the threads doesn't wait for a whole transfer.
+  this->Internals->ScheduledTilesLock->Lock();
   this->Internals->ThreadingEnabled = 0;
+  this->Internals->CancelDownloads = true;
   this->Internals->ThreadingCondition->Broadcast();
+  this->Internals->ActiveDownloads.ForEach(
+    [](vtkTypeUInt64, vtkMapTileDownloader::CancelFlag* cancel) {
+      *cancel = 1;
+    });
+  this->Internals->ScheduledTilesLock->Unlock();
 
-  this->Internals->BackgroundThreader->TerminateThread(
-    this->Internals->BackgroundThreadId);
-  vtkDebugMacro("Terminate Thread " << this->Internals->BackgroundThreadId);
-
-  this->Internals->BackgroundThreader->Delete();
-  this->Internals->RequestThreader->Delete();
+  this->StopRequestThreads();
 
+  this->Internals->Threader->Delete();
   this->Internals->ThreadingCondition->Delete();
   this->Internals->ScheduledTilesLock->Delete();
   this->Internals->NewTilesLock->Delete();
@@ -131,10 +370,9 @@ void vtkMultiThreadedOsmLayer::PrintSelf(ostream& os, vtkIndent indent)
   Superclass::PrintSelf(os, indent);
   os << "vtkMultiThreadedOsmLayer"
      << "\n"
-     << indent << "BackgroundThreadId: " << this->Internals->BackgroundThreadId
+     << indent << "NumberOfRequestThreads: " << this->NumberOfRequestThreads
      << "\n"
-     << indent << "NumberOfRequestThreads: "
-     << this->Internals->RequestThreader->GetNumberOfThreads() << std::endl;
+     << indent << "PrefetchBudget: " << this->PrefetchBudget << std::endl;
 }
 
 //----------------------------------------------------------------------------
@@ -144,142 +382,414 @@ void vtkMultiThreadedOsmLayer::Update()
 }
 
 //----------------------------------------------------------------------------
-void vtkMultiThreadedOsmLayer::BackgroundThreadExecute()
+void vtkMultiThreadedOsmLayer::SetNumberOfRequestThreads(int number)
 {
-  vtkDebugMacro("Enter BackgroundThreadExecute()");
-  TileSpecList tileSpecs;
-  TileSpecList newTiles;
-  int workingStackSize; // snapshot of stack size
-  while (this->Internals->ThreadingEnabled)
-  {
-    // Check if there are scheduled tiles
-    this->Internals->ScheduledTilesLock->Lock();
-    workingStackSize = this->Internals->ScheduledTiles.size();
-    if (workingStackSize > 0)
-    {
-      tileSpecs = this->Internals->ScheduledTiles.top();
-      this->Internals->ScheduledTiles.pop();
-      workingStackSize--;
-    }
-    this->Internals->ScheduledStackSize = workingStackSize;
-    this->Internals->ScheduledTilesLock->Unlock();
-
-    // Process tileSpecs (if any) using 2-pass algorithm
-    // The 1st pass initializes those tiles that have an
-    // image file available in the image cache
-    // (from a previous application/session).
-    // The 2nd pass performs http requests for the files
-    // that aren't already in the image cache.
-    if (!tileSpecs.empty())
-    {
-      // Pass 1 initializes new tiles that have image file in cache
-      this->AssignTileSpecsToThreads(tileSpecs);
-      this->Internals->DownloadMode = false;
-      this->Internals->RequestThreader->SingleMethodExecute();
-      newTiles.clear();
-      tileSpecs.clear();
-      this->CollateThreadResults(newTiles, tileSpecs);
-
-      // std::cout << "After pass 1: "
-      //           << "newTiles.size() " << newTiles.size()
-      //           << ", tileSpecs.size() " << tileSpecs.size()
-      //           << std::endl;
-
-      // Copy new tiles to shared list
-      this->UpdateNewTiles(newTiles);
+  number = std::max(1, std::min(number, VTK_MAX_THREADS));
+  if (number == this->NumberOfRequestThreads)
+  {
+    return;
+  }
+  this->NumberOfRequestThreads = number;
+
+  // Pending tiles are kept, see StopRequestThreads()
+  this->StopRequestThreads();
+  this->StartRequestThreads();
+  this->Modified();
+}
 
-      // Check if there are newer tiles in the scheduled stack
-      if (this->Internals->ScheduledStackSize > workingStackSize)
+//----------------------------------------------------------------------------
+void vtkMultiThreadedOsmLayer::StartRequestThreads()
+{
+  this->Internals->ScheduledTilesLock->Lock();
+  this->Internals->LocalJobs.resize(this->NumberOfRequestThreads);
+  this->Internals->ThreadingEnabled = 1;
+  this->Internals->ScheduledTilesLock->Unlock();
+
+  // Threads are numbered from 0 by the dedicated threader, and this
+  // number is their index in LocalJobs
+  for (int i = 0; i < this->NumberOfRequestThreads; ++i)
+  {
+    int threadId =
+      this->Internals->Threader->SpawnThread(StaticWorkerThreadExecute, this);
+    if (threadId >= 0)
+    {
+      this->Internals->WorkerThreadIds.push_back(threadId);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiThreadedOsmLayer::StopRequestThreads()
+{
+  this->Internals->ScheduledTilesLock->Lock();
+  this->Internals->ThreadingEnabled = 0;
+  this->Internals->ThreadingCondition->Broadcast();
+  this->Internals->ScheduledTilesLock->Unlock();
+
+  // Each thread returns after its current job
+  for (std::size_t i = 0; i < this->Internals->WorkerThreadIds.size(); ++i)
+  {
+    this->Internals->Threader->TerminateThread(
+      this->Internals->WorkerThreadIds[i]);
+    vtkDebugMacro("Terminate Thread " << this->Internals->WorkerThreadIds[i]);
+  }
+  this->Internals->WorkerThreadIds.clear();
+
+  // Return jobs not started to the shared lists
+  this->Internals->ScheduledTilesLock->Lock();
+  std::vector<std::deque<vtkMultiThreadedOsmLayerInternals::Job> >&
+    localJobs = this->Internals->LocalJobs;
+  for (std::size_t i = 0; i < localJobs.size(); ++i)
+  {
+    for (std::size_t j = 0; j < localJobs[i].size(); ++j)
+    {
+      const vtkMultiThreadedOsmLayerInternals::Job& job = localJobs[i][j];
+      if (job.Prefetch)
       {
-        // If there are newer tiles, loop back and do them next
-        continue;
+        this->Internals->RemoveInFlight(job.Spec);
       }
-
-      // Pass 2 downloads image files and initializes new tiles.
-      // Process one tile per thread so that we can break out
-      // sooner when new tiles are scheduled.
-      while (tileSpecs.size() > 0 &&
-        this->Internals->ScheduledStackSize == workingStackSize)
+      else if (job.Download)
       {
-        //std::cout << "Before pass 2: " << tileSpecs.size() << std::endl;
-        this->AssignOneTileSpecPerThread(tileSpecs);
-        //std::cout << "After assign : " << tileSpecs.size() << std::endl;
-        this->Internals->DownloadMode = true;
-        this->Internals->RequestThreader->SingleMethodExecute();
-        newTiles.clear();
-        this->CollateThreadResults(newTiles, tileSpecs);
-        //std::cout << "After collate : " << tileSpecs.size() << std::endl;
-        this->UpdateNewTiles(newTiles);
-        newTiles.clear();
-      } // while
-    }   // if (tileSpecs not empty)
-
-    // If we broke out of loop early, continue processing
-    if (tileSpecs.size() > 0)
+        this->Internals->DownloadTiles.push_back(job.Spec);
+      }
+      else
+      {
+        this->Internals->ScheduledTiles.push_back(job.Spec);
+      }
+    }
+  }
+  localJobs.clear();
+  this->PrioritizeTileSpecs(this->Internals->ScheduledTiles);
+  this->PrioritizeTileSpecs(this->Internals->DownloadTiles);
+  this->Internals->UpdateScheduledCount();
+  this->Internals->ScheduledTilesLock->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiThreadedOsmLayer::WorkerThreadExecute(int threadId)
+{
+  vtkDebugMacro("Enter WorkerThreadExecute, thread " << threadId);
+  vtkMultiThreadedOsmLayerInternals* internals = this->Internals;
+  vtkMultiThreadedOsmLayerInternals::Job job;
+  TileSpecList newTiles;
+
+  // Image files read ahead for the next lookups of this thread
+  vtkNew<vtkMapTileFileReader> reader;
+  TileSpecList readSpecs;
+  std::vector<std::vector<unsigned char> > readFiles;
+  std::vector<std::string> readPaths;
+  vtkMapTileIndex<std::size_t> readIndex; // by tile key, into readFiles
+
+  // Tiles are processed using 2-pass algorithm
+  // The 1st pass initializes those tiles that have an
+  // image available in the bundle, store or image cache
+  // (from a previous application/session).
+  // The 2nd pass performs http requests for the images
+  // that aren't available locally.
+  internals->ScheduledTilesLock->Lock();
+  while (internals->ThreadingEnabled)
+  {
+    if (!internals->TakeJob(threadId, job))
     {
+      // Nothing to do, wait for AddTiles() or another thread
+      internals->ThreadingCondition->Wait(internals->ScheduledTilesLock);
       continue;
     }
+    // Lookups are taken a share at a time (see TakeJob()), the image
+    // files of the first ones of the share are read at once
+    const int* zrc = job.Spec.ZoomRowCol;
+    vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+    readSpecs.clear();
+    if (!job.Download && !job.Revalidate && !readIndex.Contains(key))
+    {
+      readSpecs.push_back(job.Spec);
+      const std::deque<vtkMultiThreadedOsmLayerInternals::Job>& local =
+        internals->LocalJobs[threadId];
+      std::size_t count = internals->ReadAheadFiles - 1;
+      count = std::min(count, local.size());
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        if (!local[i].Download)
+        {
+          readSpecs.push_back(local[i].Spec);
+        }
+      }
+    }
+    internals->ActiveJobs += job.IsVisible() ? 1 : 0;
+    internals->UpdateScheduledCount();
+    internals->ScheduledTilesLock->Unlock();
+
+    if (!readSpecs.empty())
+    {
+      this->ReadImageFiles(
+        readSpecs, reader.GetPointer(), readFiles, readPaths, readIndex);
+    }
 
-    // Check if there are more scheduled tiles to process now
-    this->Internals->ScheduledTilesLock->Lock();
-    if (this->Internals->ScheduledTiles.size() == 0)
+    bool expired = false;
+    if (job.Revalidate)
     {
-      // If not, wait for condition variable
-      this->Internals->ThreadingCondition->Wait(
-        this->Internals->ScheduledTilesLock);
+      this->RevalidateTile(job.Spec);
+    }
+    else
+    {
+      std::size_t* index = readIndex.Find(key);
+      bool read = index && *index < readFiles.size();
+      expired = this->RequestTile(job.Spec, job.Download,
+        read ? &readFiles[*index] : nullptr,
+        read ? &readPaths[*index] : nullptr);
+      readIndex.Erase(key);
+    }
+    if (!job.Host.empty())
+    {
+      internals->Downloader->EndRequest(job.Host);
+    }
+    if (job.Spec.Tile)
+    {
+      newTiles.assign(1, job.Spec);
+      this->UpdateNewTiles(newTiles);
+    }
+
+    internals->ScheduledTilesLock->Lock();
+    internals->ActiveJobs -= job.IsVisible() ? 1 : 0;
+    if (!job.Host.empty())
+    {
+      // A request slot is available
+      internals->ThreadingCondition->Broadcast();
+    }
+    if (expired)
+    {
+      // The tile is drawn from the expired file meanwhile
+      internals->RevalidateTiles.push_back(job.Spec);
+      internals->RevalidateTiles.back().Tile = nullptr;
+      this->PrioritizeTileSpecs(internals->RevalidateTiles);
+      internals->ThreadingCondition->Broadcast();
+    }
+    // New tiles are removed from InFlightTiles by ResolveAsync(), and
+    // revalidated tiles are not in it
+    if (!job.Spec.Tile && !job.Revalidate)
+    {
+      if (job.Download)
+      {
+        // Cancelled download, the tile can be requested again
+        internals->RemoveInFlight(job.Spec);
+      }
+      else if (job.Prefetch)
+      {
+        // Download predicted tile next
+        job.Download = true;
+        internals->LocalJobs[threadId].push_front(job);
+        internals->ThreadingCondition->Broadcast();
+      }
+      else
+      {
+        // Queue for download, by priority
+        internals->DownloadTiles.push_back(job.Spec);
+        this->PrioritizeTileSpecs(internals->DownloadTiles);
+        internals->ThreadingCondition->Broadcast();
+      }
+    }
+    internals->UpdateScheduledCount();
+
+    if (job.Download && this->TileStore && internals->ScheduledCount == 0)
+    {
+      internals->ScheduledTilesLock->Unlock();
+      this->TileStore->Flush();
+      internals->ScheduledTilesLock->Lock();
     }
-    this->Internals->ScheduledTilesLock->Unlock();
   } // while
+  internals->ScheduledTilesLock->Unlock();
 }
 
 //----------------------------------------------------------------------------
-// Checks if image file is in cache, and if so, creates tile
-void vtkMultiThreadedOsmLayer::RequestThreadExecute(int threadId)
+void vtkMultiThreadedOsmLayer::ReadImageFiles(const TileSpecList& specs,
+  vtkMapTileFileReader* reader, std::vector<std::vector<unsigned char> >& files,
+  std::vector<std::string>& paths, vtkMapTileIndex<std::size_t>& index)
 {
-  //vtkDebugMacro("Enter RequestThreadExecute, thread " << threadId);
-  std::stringstream oss;
+  // Files not used yet are those of lookups stolen by other threads
+  index.Clear();
+  files.clear();
+  paths.clear();
 
-  // Get reference to tiles assigned to this thread
-  TileSpecList& tileSpecs = this->Internals->ThreadTileSpecs[threadId];
-  if (tileSpecs.empty())
+  // Tiles without a file to read are indexed past the end of files
+  for (std::size_t i = 0; i < specs.size(); ++i)
   {
-    return;
+    const int* zrc = specs[i].ZoomRowCol;
+    vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+    std::size_t size = 0;
+    std::string path;
+    if (!this->TileStore &&
+      (!this->TileBundle ||
+          !this->TileBundle->GetTileData(zrc[0], zrc[1], zrc[2], size)) &&
+      this->DiskCache->FindFile(key, path))
+    {
+      index.Insert(key, paths.size());
+      paths.push_back(path);
+    }
+    else
+    {
+      index.Insert(key, specs.size());
+    }
   }
+  reader->ReadFiles(paths, files);
+}
 
-  // Process all tile specs
-  std::vector<vtkMapTileSpecInternal>::iterator tileSpecIter =
-    tileSpecs.begin();
-  std::string filename;
+//----------------------------------------------------------------------------
+// Checks if image file is in cache, or downloads it, and creates tile
+bool vtkMultiThreadedOsmLayer::RequestTile(vtkMapTileSpecInternal& spec,
+  bool download, std::vector<unsigned char>* fileData,
+  const std::string* filePath)
+{
+  std::stringstream oss;
+  this->MakeFileSystemPath(spec, oss);
+  std::string filename = oss.str();
   std::string url;
-  for (; tileSpecIter != tileSpecs.end(); tileSpecIter++)
+  bool expired = false;
+  bool lookup = !download;
+  bool cached = false; // image file read from the disk cache
+
+  // Another process sharing the cache directory may be downloading it.
+  // The wait is cancelled like a download, see PerformRequest().
+  if (download)
   {
-    vtkMapTileSpecInternal& spec = *tileSpecIter;
-    this->MakeFileSystemPath(spec, oss);
-    filename = oss.str();
-    url.clear();
+    vtkMapTileDownloader::CancelFlag cancel;
+    this->Internals->AddActiveDownload(spec, &cancel);
+    download = this->ClaimTileDownload(
+      spec, this->DiskCache->GetClaimTimeout(), &cancel);
+    this->Internals->RemoveActiveDownload(spec);
+  }
 
-    if (this->Internals->DownloadMode)
+  if (download)
+  {
+    // Perform http request
+    this->MakeUrl(spec, oss);
+    url = oss.str();
+    vtkMapTileDownloader::Request request;
+    request.Url = url;
+    this->PerformRequest(spec, request);
+    bool saved = this->SaveImageFile(spec, request, filename);
+    if (request.Cancelled)
     {
-      // If DownloadMode, perform http request
-      this->MakeUrl(spec, oss);
-      url = oss.str();
-      if (!this->DownloadImageFile(url, filename))
+      // Tile left the view, no tile is created
+      return false;
+    }
+    if (!saved)
+    {
+      filename = this->TileNotAvailableImagePath;
+    }
+    this->CreateTile(spec, filename, url);
+    if (saved)
+    {
+      spec.Tile->SetImageBuffer(request.Data);
+    }
+  }
+  else
+  {
+    // Check for image in bundle, store or cache. Files read ahead were
+    // looked up in the disk cache index already, but data queued for
+    // writing since is more recent.
+    std::vector<unsigned char> data;
+    bool found = true;
+    if (!filePath)
+    {
+      found = this->FindTileImage(spec, filename, data);
+    }
+    else
+    {
+      const int* zrc = spec.ZoomRowCol;
+      vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+      if (!this->DiskCache->ReadPendingFile(key, data))
       {
-        filename = this->TileNotAvailableImagePath;
+        filename = *filePath;
       }
-      this->CreateTile(spec, filename, url);
     }
-    else
+    if (found)
     {
-      // If *not* DownloadMode, check for image file in cache
-      if (vtksys::SystemTools::FileExists(filename.c_str(), true))
+      this->MakeUrl(spec, oss);
+      url = oss.str();
+      this->CreateTile(spec, filename, url);
+      vtkMapTileDownloader::Request request;
+      expired = data.empty() && this->MakeRevalidationRequest(spec, request);
+      if (data.empty() && fileData)
       {
-        this->MakeUrl(spec, oss);
-        url = oss.str();
-        this->CreateTile(spec, filename, url);
+        // Image file read ahead, see ReadImageFiles()
+        data.swap(*fileData);
       }
+      if (!data.empty())
+      {
+        spec.Tile->SetImageBuffer(data);
+      }
+      cached = lookup && data.empty();
     }
-  } // for
+    else if (this->IsTileUnavailable(spec))
+    {
+      // Failed recently, served without asking the server again
+      this->MakeUrl(spec, oss);
+      url = oss.str();
+      this->CreateTile(spec, this->TileNotAvailableImagePath, url);
+    }
+  }
+
+  // Decode image and prepare geometry here, so that ResolveAsync()
+  // only has to create the actor
+  if (spec.Tile)
+  {
+    spec.Tile->LoadImage();
+    if (cached && spec.Tile->GetImageFileMissing() &&
+      this->FindMovedTileImage(spec, filename))
+    {
+      // Moved to the current cache layout while it was read
+      spec.Tile->SetFileSystemPath(filename);
+      spec.Tile->LoadImage();
+    }
+    else if (cached && spec.Tile->GetImageFileMissing())
+    {
+      // Indexed file removed from the cache directory, e.g. by another
+      // process: the tile is left null, to be queued for download with
+      // the others (see WorkerThreadExecute())
+      this->TilePool->ReleaseTile(spec.Tile);
+      spec.Tile = nullptr;
+      return false;
+    }
+  }
+  return expired;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiThreadedOsmLayer::RevalidateTile(vtkMapTileSpecInternal& spec)
+{
+  vtkMapTileDownloader::Request request;
+  if (!this->MakeRevalidationRequest(spec, request))
+  {
+    // Revalidated in the meantime
+    return;
+  }
+
+  std::stringstream oss;
+  this->MakeUrl(spec, oss);
+  std::string url = oss.str();
+  request.Url = url;
+  this->PerformRequest(spec, request);
+
+  this->MakeFileSystemPath(spec, oss);
+  std::string filename = oss.str();
+  if (this->SaveRevalidatedImage(spec, request, filename))
+  {
+    this->CreateTile(spec, filename, url);
+    spec.Tile->SetImageBuffer(request.Data);
+    spec.Tile->LoadImage();
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiThreadedOsmLayer::PerformRequest(
+  const vtkMapTileSpecInternal& spec, vtkMapTileDownloader::Request& request)
+{
+  vtkMapTileDownloader::CancelFlag cancel;
+  this->Internals->AddActiveDownload(spec, &cancel);
+  request.Cancel = &cancel;
+  this->Downloader->Download(request);
+  request.Cancel = nullptr;
+  this->Internals->RemoveActiveDownload(spec);
 }
 
 //----------------------------------------------------------------------------
@@ -297,6 +807,9 @@ vtkMap::AsyncState vtkMultiThreadedOsmLayer::ResolveAsync()
   this->Internals->NewTilesLock->Unlock();
 
   // Add newTiles to cache
+  this->Internals->ScheduledTilesLock->Lock();
+  this->Internals->RemoveInFlight(newTiles);
+  this->Internals->ScheduledTilesLock->Unlock();
   TileSpecList::iterator specIter = newTiles.begin();
   for (; specIter != newTiles.end(); specIter++)
   {
@@ -305,12 +818,12 @@ vtkMap::AsyncState vtkMultiThreadedOsmLayer::ResolveAsync()
     int x = spec.ZoomXY[1];
     int y = spec.ZoomXY[2];
     spec.Tile->SetLayer(this);
-    spec.Tile->Init();
+    this->PrepareTile(spec.Tile);
     this->AddTileToCache(zoom, x, y, spec.Tile);
   }
 
   vtkMap::AsyncState result = vtkMap::AsyncIdle; // return value
-  bool tilesTodo = this->Internals->ScheduledStackSize > 0;
+  bool tilesTodo = this->Internals->ScheduledCount > 0;
   if (newTiles.size() > 0)
   {
     //std::cout << "Added new tiles: " << newTiles.size() << std::endl;
@@ -344,21 +857,103 @@ void vtkMultiThreadedOsmLayer::AddTiles()
   std::vector<vtkMapTileSpecInternal> tileSpecs;
 
   this->SelectTiles(tiles, tileSpecs);
-  if (tileSpecs.size() > 0)
-  {
-    // Add newTileSpecs to scheduled tiles stack
-    //std::cout << "Scheduling tiles " << newTileSpecs.size() << std::endl;
-    this->Internals->ScheduledTilesLock->Lock();
-    this->Internals->ScheduledTiles.push(tileSpecs);
-    this->Internals->ScheduledStackSize =
-      this->Internals->ScheduledTiles.size();
+  TileSpecList prefetchSpecs;
+  this->SelectPrefetchTiles(this->PrefetchBudget, prefetchSpecs);
+
+  this->Internals->ScheduledTilesLock->Lock();
+  std::copy(this->VisibleTiles, this->VisibleTiles + 5,
+    this->Internals->VisibleTiles);
+  this->Internals->Host = vtkMapTileDownloader::GetHost(this->MapTileServer);
+  this->UpdateFocusPoints();
+
+  // Cancel predicted tiles not requested yet, the prediction is redone
+  // for the current view below
+  this->Internals->RemoveInFlight(this->Internals->PrefetchTiles);
+  this->Internals->PrefetchTiles.clear();
+
+  // Schedule new tiles, skipping tiles that are already being requested
+  TileSpecList& scheduledTiles = this->Internals->ScheduledTiles;
+  for (std::size_t i = 0; i < tileSpecs.size(); ++i)
+  {
+    const int* zxy = tileSpecs[i].ZoomXY;
+    vtkTypeUInt64 key = vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]);
+    if (!this->Internals->InFlightTiles.Contains(key))
+    {
+      this->Internals->InFlightTiles.Insert(key, 1);
+      scheduledTiles.push_back(tileSpecs[i]);
+    }
+  }
+
+  // Drop jobs and abort downloads of tiles that are neither in view nor
+  // predicted
+  vtkMapTileIndex<char> predicted;
+  for (std::size_t i = 0; i < prefetchSpecs.size(); ++i)
+  {
+    const int* zxy = prefetchSpecs[i].ZoomXY;
+    predicted.Insert(vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]), 1);
+  }
+  vtkMultiThreadedOsmLayerInternals* internals = this->Internals;
+  for (std::size_t i = 0; i < internals->LocalJobs.size(); ++i)
+  {
+    std::deque<vtkMultiThreadedOsmLayerInternals::Job>& jobs =
+      internals->LocalJobs[i];
+    for (std::size_t j = jobs.size(); j-- > 0;)
+    {
+      const int* zxy = jobs[j].Spec.ZoomXY;
+      vtkTypeUInt64 key = vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]);
+      if ((!jobs[j].Prefetch || !predicted.Contains(key)) &&
+        !internals->IsTileWanted(zxy[0], zxy[1], zxy[2]))
+      {
+        internals->InFlightTiles.Erase(key);
+        jobs.erase(jobs.begin() + j);
+      }
+    }
+  }
+  internals->ActiveDownloads.ForEach(
+    [internals, &predicted](
+      vtkTypeUInt64 key, vtkMapTileDownloader::CancelFlag* cancel) {
+      if (!predicted.Contains(key) &&
+        !internals->IsTileWanted(vtkMapTileKey::Zoom(key),
+          vtkMapTileKey::X(key), vtkMapTileKey::Y(key)))
+      {
+        *cancel = 1;
+      }
+    });
+
+  // Order all pending tiles for the current view
+  this->PrioritizeTileSpecs(scheduledTiles);
+  this->PrioritizeTileSpecs(this->Internals->DownloadTiles);
+  this->PrioritizeTileSpecs(this->Internals->RevalidateTiles);
+  this->Internals->UpdateScheduledCount();
+  if (!scheduledTiles.empty())
+  {
     this->Internals->ThreadingCondition->Broadcast();
-    this->Internals->ScheduledTilesLock->Unlock();
   }
-  else
+
+  // Queue predicted tiles, most likely last
+  for (std::size_t i = prefetchSpecs.size(); i-- > 0;)
   {
-    this->RenderTiles(tiles);
+    const int* zxy = prefetchSpecs[i].ZoomXY;
+    vtkTypeUInt64 key = vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]);
+    if (!this->Internals->InFlightTiles.Contains(key))
+    {
+      this->Internals->InFlightTiles.Insert(key, 1);
+      this->Internals->PrefetchTiles.push_back(prefetchSpecs[i]);
+    }
   }
+  if (!this->Internals->PrefetchTiles.empty())
+  {
+    this->Internals->ThreadingCondition->Broadcast();
+  }
+  this->Internals->ScheduledTilesLock->Unlock();
+
+  // Draw cached tiles of other zoom levels in place of the missing ones,
+  // until the request threads deliver them
+  if (!tileSpecs.empty())
+  {
+    this->AddFallbackTiles(tileSpecs, tiles);
+  }
+  this->RenderTiles(tiles);
 }
 
 //----------------------------------------------------------------------------
@@ -366,82 +961,101 @@ vtkSmartPointer<vtkMapTile> vtkMultiThreadedOsmLayer::CreateTile(
   vtkMapTileSpecInternal& spec, const std::string& localPath,
   const std::string& remoteUrl)
 {
-  vtkSmartPointer<vtkMapTile> tile = vtkSmartPointer<vtkMapTile>::New();
+  vtkSmartPointer<vtkMapTile> tile = this->TilePool->NewTile();
   tile->SetCorners(spec.Corners);
   tile->SetFileSystemPath(localPath);
   tile->SetImageSource(remoteUrl);
+  tile->SetImagePool(this->ImagePool);
 
-  // Don't call tile->Init() here; must do that in the foreground thread
+  // Don't call tile->Init() here; must do that in the foreground thread.
+  // The image is decoded by the request thread, once it is available
+  // (see RequestTile()).
   spec.Tile = tile;
   return tile;
 }
 
 //----------------------------------------------------------------------------
-void vtkMultiThreadedOsmLayer::AssignTileSpecsToThreads(TileSpecList& tileSpecs)
+void vtkMultiThreadedOsmLayer::UpdateFocusPoints()
 {
-  // Clear current thread tile spec lists
-  int numThreads = this->Internals->RequestThreader->GetNumberOfThreads();
-  for (int i = 0; i < numThreads; i++)
+  double(*focus)[2] = this->Internals->FocusPoints;
+  focus[0][0] = this->ViewCenter[0];
+  focus[0][1] = this->ViewCenter[1];
+  this->Internals->NumberOfFocusPoints = 1;
+
+  vtkRenderWindow* window = this->Renderer->GetRenderWindow();
+  vtkRenderWindowInteractor* interactor =
+    window ? window->GetInteractor() : nullptr;
+  if (!interactor)
+  {
+    return;
+  }
+  int* position = interactor->GetEventPosition();
+  if (!this->Renderer->IsInViewport(position[0], position[1]))
   {
-    this->Internals->ThreadTileSpecs[i].clear();
+    return;
   }
 
-  // Distribute inputs across threads
-  int index;
-  for (int i = 0; i < tileSpecs.size(); i++)
+  // Cursor position on the map plane
+  double displayPoint[3], worldPoint[4];
+  this->Renderer->SetWorldPoint(0.0, 0.0, 0.0, 1.0);
+  this->Renderer->WorldToDisplay();
+  this->Renderer->GetDisplayPoint(displayPoint);
+  this->Renderer->SetDisplayPoint(position[0], position[1], displayPoint[2]);
+  this->Renderer->DisplayToWorld();
+  this->Renderer->GetWorldPoint(worldPoint);
+  if (worldPoint[3] != 0.0)
   {
-    index = i % numThreads;
-    this->Internals->ThreadTileSpecs[index].push_back(tileSpecs[i]);
+    worldPoint[0] /= worldPoint[3];
+    worldPoint[1] /= worldPoint[3];
   }
+
+  double tileSize = 360.0 / (1 << this->Internals->VisibleTiles[0]);
+  focus[1][0] = (worldPoint[0] + 180.0) / tileSize;
+  focus[1][1] = (worldPoint[1] + 180.0) / tileSize;
+  this->Internals->NumberOfFocusPoints = 2;
 }
 
 //----------------------------------------------------------------------------
-void vtkMultiThreadedOsmLayer::AssignOneTileSpecPerThread(
-  TileSpecList& tileSpecs)
+static bool CompareTileSpecPriority(
+  const vtkMapTileSpecInternal& a, const vtkMapTileSpecInternal& b)
 {
-  // Move tileSpecs from end of tileSpecs to thread
-  int numThreads = this->Internals->RequestThreader->GetNumberOfThreads();
-  for (int i = 0; i < numThreads; i++)
-  {
-    this->Internals->ThreadTileSpecs[i].clear();
-    if (tileSpecs.size() > 0)
-    {
-      // vtkMapTileSpecInternal spec = tileSpecs.back();
-      // std::stringstream oss;
-      // oss << "Assign "
-      //     << spec.ZoomRowCol[0] << spec.ZoomRowCol[1] << spec.ZoomRowCol[2]
-      //     << std::endl;
-      // std::cout << oss.str();
-
-      this->Internals->ThreadTileSpecs[i].push_back(tileSpecs.back());
-      tileSpecs.pop_back();
-    }
-  }
+  return a.Priority > b.Priority;
 }
 
 //----------------------------------------------------------------------------
-// Checks thread results and updates lists
-void vtkMultiThreadedOsmLayer::CollateThreadResults(
-  TileSpecList& newTiles, TileSpecList& tileSpecs)
+void vtkMultiThreadedOsmLayer::PrioritizeTileSpecs(TileSpecList& specs)
 {
-  int numThreads = this->Internals->RequestThreader->GetNumberOfThreads();
-  for (int i = 0; i < numThreads; i++)
+  int zoom = this->Internals->VisibleTiles[0];
+  TileSpecList::iterator last = specs.begin();
+  for (TileSpecList::iterator iter = specs.begin(); iter != specs.end();
+       ++iter)
   {
-    TileSpecList::iterator specIter =
-      this->Internals->ThreadTileSpecs[i].begin();
-    for (; specIter != this->Internals->ThreadTileSpecs[i].end(); specIter++)
+    vtkMapTileSpecInternal& spec = *iter;
+    const int* zxy = spec.ZoomXY;
+    if (!this->Internals->IsTileWanted(zxy[0], zxy[1], zxy[2]))
     {
-      vtkMapTileSpecInternal& spec = *specIter;
-      if (spec.Tile)
-      {
-        newTiles.push_back(spec);
-      }
-      else
-      {
-        tileSpecs.push_back(spec);
-      }
+      this->Internals->InFlightTiles.Erase(
+        vtkMapTileKey::Make(zxy[0], zxy[1], zxy[2]));
+      continue;
     }
+
+    // Distance to nearest focus point, plus 2 per zoom level difference
+    double scale = std::ldexp(1.0, zoom - zxy[0]);
+    double x = (zxy[1] + 0.5) * scale;
+    double y = (zxy[2] + 0.5) * scale;
+    double distance = VTK_DOUBLE_MAX;
+    for (int i = 0; i < this->Internals->NumberOfFocusPoints; ++i)
+    {
+      double dx = x - this->Internals->FocusPoints[i][0];
+      double dy = y - this->Internals->FocusPoints[i][1];
+      distance = std::min(distance, sqrt(dx * dx + dy * dy));
+    }
+    spec.Priority = distance + 2.0 * std::abs(zxy[0] - zoom);
+    *last++ = spec;
   }
+  specs.erase(last, specs.end());
+
+  std::stable_sort(specs.begin(), specs.end(), CompareTileSpecPriority);
 }
 
 //----------------------------------------------------------------------------
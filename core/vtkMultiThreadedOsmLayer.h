@@ -17,14 +17,19 @@
 // A multithreaded subclass of vtkOsmLayer.
 // It performs concurrent map-tile requests in background threads,
 // in order to circumvent I/O blocking. On initialization, the class
-// starts a single background thread that supervises the overall logic
-// for both: (i) requesting files from the map tile server and
-// (ii) constructing new vtkMapTile instances. This supervisory thread
-// in turn executes a set of additional threads concurrently to perform
-// file I/O and http I/O actions. Because map tiles are generated
-// asynchronously, the class overrides the vtkLayer::ResolveAsync()
-// method; if new tiles have been created by the background threads,
-// they are added to the layer's map-tile cache in ResolveAsync().
+// starts a pool of request threads that run until the layer is deleted.
+// Each thread takes one tile at a time, either from the lists shared by
+// all threads, ordered by priority, or from its own list of jobs; idle
+// threads steal jobs from the other threads, so that a slow request
+// never holds back the others. A request first looks up the tile image
+// in the bundle, store or file cache, and otherwise requests the file
+// from the map tile server, before constructing the new vtkMapTile
+// instance. Tiles drawn from expired files of the cache are revalidated
+// with the server afterwards, and replaced if it returns a new image.
+// Because map tiles are generated asynchronously, the class overrides
+// the vtkLayer::ResolveAsync() method; if new tiles have been created by
+// the request threads, they are added to the layer's map-tile cache in
+// ResolveAsync().
 
 #ifndef __vtkMultiThreadedOsmLayer_h
 #define __vtkMultiThreadedOsmLayer_h
@@ -35,6 +40,7 @@
 #include <vector>
 
 class vtkMapTile;
+class vtkMapTileFileReader;
 
 typedef std::vector<vtkMapTileSpecInternal> TileSpecList;
 
@@ -49,12 +55,27 @@ public:
   void Update() override;
 
   // Description:
-  // Threaded method for managing tile requests, to prevent blocking.
-  void BackgroundThreadExecute();
+  // Threaded method for concurrent tile requests, run by each request
+  // thread until the layer is deleted.
+  void WorkerThreadExecute(int threadId);
 
   // Description:
-  // Threaded method for concurrent tile requests.
-  void RequestThreadExecute(int threadId);
+  // Number of request threads, which is also the maximum number of
+  // concurrent http requests. Within this maximum, the number of
+  // concurrent requests adapts to the server (see
+  // vtkMapTileDownloader::GetConcurrencyLimit()). Changing it restarts
+  // the threads once their current requests complete. Default is 6.
+  virtual void SetNumberOfRequestThreads(int number);
+  vtkGetMacro(NumberOfRequestThreads, int);
+
+  // Description:
+  // Maximum number of tiles predicted from the viewport motion and
+  // requested ahead of time, at lower priority than the visible tiles
+  // (see vtkOsmLayer::SelectPrefetchTiles()). Requests not yet started
+  // are dropped whenever the view changes. Default is 32, 0 disables
+  // prefetching.
+  vtkSetClampMacro(PrefetchBudget, int, 0, VTK_INT_MAX);
+  vtkGetMacro(PrefetchBudget, int);
 
   // Description:
   // Override vtkLayer::ResolveAsync()
@@ -75,23 +96,65 @@ protected:
     const std::string& localPath, const std::string& remoteUrl);
 
   // Description:
-  // Assign tile specs evenly across request threads
-  void AssignTileSpecsToThreads(TileSpecList& specs);
+  // Start and stop the request threads. Tiles not yet requested are
+  // kept when the threads stop, except predicted tiles.
+  void StartRequestThreads();
+  void StopRequestThreads();
+
+  // Description:
+  // Initializes the tile of a tile spec if its image is found locally or,
+  // if download is true, once its image file is downloaded. The tile is
+  // left null if not found, or if the download is cancelled. Returns true
+  // if the tile is drawn from an expired image file, to be revalidated.
+  // fileData and filePath, if given, are the content and path of the
+  // image file of the tile in the cache directory, found and read by
+  // ReadImageFiles(): the file is not looked up again, and its content
+  // is moved to the tile, which otherwise reads the file itself.
+  bool RequestTile(vtkMapTileSpecInternal& spec, bool download,
+    std::vector<unsigned char>* fileData = nullptr,
+    const std::string* filePath = nullptr);
+
+  // Description:
+  // Reads the image files in the cache directory of a batch of tiles at
+  // once, with reader (see vtkMapTileFileReader), into files, and sets
+  // paths to their paths. index is set, by tile key, to the position in
+  // files and paths of each tile, or past the end for tiles without a
+  // file (e.g. found in TileBundle or TileStore).
+  void ReadImageFiles(const TileSpecList& specs, vtkMapTileFileReader* reader,
+    std::vector<std::vector<unsigned char> >& files,
+    std::vector<std::string>& paths, vtkMapTileIndex<std::size_t>& index);
 
   // Description:
-  // Assign 1 tile spec to each thread
-  void AssignOneTileSpecPerThread(TileSpecList& specs);
+  // Revalidates the expired image file of a tile with a conditional
+  // request, and initializes the tile of the spec if the server returns
+  // a new image.
+  void RevalidateTile(vtkMapTileSpecInternal& spec);
 
   // Description:
-  // Separate tile specs from threads into two lists,
-  // depending on whether they have initialized tile or not.
-  // Does not clear lists, but appends data to them.
-  void CollateThreadResults(TileSpecList& newTiles, TileSpecList& tileSpecs);
+  // Performs a request for the tile of spec, which can be cancelled by
+  // AddTiles() once the tile leaves the view.
+  void PerformRequest(const vtkMapTileSpecInternal& spec,
+    vtkMapTileDownloader::Request& request);
 
   // Description:
   // Copies new tiles to shared list.
   void UpdateNewTiles(TileSpecList& newTiles);
 
+  // Description:
+  // Sets the points of the view around which tiles are requested first:
+  // the viewport center and the cursor, if it is over the viewport.
+  // Called with the scheduled tiles lock held, like PrioritizeTileSpecs().
+  void UpdateFocusPoints();
+
+  // Description:
+  // Sets the Priority of tile specs from their distance to the focus
+  // points and their zoom level, and sorts them, most urgent last.
+  // Specs of tiles outside the current view are removed.
+  void PrioritizeTileSpecs(TileSpecList& specs);
+
+  int NumberOfRequestThreads;
+  int PrefetchBudget;
+
   class vtkMultiThreadedOsmLayerInternals;
   vtkMultiThreadedOsmLayerInternals* Internals;
 
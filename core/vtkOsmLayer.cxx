@@ -16,23 +16,30 @@
 
 #include "tileNotAvailable_png.h"
 #include "vtkMapTile.h"
+#include "vtkMapTileKey.h"
 #include "vtkMercator.h"
 
+#include <vtkActor.h>
 #include <vtkObjectFactory.h>
 #include <vtkTextActor.h>
 #include <vtkTextProperty.h>
 #include <vtksys/SystemTools.hxx>
 
-#include <curl/curl.h>
-
 #include <algorithm>
 #include <cstdio>  // remove()
 #include <cstring> // strdup()
+#include <ctime>
 #include <iomanip>
 #include <iterator>
 #include <math.h>
 #include <sstream>
 
+// Number of lower zoom levels searched by AddFallbackTiles()
+#define MAX_FALLBACK_LEVELS 4
+
+// Highest zoom level of the tile servers (see vtkMap::SetVisibleBounds())
+#define MAX_ZOOM_LEVEL 19
+
 vtkStandardNewMacro(vtkOsmLayer)
 
   //----------------------------------------------------------------------------
@@ -45,7 +52,22 @@ vtkStandardNewMacro(vtkOsmLayer)
   this->MapTileAttribution = strdup("(c) OpenStreetMap contributors");
   this->TileNotAvailableImagePath = NULL;
   this->AttributionActor = NULL;
+  this->Downloader = vtkMapTileDownloader::New();
   this->CacheDirectory = NULL;
+  this->DiskCache = vtkMapTileDiskCache::New();
+  this->TileStore = NULL;
+  this->TileBundle = NULL;
+  this->TileCache = vtkMapTileCache::New();
+  this->ImagePool = vtkMapTileImagePool::New();
+  this->TilePool = vtkMapTilePool::New();
+  this->TileCache->SetTilePool(this->TilePool);
+  this->UseTileAtlas = false;
+  this->TileAtlas = vtkMapTileAtlas::New();
+  this->NumberOfAtlasActors = 0;
+  this->VisibleTiles[0] = -1;
+  this->ViewCenter[0] = this->ViewCenter[1] = 0.0;
+  this->PanVelocity[0] = this->PanVelocity[1] = 0.0;
+  this->ZoomDirection = 0;
 }
 
 //----------------------------------------------------------------------------
@@ -56,6 +78,14 @@ vtkOsmLayer::~vtkOsmLayer()
     this->AttributionActor->Delete();
   }
   this->RemoveTiles();
+  this->TileAtlas->Delete();
+  this->TileCache->Delete();
+  this->ImagePool->Delete();
+  this->TilePool->Delete();
+  this->DiskCache->Delete();
+  this->SetTileStore(NULL);
+  this->SetTileBundle(NULL);
+  this->Downloader->Delete();
   free(this->CacheDirectory);
   free(this->MapTileAttribution);
   free(this->MapTileExtension);
@@ -66,6 +96,14 @@ vtkOsmLayer::~vtkOsmLayer()
 void vtkOsmLayer::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "TileCache:\n";
+  this->TileCache->PrintSelf(os, indent.GetNextIndent());
+  os << indent << "ImagePool:\n";
+  this->ImagePool->PrintSelf(os, indent.GetNextIndent());
+  os << indent << "TilePool:\n";
+  this->TilePool->PrintSelf(os, indent.GetNextIndent());
+  os << indent << "DiskCache:\n";
+  this->DiskCache->PrintSelf(os, indent.GetNextIndent());
 }
 
 //----------------------------------------------------------------------------
@@ -100,17 +138,15 @@ void vtkOsmLayer::SetMapTileServer(
 
   // Clear tile cached and update internals
   // Remove tiles from renderer before calling RemoveTiles()
-  auto iter = this->CachedTiles.begin();
-  for (; iter != this->CachedTiles.end(); iter++)
-  {
-    this->RemoveActor(iter->GetPointer()->GetActor());
-  }
+  this->RemoveTileActors();
+  this->RemoveAtlasActors();
   this->RemoveTiles();
 
   this->MapTileExtension = strdup(extension);
   this->MapTileServer = strdup(server);
   this->MapTileAttribution = strdup(attribution);
   this->CacheDirectory = strdup(fullPath.c_str());
+  this->DiskCache->SetDirectory(fullPath);
 
   if (this->AttributionActor)
   {
@@ -196,15 +232,64 @@ void vtkOsmLayer::SetCacheSubDirectory(const char* relativePath)
     vtksys::SystemTools::MakeDirectory(fullPath.c_str());
   }
   this->CacheDirectory = strdup(fullPath.c_str());
+  this->DiskCache->SetDirectory(fullPath);
+}
+
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::SetTileBundleFile(const std::string& fileName)
+{
+  vtkSmartPointer<vtkMapTileBundle> bundle =
+    vtkSmartPointer<vtkMapTileBundle>::New();
+  if (!bundle->Open(fileName))
+  {
+    return false;
+  }
+  this->SetTileBundle(bundle);
+  return true;
 }
 
 //----------------------------------------------------------------------------
 void vtkOsmLayer::RemoveTiles()
 {
-  this->CachedTilesMap.clear();
+  this->FallbackTiles.Clear();
+  this->TileCache->Clear();
   this->CachedTiles.clear();
 }
 
+//----------------------------------------------------------------------------
+void vtkOsmLayer::RemoveAtlasActors()
+{
+  for (int i = 0; i < this->NumberOfAtlasActors; ++i)
+  {
+    this->RemoveActor(this->TileAtlas->GetActor(i));
+  }
+  this->NumberOfAtlasActors = 0;
+  this->TileAtlas->Clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkOsmLayer::RemoveTileActors()
+{
+  for (std::size_t i = 0; i < this->TileActors.size(); ++i)
+  {
+    this->RemoveActor(this->TileActors[i]);
+  }
+  this->TileActors.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkOsmLayer::PrepareTile(vtkMapTile* tile)
+{
+  if (this->UseTileAtlas)
+  {
+    tile->LoadImage();
+  }
+  else
+  {
+    tile->Init();
+  }
+}
+
 //----------------------------------------------------------------------------
 void vtkOsmLayer::AddTiles()
 {
@@ -225,60 +310,222 @@ void vtkOsmLayer::AddTiles()
 }
 
 //----------------------------------------------------------------------------
-bool vtkOsmLayer::DownloadImageFile(std::string url, std::string filename)
+bool vtkOsmLayer::FindTileImage(const vtkMapTileSpecInternal& tileSpec,
+  std::string& filename, std::vector<unsigned char>& data)
+{
+  const int* zrc = tileSpec.ZoomRowCol;
+  if (this->TileBundle &&
+    this->TileBundle->ReadTile(zrc[0], zrc[1], zrc[2], data))
+  {
+    return true;
+  }
+
+  if (this->TileStore)
+  {
+    return this->TileStore->ReadTile(zrc[0], zrc[1], zrc[2], data);
+  }
+
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+  if (this->DiskCache->ReadPendingFile(key, data))
+  {
+    return true;
+  }
+
+  // Answered from the index in memory, the file is not accessed
+  // until the tile image is loaded
+  return this->DiskCache->FindFile(key, filename);
+}
+
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::DownloadImageFile(const vtkMapTileSpecInternal& tileSpec,
+  vtkMapTileDownloader::Request& request, std::string filename)
 {
   //std::cout << "Downloading " << filename << std::endl;
-  CURL* curl;
-  FILE* fp;
-  CURLcode res;
-  char errorBuffer[CURL_ERROR_SIZE]; // for debug
-  long httpStatus = 0;               // for debug
-  curl = curl_easy_init();
-  if (!curl)
-  {
-    vtkErrorMacro(<< "curl_easy_init() failed");
+  this->Downloader->Download(request);
+  return this->SaveImageFile(tileSpec, request, filename);
+}
+
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::SaveImageFile(const vtkMapTileSpecInternal& tileSpec,
+  vtkMapTileDownloader::Request& request, const std::string& filename)
+{
+  // Failed downloads release the claim of the tile, see
+  // ClaimTileDownload(); saved ones release it once written
+  const int* zrc = tileSpec.ZoomRowCol;
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+  if (request.Cancelled)
+  {
+    this->DiskCache->ReleaseFile(key);
+    return false;
+  }
+  if (!request.Success)
+  {
+    // Transport errors are not remembered, the tile is requested again
+    this->DiskCache->ReleaseFile(key);
+    vtkErrorMacro(<< request.Error);
     return false;
   }
 
-  fp = fopen(filename.c_str(), "wb");
-  if (!fp)
+  // A tile that is missing (404, 410) or whose response is not a valid
+  // image is not provided by the server, and is not requested again until
+  // the retry delay of the disk cache has passed. Other error statuses,
+  // e.g. rate limiting (429) or server errors (5xx), are transient.
+  bool missing = request.HttpStatus == 404 || request.HttpStatus == 410;
+  if (request.HttpStatus >= 300 && !missing)
   {
-    vtkErrorMacro(<< "Cannot open file " << filename.c_str());
+    this->DiskCache->ReleaseFile(key);
+    vtkErrorMacro(<< "map tile request failed: " << request.Url
+                  << " (status " << request.HttpStatus << ")");
     return false;
   }
-#ifdef DISABLE_CURL_SIGNALS
-  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
-#endif
-  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errorBuffer);
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-  res = curl_easy_perform(curl);
-
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpStatus);
-  vtkDebugMacro("Download " << url.c_str() << " status: " << httpStatus);
-  curl_easy_cleanup(curl);
-  fclose(fp);
+  std::string ext = std::string(".") + this->MapTileExtension;
+  if (missing || !this->VerifyImageData(request.Data, ext))
+  {
+    this->DiskCache->AddFailure(key);
+    this->DiskCache->ReleaseFile(key);
+    if (missing)
+    {
+      vtkErrorMacro(<< "map tile not found: " << request.Url << " (status "
+                    << request.HttpStatus << ")");
+    }
+    else
+    {
+      vtkErrorMacro(<< "map tile contents not a valid image: "
+                    << request.Url);
+    }
+    return false;
+  }
+  this->DiskCache->RemoveFailure(key);
+
+  if (this->TileStore)
+  {
+    // Write errors are reported by the store, the image is still usable
+    this->TileStore->WriteTile(zrc[0], zrc[1], zrc[2], request.Data);
+    this->DiskCache->ReleaseFile(key);
+    return true;
+  }
+
+  // The tile is decoded from request.Data, so the image file
+  // is written in the background
+  vtkMapTileDiskCache::Metadata metadata;
+  metadata.ETag = request.ETag;
+  metadata.LastModified = request.LastModified;
+  metadata.Expires = request.Expires;
+  this->DiskCache->WriteFileAsync(key, filename, request.Data, metadata);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::ClaimTileDownload(const vtkMapTileSpecInternal& tileSpec,
+  int timeout, const vtkMapTileDownloader::CancelFlag* cancel)
+{
+  // Stores do their own locking
+  if (this->TileStore)
+  {
+    return true;
+  }
+
+  const int* zrc = tileSpec.ZoomRowCol;
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+  if (this->DiskCache->ClaimFile(key))
+  {
+    return true;
+  }
+  if (this->DiskCache->WaitForFile(key, timeout, cancel) ||
+    this->DiskCache->IsFailed(key))
+  {
+    return false;
+  }
+
+  // Released without the file, or abandoned
+  return this->DiskCache->ClaimFile(key);
+}
+
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::IsTileUnavailable(const vtkMapTileSpecInternal& tileSpec)
+{
+  const int* zrc = tileSpec.ZoomRowCol;
+  return this->DiskCache->IsFailed(vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]));
+}
 
-  // Confirm that the file is a valid image
-  if ((res == CURLE_OK) && (!this->VerifyImageFile(fp, filename)))
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::FindMovedTileImage(
+  const vtkMapTileSpecInternal& tileSpec, std::string& filename)
+{
+  if (this->TileStore)
   {
-    res = CURLE_READ_ERROR;
-    sprintf(errorBuffer, "map tile contents not a valid image");
+    return false;
   }
+  const int* zrc = tileSpec.ZoomRowCol;
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]);
+  std::string path;
+  if (this->DiskCache->ForgetFile(key, filename) ||
+    !this->DiskCache->FindFile(key, path) || path == filename)
+  {
+    return false;
+  }
+  filename = path;
+  return true;
+}
 
-  // If there was an error, remove invalid image file
-  if (res != CURLE_OK)
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::MakeRevalidationRequest(
+  const vtkMapTileSpecInternal& tileSpec,
+  vtkMapTileDownloader::Request& request)
+{
+  // Tiles of TileStore and TileBundle have no expiry
+  if (this->TileStore)
   {
-    //std::cerr << "Removing invalid file: " << filename << std::endl;
-    remove(filename.c_str());
-    vtkErrorMacro(<< errorBuffer);
     return false;
   }
 
+  const int* zrc = tileSpec.ZoomRowCol;
+  vtkMapTileDiskCache::Metadata metadata;
+  if (!this->DiskCache->GetMetadata(
+        vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]), metadata) ||
+    metadata.Expires > static_cast<vtkTypeInt64>(time(nullptr)))
+  {
+    return false;
+  }
+  request.ETag = metadata.ETag;
+  request.LastModified = metadata.LastModified;
   return true;
 }
 
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::SaveRevalidatedImage(const vtkMapTileSpecInternal& tileSpec,
+  vtkMapTileDownloader::Request& request, const std::string& filename)
+{
+  if (request.Cancelled)
+  {
+    return false;
+  }
+  if (request.Success && request.HttpStatus == 304)
+  {
+    // The cached file is current, extend its lifetime
+    const int* zrc = tileSpec.ZoomRowCol;
+    vtkMapTileDiskCache::Metadata metadata;
+    metadata.ETag = request.ETag;
+    metadata.LastModified = request.LastModified;
+    metadata.Expires = request.Expires > 0
+      ? request.Expires
+      : static_cast<vtkTypeInt64>(time(nullptr)) +
+        this->DiskCache->GetDefaultMaxAge();
+    this->DiskCache->SetMetadata(
+      vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]), metadata);
+    return false;
+  }
+  if (!request.Success || request.HttpStatus != 200)
+  {
+    // Keep the expired file, it is revalidated again on next use
+    vtkDebugMacro("Cannot revalidate " << request.Url << ": "
+                                       << request.HttpStatus << " "
+                                       << request.Error);
+    return false;
+  }
+  return this->SaveImageFile(tileSpec, request, filename);
+}
+
 //----------------------------------------------------------------------------
 bool vtkOsmLayer::VerifyImageFile(FILE* fp, std::string filename)
 {
@@ -346,6 +593,48 @@ bool vtkOsmLayer::VerifyImageFile(FILE* fp, std::string filename)
   return match;
 }
 
+//----------------------------------------------------------------------------
+bool vtkOsmLayer::VerifyImageData(
+  const std::vector<unsigned char>& data, const std::string& ext)
+{
+  if (ext == ".png")
+  {
+    unsigned char pngSignature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+      '\n' };
+    return data.size() >= 8 && std::equal(pngSignature, pngSignature + 8,
+                                  data.begin());
+  }
+  else if ((ext == ".jpg") || (ext == ".jpeg"))
+  {
+    std::size_t n = data.size();
+    return n >= 4 && data[0] == 0xff && data[1] == 0xd8 &&
+      data[n - 2] == 0xff && data[n - 1] == 0xd9;
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+// Sets corners and indices of a tile, given its ZoomXY indices
+static void InitializeTileSpec(
+  int zoom, int x, int y, vtkMapTileSpecInternal& tileSpec)
+{
+  int numTiles = 1 << zoom;
+  double degreesPerTile = 360.0 / numTiles;
+
+  tileSpec.Corners[0] = -180.0 + x * degreesPerTile;       // llx
+  tileSpec.Corners[1] = -180.0 + y * degreesPerTile;       // lly
+  tileSpec.Corners[2] = -180.0 + (x + 1) * degreesPerTile; // urx
+  tileSpec.Corners[3] = -180.0 + (y + 1) * degreesPerTile; // ury
+
+  tileSpec.ZoomRowCol[0] = zoom;
+  tileSpec.ZoomRowCol[1] = x;
+  tileSpec.ZoomRowCol[2] = numTiles - 1 - y;
+
+  tileSpec.ZoomXY[0] = zoom;
+  tileSpec.ZoomXY[1] = x;
+  tileSpec.ZoomXY[2] = y;
+}
+
 //----------------------------------------------------------------------------
 // Builds two lists based on current viewpoint:
 //  * Existing tiles to render
@@ -372,7 +661,8 @@ void vtkOsmLayer::SelectTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles,
     bottomLeft[2] /= bottomLeft[3];
   }
 
-  //std::cerr << "Before bottomLeft " << bottomLeft[0] << " " << bottomLeft[1] << std::endl;
+  //std::cerr << "Before bottomLeft " << bottomLeft[0] << " "
+  //          << bottomLeft[1] << std::endl;
 
   if (this->Map->GetPerspectiveProjection())
   {
@@ -424,8 +714,10 @@ void vtkOsmLayer::SelectTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles,
     tile2y = temp;
   }
 
-  //std::cerr << "Before bottomLeft " << bottomLeft[0] << " " << bottomLeft[1] << std::endl;
-  //std::cerr << "Before topRight " << topRight[0] << " " << topRight[1] << std::endl;
+  //std::cerr << "Before bottomLeft " << bottomLeft[0] << " "
+  //          << bottomLeft[1] << std::endl;
+  //std::cerr << "Before topRight " << topRight[0] << " " << topRight[1]
+  //          << std::endl;
 
   /// Clamp tilex and tiley
   tile1x = std::max(tile1x, 0);
@@ -467,24 +759,242 @@ void vtkOsmLayer::SelectTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles,
       else
       {
         vtkMapTileSpecInternal tileSpec;
+        InitializeTileSpec(zoomLevel, xIndex, yIndex, tileSpec);
+        tileSpecs.push_back(tileSpec);
+      }
+    }
+  }
 
-        tileSpec.Corners[0] = -180.0 + xIndex * lonPerTile;       // llx
-        tileSpec.Corners[1] = -180.0 + yIndex * latPerTile;       // lly
-        tileSpec.Corners[2] = -180.0 + (xIndex + 1) * lonPerTile; // urx
-        tileSpec.Corners[3] = -180.0 + (yIndex + 1) * latPerTile; // ury
+  // Record viewport and its motion, in tile units, for SelectPrefetchTiles()
+  double center[2];
+  center[0] = (0.5 * (bottomLeft[0] + topRight[0]) + 180.0) / lonPerTile;
+  center[1] = (0.5 * (bottomLeft[1] + topRight[1]) + 180.0) / latPerTile;
+  if (zoomLevel != this->VisibleTiles[0])
+  {
+    if (this->VisibleTiles[0] >= 0)
+    {
+      this->ZoomDirection = zoomLevel > this->VisibleTiles[0] ? 1 : -1;
+    }
+    this->PanVelocity[0] = this->PanVelocity[1] = 0.0;
+  }
+  else if (center[0] != this->ViewCenter[0] ||
+    center[1] != this->ViewCenter[1])
+  {
+    // Exponential smoothing of the motion between successive updates
+    for (int k = 0; k < 2; ++k)
+    {
+      this->PanVelocity[k] =
+        0.5 * this->PanVelocity[k] + 0.5 * (center[k] - this->ViewCenter[k]);
+    }
+  }
+  this->ViewCenter[0] = center[0];
+  this->ViewCenter[1] = center[1];
+  this->VisibleTiles[0] = zoomLevel;
+  this->VisibleTiles[1] = tile1x;
+  this->VisibleTiles[2] = tile2x;
+  this->VisibleTiles[3] = zoomLevelFactor - 1 - tile1y;
+  this->VisibleTiles[4] = zoomLevelFactor - 1 - tile2y;
+}
 
-        tileSpec.ZoomRowCol[0] = zoomLevel;
-        tileSpec.ZoomRowCol[1] = i;
-        tileSpec.ZoomRowCol[2] = zoomLevelFactor - 1 - yIndex;
+//----------------------------------------------------------------------------
+void vtkOsmLayer::AddFallbackTiles(
+  const std::vector<vtkMapTileSpecInternal>& tileSpecs,
+  std::vector<vtkSmartPointer<vtkMapTile> >& tiles)
+{
+  vtkMapTileIndex<vtkSmartPointer<vtkMapTile> > fallbackTiles;
+  for (std::size_t i = 0; i < tileSpecs.size(); ++i)
+  {
+    const vtkMapTileSpecInternal& spec = tileSpecs[i];
+    int zoom = spec.ZoomXY[0];
+    int x = spec.ZoomXY[1];
+    int y = spec.ZoomXY[2];
+
+    // Children, usually cached after zooming out. Tiles are probed
+    // without marking them as recently used, only the tiles drawn are.
+    vtkSmartPointer<vtkMapTile> children[4];
+    int numChildren = 0;
+    for (int k = 0; k < 4 && zoom < MAX_ZOOM_LEVEL; ++k)
+    {
+      children[k] = this->TileCache->FindTile(
+        zoom + 1, 2 * x + (k & 1), 2 * y + (k >> 1));
+      numChildren += children[k] ? 1 : 0;
+    }
+    if (numChildren == 4)
+    {
+      for (int k = 0; k < 4; ++k)
+      {
+        this->GetCachedTile(zoom + 1, 2 * x + (k & 1), 2 * y + (k >> 1));
+      }
+      tiles.insert(tiles.end(), children, children + 4);
+      continue;
+    }
 
-        tileSpec.ZoomXY[0] = zoomLevel;
-        tileSpec.ZoomXY[1] = xIndex;
-        tileSpec.ZoomXY[2] = yIndex;
+    // Part of the nearest ancestor, usually cached after zooming in
+    vtkTypeUInt64 key = vtkMapTileKey::Make(zoom, x, y);
+    vtkSmartPointer<vtkMapTile> fallback;
+    for (int level = 1; level <= MAX_FALLBACK_LEVELS && level <= zoom; ++level)
+    {
+      vtkMapTile* ancestor =
+        this->TileCache->FindTile(zoom - level, x >> level, y >> level);
+      if (!ancestor || !ancestor->GetImageData())
+      {
+        continue;
+      }
+      this->GetCachedTile(zoom - level, x >> level, y >> level);
 
-        tileSpecs.push_back(tileSpec);
+      vtkSmartPointer<vtkMapTile>* previous = this->FallbackTiles.Find(key);
+      if (previous &&
+        (*previous)->GetImageData() == ancestor->GetImageData())
+      {
+        fallback = *previous;
+        break;
+      }
+
+      // Range of the tile in the ancestor image
+      double size = 1.0 / (1 << level);
+      int mask = (1 << level) - 1;
+      double range[4] = { (x & mask) * size, ((x & mask) + 1) * size,
+        (y & mask) * size, ((y & mask) + 1) * size };
+
+      fallback = this->TilePool->NewTile();
+      fallback->SetLayer(this);
+      fallback->SetCorners(
+        spec.Corners[0], spec.Corners[1], spec.Corners[2], spec.Corners[3]);
+      fallback->SetTextureRange(range);
+      fallback->SetImageData(ancestor->GetImageData());
+      fallback->VisibilityOn();
+      this->PrepareTile(fallback);
+      break;
+    }
+    if (fallback)
+    {
+      fallbackTiles.Insert(key, fallback);
+      tiles.push_back(fallback);
+      continue;
+    }
+
+    // Partial coverage is better than none
+    for (int k = 0; k < 4; ++k)
+    {
+      if (children[k])
+      {
+        this->GetCachedTile(zoom + 1, 2 * x + (k & 1), 2 * y + (k >> 1));
+        tiles.push_back(children[k]);
       }
     }
   }
+
+  // Drop fallback tiles of tiles loaded since the last call
+  std::swap(this->FallbackTiles, fallbackTiles);
+}
+
+//----------------------------------------------------------------------------
+void vtkOsmLayer::SelectPrefetchTiles(
+  int budget, std::vector<vtkMapTileSpecInternal>& tileSpecs)
+{
+  if (budget <= 0 || this->VisibleTiles[0] < 0)
+  {
+    return;
+  }
+
+  int zoom = this->VisibleTiles[0];
+  int xMin = this->VisibleTiles[1];
+  int xMax = this->VisibleTiles[2];
+  int yMin = this->VisibleTiles[3];
+  int yMax = this->VisibleTiles[4];
+  int numTiles = 1 << zoom;
+
+  // Candidates are scored, lowest first
+  struct Candidate
+  {
+    double Score;
+    int Zoom, X, Y;
+    bool operator<(const Candidate& other) const
+    {
+      return this->Score < other.Score;
+    }
+  };
+  std::vector<Candidate> candidates;
+
+  // Ring of neighboring tiles, extended ahead of the pan motion
+  double speed = sqrt(this->PanVelocity[0] * this->PanVelocity[0] +
+    this->PanVelocity[1] * this->PanVelocity[1]);
+  int reach = speed > 0.0 ? 3 : 1;
+  double centerX = 0.5 * (xMin + xMax);
+  double centerY = 0.5 * (yMin + yMax);
+  for (int x = std::max(0, xMin - reach);
+       x <= std::min(numTiles - 1, xMax + reach); ++x)
+  {
+    for (int y = std::max(0, yMin - reach);
+         y <= std::min(numTiles - 1, yMax + reach); ++y)
+    {
+      int distance = std::max(std::max(xMin - x, x - xMax),
+        std::max(yMin - y, y - yMax));
+      if (distance <= 0)
+      {
+        continue; // visible
+      }
+
+      // Cosine of angle between motion and direction of tile
+      double dx = x - centerX;
+      double dy = y - centerY;
+      double length = sqrt(dx * dx + dy * dy);
+      double ahead = speed > 0.0
+        ? (dx * this->PanVelocity[0] + dy * this->PanVelocity[1]) /
+          (length * speed)
+        : 0.0;
+      if (distance > 1 && ahead < 0.5)
+      {
+        continue;
+      }
+      Candidate candidate = { distance - 1.5 * ahead, zoom, x, y };
+      candidates.push_back(candidate);
+    }
+  }
+
+  // Next zoom level in the direction of the last zoom change.
+  // Children of visible tiles are ordered by distance to view center.
+  if (this->ZoomDirection >= 0 && zoom < MAX_ZOOM_LEVEL)
+  {
+    double base = this->ZoomDirection > 0 ? 0.5 : 2.0;
+    double extent = std::max(xMax - xMin, yMax - yMin) + 1.0;
+    for (int x = 2 * xMin; x <= 2 * xMax + 1; ++x)
+    {
+      for (int y = 2 * yMin; y <= 2 * yMax + 1; ++y)
+      {
+        double dx = 0.5 * (x + 0.5) - (centerX + 0.5);
+        double dy = 0.5 * (y + 0.5) - (centerY + 0.5);
+        Candidate candidate = { base + sqrt(dx * dx + dy * dy) / extent,
+          zoom + 1, x, y };
+        candidates.push_back(candidate);
+      }
+    }
+  }
+  else if (this->ZoomDirection < 0 && zoom > 0)
+  {
+    for (int x = xMin / 2; x <= xMax / 2; ++x)
+    {
+      for (int y = yMin / 2; y <= yMax / 2; ++y)
+      {
+        Candidate candidate = { 0.5, zoom - 1, x, y };
+        candidates.push_back(candidate);
+      }
+    }
+  }
+
+  std::stable_sort(candidates.begin(), candidates.end());
+  for (std::size_t i = 0;
+       i < candidates.size() && static_cast<int>(tileSpecs.size()) < budget;
+       ++i)
+  {
+    const Candidate& c = candidates[i];
+    if (!this->GetCachedTile(c.Zoom, c.X, c.Y))
+    {
+      vtkMapTileSpecInternal tileSpec;
+      InitializeTileSpec(c.Zoom, c.X, c.Y, tileSpec);
+      tileSpecs.push_back(tileSpec);
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -498,9 +1008,19 @@ void vtkOsmLayer::InitializeTiles(
     tileSpecs.begin();
   std::string filename;
   std::string url;
+
+  // Tiles whose image file must be downloaded first, or revalidated
+  std::vector<vtkSmartPointer<vtkMapTile> > pendingTiles;
+  std::vector<vtkMapTileSpecInternal*> pendingSpecs;
+  std::vector<vtkMapTileDownloader::Request> requests;
+  std::vector<bool> revalidating;
+
+  // Tiles being downloaded by another process sharing the cache directory
+  std::vector<vtkMapTileSpecInternal> waitingSpecs;
+
   for (; tileSpecIter != tileSpecs.end(); tileSpecIter++)
   {
-    vtkMapTileSpecInternal spec = *tileSpecIter;
+    vtkMapTileSpecInternal& spec = *tileSpecIter;
 
     this->MakeFileSystemPath(spec, oss);
     filename = oss.str();
@@ -508,41 +1028,156 @@ void vtkOsmLayer::InitializeTiles(
     url = oss.str();
 
     // Instantiate tile
-    vtkSmartPointer<vtkMapTile> tile = vtkSmartPointer<vtkMapTile>::New();
+    vtkSmartPointer<vtkMapTile> tile = this->TilePool->NewTile();
     tile->SetLayer(this);
     tile->SetCorners(spec.Corners);
-    tile->SetFileSystemPath(filename);
     tile->SetImageSource(url);
+    tile->SetImagePool(this->ImagePool);
     tiles.push_back(tile);
 
     // Download image file if needed
-    if (!vtksys::SystemTools::FileExists(filename.c_str(), true))
+    std::vector<unsigned char> data;
+    bool found = this->FindTileImage(spec, filename, data);
+    if (!found && !this->IsTileUnavailable(spec) &&
+      !this->ClaimTileDownload(spec, 0))
+    {
+      // Downloaded by another process in the meantime, or still being
+      // downloaded. The render thread doesn't wait for it: other zoom
+      // levels are drawn instead until a later render.
+      found = this->FindTileImage(spec, filename, data);
+      if (!found && !this->IsTileUnavailable(spec))
+      {
+        tiles.pop_back();
+        waitingSpecs.push_back(spec);
+        continue;
+      }
+    }
+    tile->SetFileSystemPath(filename);
+    if (!found && this->IsTileUnavailable(spec))
+    {
+      // Failed recently, don't ask the server again
+      tile->SetFileSystemPath(this->TileNotAvailableImagePath);
+    }
+    else if (!found)
     {
       std::cout << "Downloading " << url << " to " << filename << std::endl;
-      if (this->DownloadImageFile(url, filename))
+      vtkMapTileDownloader::Request request;
+      request.Url = url;
+      requests.push_back(request);
+      pendingTiles.push_back(tile);
+      pendingSpecs.push_back(&spec);
+      revalidating.push_back(false);
+      continue;
+    }
+
+    // Expired image file, revalidated with the downloads. There is no
+    // background thread here to serve it first, see
+    // vtkMultiThreadedOsmLayer.
+    vtkMapTileDownloader::Request request;
+    if (data.empty() && this->MakeRevalidationRequest(spec, request))
+    {
+      request.Url = url;
+      requests.push_back(request);
+      pendingTiles.push_back(tile);
+      pendingSpecs.push_back(&spec);
+      revalidating.push_back(true);
+      continue;
+    }
+    if (!data.empty())
+    {
+      tile->SetImageBuffer(data);
+    }
+
+    // Initialize tile
+    tile->VisibilityOn();
+    this->PrepareTile(tile);
+    if (found && data.empty() && tile->GetImageFileMissing() &&
+      this->FindMovedTileImage(spec, filename))
+    {
+      // Moved to the current cache layout while it was read
+      tile->SetFileSystemPath(filename);
+      this->PrepareTile(tile);
+    }
+    if (found && data.empty() && tile->GetImageFileMissing())
+    {
+      // Indexed file removed from the cache directory, e.g. by another
+      // process: download the tile with the others, or on a later render
+      // if another process is downloading it
+      if (this->ClaimTileDownload(spec, 0))
       {
-        // Update tile cache
-        this->AddTileToCache(
-          spec.ZoomXY[0], spec.ZoomXY[1], spec.ZoomXY[2], tile);
+        vtkMapTileDownloader::Request download;
+        download.Url = url;
+        requests.push_back(download);
+        pendingTiles.push_back(tile);
+        pendingSpecs.push_back(&spec);
+        revalidating.push_back(false);
       }
       else
       {
-        tile->SetFileSystemPath(this->TileNotAvailableImagePath);
+        tiles.pop_back();
+        waitingSpecs.push_back(spec);
       }
+      continue;
     }
-    else
+
+    // This is potentially the case when the tile was downloaded in a previous
+    // execution of a program using vtkMap and vtkOsmLayer.
+    // Update tile cache (after loading, so that the tile size is known) :
+    this->AddTileToCache(spec.ZoomXY[0], spec.ZoomXY[1], spec.ZoomXY[2], tile);
+  } // for
+
+  if (!waitingSpecs.empty())
+  {
+    this->AddFallbackTiles(waitingSpecs, tiles);
+  }
+  if (requests.empty())
+  {
+    return;
+  }
+
+  // Perform all downloads concurrently, reusing connections
+  std::vector<vtkMapTileDownloader::Request*> requestPtrs;
+  for (std::size_t i = 0; i < requests.size(); ++i)
+  {
+    requestPtrs.push_back(&requests[i]);
+  }
+  this->Downloader->Download(requestPtrs);
+
+  for (std::size_t i = 0; i < requests.size(); ++i)
+  {
+    vtkMapTile* tile = pendingTiles[i];
+    vtkMapTileSpecInternal& spec = *pendingSpecs[i];
+
+    this->MakeFileSystemPath(spec, oss);
+    filename = oss.str();
+    bool saved = revalidating[i]
+      ? this->SaveRevalidatedImage(spec, requests[i], filename)
+      : this->SaveImageFile(spec, requests[i], filename);
+    if (saved)
     {
-      // This is potentially the case when the tile was downloaded in a previous
-      // execution of a program using vtkMap and vtkOsmLayer.
-      // Update tile cache :
-      this->AddTileToCache(
-        spec.ZoomXY[0], spec.ZoomXY[1], spec.ZoomXY[2], tile);
+      tile->SetImageBuffer(requests[i].Data);
+    }
+    else if (!revalidating[i])
+    {
+      tile->SetFileSystemPath(this->TileNotAvailableImagePath);
     }
 
     // Initialize tile
     tile->VisibilityOn();
-    tile->Init();
-  } // for
+    this->PrepareTile(tile);
+
+    if (saved || revalidating[i] || this->IsTileUnavailable(spec))
+    {
+      // Update tile cache
+      this->AddTileToCache(
+        spec.ZoomXY[0], spec.ZoomXY[1], spec.ZoomXY[2], tile);
+    }
+  }
+
+  if (this->TileStore)
+  {
+    this->TileStore->Flush();
+  }
 
   //tileSpecs.clear(); // it's not this method job to clear it :)
 }
@@ -553,25 +1188,70 @@ void vtkOsmLayer::RenderTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles)
 {
   if (tiles.size() > 0)
   {
-    // Remove old tiles
-    auto itr = this->CachedTiles.begin();
-    for (; itr != this->CachedTiles.end(); ++itr)
+    if (this->UseTileAtlas)
     {
-      this->RemoveActor(itr->GetPointer()->GetActor());
+      // Tiles drawn by the atlas have no actor
+      this->RemoveTileActors();
+
+      // Update the atlas pages in place, new pages need new actors
+      this->TileAtlas->SetTiles(tiles);
+      int numberOfActors = this->TileAtlas->GetNumberOfActors();
+      for (int i = this->NumberOfAtlasActors; i < numberOfActors; ++i)
+      {
+        this->AddActor(this->TileAtlas->GetActor(i));
+      }
+      this->NumberOfAtlasActors = numberOfActors;
+      CachedTiles = tiles;
     }
+    else
+    {
+      if (this->NumberOfAtlasActors > 0)
+      {
+        this->RemoveAtlasActors();
+      }
 
-    // clear the last rendered tiles cache
-    CachedTiles.clear();
+      // Tiles loaded while UseTileAtlas was on have no actor yet
+      std::vector<vtkSmartPointer<vtkActor> > actors;
+      actors.reserve(tiles.size());
+      for (std::size_t i = 0; i < tiles.size(); ++i)
+      {
+        tiles[i]->Init();
+        if (tiles[i]->GetActor())
+        {
+          actors.push_back(tiles[i]->GetActor());
+        }
+      }
+      std::sort(actors.begin(), actors.end());
+      actors.erase(std::unique(actors.begin(), actors.end()), actors.end());
 
-    // Add new tiles
-    for (std::size_t i = 0; i < tiles.size(); ++i)
-    {
-      this->AddActor(tiles[i]->GetActor());
+      // Only the tiles entering or leaving the view change the renderer,
+      // the others keep their actor
+      for (std::size_t i = 0; i < this->TileActors.size(); ++i)
+      {
+        if (!std::binary_search(
+              actors.begin(), actors.end(), this->TileActors[i]))
+        {
+          this->RemoveActor(this->TileActors[i]);
+        }
+      }
+      for (std::size_t i = 0; i < actors.size(); ++i)
+      {
+        if (!std::binary_search(
+              this->TileActors.begin(), this->TileActors.end(), actors[i]))
+        {
+          this->AddActor(actors[i]);
+        }
+      }
+      this->TileActors.swap(actors);
 
       // add tiles put on the scene in the proper cache
-      CachedTiles.push_back(tiles[i]);
+      CachedTiles = tiles;
     }
 
+    // Displayed tiles are protected, older tiles can now be released
+    this->TileCache->SetPinnedTiles(this->CachedTiles);
+    this->TileCache->Trim();
+
     //tiles.clear(); // it's not this method job to clear it :)
   }
 }
@@ -579,35 +1259,30 @@ void vtkOsmLayer::RenderTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles)
 //----------------------------------------------------------------------------
 void vtkOsmLayer::AddTileToCache(int zoom, int x, int y, vtkMapTile* tile)
 {
-  this->CachedTilesMap[zoom][x][y] = tile;
+  this->TileCache->AddTile(zoom, x, y, tile);
   // don't add tiles to CachedTiles here ! as in RenderTiles, CachedTiles will
   // contain old AND new tiles added via AddTileToCache in InitializeTiles,
-  // and will be used to remove the last tiles rendered before rendering the new ones.
+  // and will be used to remove the last tiles rendered before rendering the
+  // new ones.
   //this->CachedTiles.push_back(tile);
 }
 
 //----------------------------------------------------------------------------
 vtkSmartPointer<vtkMapTile> vtkOsmLayer::GetCachedTile(int zoom, int x, int y)
 {
-  if (this->CachedTilesMap.find(zoom) == this->CachedTilesMap.end() ||
-    this->CachedTilesMap[zoom].find(x) == this->CachedTilesMap[zoom].end() ||
-    this->CachedTilesMap[zoom][x].find(y) ==
-      this->CachedTilesMap[zoom][x].end())
-  {
-    return nullptr;
-  }
-
-  return this->CachedTilesMap[zoom][x][y];
+  return this->TileCache->GetTile(zoom, x, y);
 }
 
 //----------------------------------------------------------------------------
 void vtkOsmLayer::MakeFileSystemPath(
   vtkMapTileSpecInternal& tileSpec, std::stringstream& ss)
 {
+  // The layout of the cache directory is defined by DiskCache
+  const int* zrc = tileSpec.ZoomRowCol;
   ss.str("");
-  ss << this->GetCacheDirectory() << "/" << tileSpec.ZoomRowCol[0] << "-"
-     << tileSpec.ZoomRowCol[1] << "-" << tileSpec.ZoomRowCol[2] << "."
-     << this->MapTileExtension;
+  ss << this->GetCacheDirectory() << "/"
+     << this->DiskCache->MakeFileName(
+          vtkMapTileKey::Make(zrc[0], zrc[1], zrc[2]), this->MapTileExtension);
 }
 
 //----------------------------------------------------------------------------
@@ -20,17 +20,26 @@
 
 #include "vtkFeatureLayer.h"
 #include "vtkMapTile.h"
+#include "vtkMapTileAtlas.h"
+#include "vtkMapTileBundle.h"
+#include "vtkMapTileCache.h"
+#include "vtkMapTileDiskCache.h"
+#include "vtkMapTileDownloader.h"
+#include "vtkMapTileImagePool.h"
+#include "vtkMapTileIndex.h"
+#include "vtkMapTilePool.h"
 #include "vtkMapTileSpecInternal.h"
+#include "vtkMapTileStore.h"
 #include "vtkmapcore_export.h"
 
 // VTK Includes
 #include <vtkObject.h>
 #include <vtkRenderer.h>
 
-#include <map>
 #include <sstream>
 #include <vector>
 
+class vtkActor;
 class vtkTextActor;
 
 class VTKMAPCORE_EXPORT vtkOsmLayer : public vtkFeatureLayer
@@ -55,6 +64,58 @@ public:
     // Description:
     void Update() override;
 
+  // Description:
+  // In-memory cache of built tiles. Use it to configure the
+  // memory budget, e.g. GetTileCache()->SetMemoryLimit(bytes).
+  vtkGetObjectMacro(TileCache, vtkMapTileCache);
+
+  // Description:
+  // Decoded images and textures shared by the tiles with identical
+  // image content (e.g. open sea), see vtkMapTileImagePool.
+  vtkGetObjectMacro(ImagePool, vtkMapTileImagePool);
+
+  // Description:
+  // Tiles evicted from TileCache, reused for new tiles (see
+  // vtkMapTilePool). Use it to configure the number of recycled tiles,
+  // e.g. GetTilePool()->SetMaxSize(n).
+  vtkGetObjectMacro(TilePool, vtkMapTilePool);
+
+  // Description:
+  // Index of the map-tile files in CacheDirectory. Use it to configure
+  // the disk quota, e.g. GetDiskCache()->SetMaxSize(bytes).
+  vtkGetObjectMacro(DiskCache, vtkMapTileDiskCache);
+
+  // Description:
+  // Http engine of the layer. Use it to configure the concurrency of
+  // tile requests, e.g. GetDownloader()->SetHostConcurrencyCap(host, n).
+  vtkGetObjectMacro(Downloader, vtkMapTileDownloader);
+
+  // Description:
+  // Optional storage backend for tile images. When set, tiles are read
+  // from and written to the store instead of one image file per tile in
+  // CacheDirectory, and are decoded from memory.
+  vtkSetObjectMacro(TileStore, vtkMapTileStore);
+  vtkGetObjectMacro(TileStore, vtkMapTileStore);
+
+  // Description:
+  // Optional read-only bundle of pre-seeded tiles (see vtkMapTileBundle),
+  // looked up before TileStore or the cache directory.
+  vtkSetObjectMacro(TileBundle, vtkMapTileBundle);
+  vtkGetObjectMacro(TileBundle, vtkMapTileBundle);
+
+  // Description:
+  // Convenience method to open a bundle file and set it as TileBundle.
+  // Returns false if the file cannot be opened.
+  bool SetTileBundleFile(const std::string& fileName);
+
+  // Description:
+  // Draw the visible tiles with a few texture-atlas actors (see
+  // vtkMapTileAtlas) instead of one actor per tile, which reduces the
+  // number of draw calls and texture binds. Off by default.
+  vtkSetMacro(UseTileAtlas, bool);
+  vtkGetMacro(UseTileAtlas, bool);
+  vtkBooleanMacro(UseTileAtlas, bool);
+
   // Description:
   // Set the subdirectory used for caching map files.
   // This method is intended for *testing* use only.
@@ -68,9 +129,64 @@ protected:
   vtkSetStringMacro(CacheDirectory)
 
     virtual void AddTiles();
-  bool DownloadImageFile(std::string url, std::string filename);
+  // Performs request (with its Url set) and saves the result,
+  // request.Data holds the image afterwards
+  bool DownloadImageFile(const vtkMapTileSpecInternal& tileSpec,
+    vtkMapTileDownloader::Request& request, std::string filename);
+  // Verifies a completed request in memory and queues it for writing to
+  // the image cache (or TileStore). Returns false if the request failed
+  // or did not return a valid image.
+  bool SaveImageFile(const vtkMapTileSpecInternal& tileSpec,
+    vtkMapTileDownloader::Request& request, const std::string& filename);
+  // Claims the download of a tile among the processes sharing the cache
+  // directory (see vtkMapTileDiskCache::ClaimFile()). If another process
+  // is downloading the tile, waits for it for at most timeout seconds
+  // (not at all if 0) or until *cancel is set, and returns false if the
+  // tile was cached, failed or is still being downloaded, so that it is
+  // not downloaded twice.
+  bool ClaimTileDownload(const vtkMapTileSpecInternal& tileSpec, int timeout,
+    const vtkMapTileDownloader::CancelFlag* cancel = nullptr);
+  // Returns true if the server failed to provide the tile recently (see
+  // vtkMapTileDiskCache::AddFailure()), it is then not requested again.
+  bool IsTileUnavailable(const vtkMapTileSpecInternal& tileSpec);
+  // Handles a tile whose cached image file could not be read (see
+  // vtkMapTile::GetImageFileMissing()). If the file was moved to the
+  // current cache layout in the meantime (see
+  // vtkMapTileDiskCache::MigrateFiles()), sets filename to its new path
+  // and returns true. Otherwise forgets the cache entry, so that the
+  // tile is requested again, and returns false.
+  bool FindMovedTileImage(
+    const vtkMapTileSpecInternal& tileSpec, std::string& filename);
+  // Sets the validators of a conditional request for a tile whose image
+  // file in CacheDirectory has expired. Returns false if the file is
+  // current or not in the index.
+  bool MakeRevalidationRequest(const vtkMapTileSpecInternal& tileSpec,
+    vtkMapTileDownloader::Request& request);
+  // Completes a conditional request: on a 304 response the expiry time of
+  // the image file is extended, on a 200 response the new image is saved
+  // like SaveImageFile(). Returns true if request.Data holds a new image.
+  bool SaveRevalidatedImage(const vtkMapTileSpecInternal& tileSpec,
+    vtkMapTileDownloader::Request& request, const std::string& filename);
   bool VerifyImageFile(FILE* fp, std::string filename);
+  // Same check as VerifyImageFile() for an image held in memory,
+  // ext is the expected file extension (".png", ".jpg")
+  bool VerifyImageData(
+    const std::vector<unsigned char>& data, const std::string& ext);
   void RemoveTiles();
+  void RemoveAtlasActors();
+  void RemoveTileActors();
+
+  // Loads the tile image, and builds the tile actor unless UseTileAtlas
+  // is on. Must be called from the main thread.
+  void PrepareTile(vtkMapTile* tile);
+
+  // Looks for the image of a tile in TileBundle, TileStore or the image
+  // cache, returns false if it must be downloaded. Images found in
+  // memory are copied to data, which is left empty for image files;
+  // filename is then set to the path of the file in the cache index.
+  // No file system access is made.
+  bool FindTileImage(const vtkMapTileSpecInternal& tileSpec,
+    std::string& filename, std::vector<unsigned char>& data);
 
   // Next 3 methods used to add tiles to layer
   void SelectTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles,
@@ -79,6 +195,21 @@ protected:
     std::vector<vtkMapTileSpecInternal>& tileSpecs);
   void RenderTiles(std::vector<vtkSmartPointer<vtkMapTile> >& tiles);
 
+  // Appends cached tiles of other zoom levels covering the tiles of
+  // tileSpecs, to be drawn until these are loaded: the 4 children of a
+  // tile if all are cached, else the part of its nearest cached ancestor
+  // (see vtkMapTile::SetTextureRange()), else the cached children.
+  void AddFallbackTiles(const std::vector<vtkMapTileSpecInternal>& tileSpecs,
+    std::vector<vtkSmartPointer<vtkMapTile> >& tiles);
+
+  // Predicts tiles likely to be displayed next, from the motion of the
+  // viewport recorded by SelectTiles(): the ring of tiles around the
+  // viewport, farther ahead in the pan direction, and the next zoom level
+  // in the direction of the last zoom change. Appends at most budget
+  // specs of tiles not in TileCache, most likely first.
+  void SelectPrefetchTiles(
+    int budget, std::vector<vtkMapTileSpecInternal>& tileSpecs);
+
   void AddTileToCache(int zoom, int x, int y, vtkMapTile* tile);
   vtkSmartPointer<vtkMapTile> GetCachedTile(int zoom, int x, int y);
 
@@ -95,12 +226,41 @@ protected:
   char* TileNotAvailableImagePath;
   vtkTextActor* AttributionActor;
 
+  // Shared by all tile requests, keeps connections alive between them
+  vtkMapTileDownloader* Downloader;
+
   char* CacheDirectory;
-  // CachedTilesMap contains already built tiles
-  std::map<int, std::map<int, std::map<int, vtkSmartPointer<vtkMapTile> > > >
-    CachedTilesMap;
+  // DiskCache indexes the image files in CacheDirectory
+  vtkMapTileDiskCache* DiskCache;
+  // TileBundle, if set, is checked first for every tile
+  vtkMapTileBundle* TileBundle;
+  // TileStore, if set, replaces the image files in CacheDirectory
+  vtkMapTileStore* TileStore;
+  // TileCache contains already built tiles
+  vtkMapTileCache* TileCache;
+  // ImagePool shares the images of the tiles, by content
+  vtkMapTileImagePool* ImagePool;
+  // TilePool recycles the tiles evicted from TileCache
+  vtkMapTilePool* TilePool;
   // CachedTiles is intended to retrieve tiles put on the scene
   std::vector<vtkSmartPointer<vtkMapTile> > CachedTiles;
+  // Actors of CachedTiles in the renderer when UseTileAtlas is off,
+  // sorted, so that RenderTiles() only adds and removes the changes
+  std::vector<vtkSmartPointer<vtkActor> > TileActors;
+  // Tiles drawing part of an ancestor, by ZoomXY key of the tile they
+  // replace, reused by AddFallbackTiles() while the tile is missing
+  vtkMapTileIndex<vtkSmartPointer<vtkMapTile> > FallbackTiles;
+  // TileAtlas draws CachedTiles when UseTileAtlas is on
+  bool UseTileAtlas;
+  vtkMapTileAtlas* TileAtlas;
+  int NumberOfAtlasActors; // atlas actors added to the renderer
+
+  // Viewport recorded by SelectTiles(), in ZoomXY indices:
+  // zoom, x min, x max, y min, y max (zoom is -1 before the first call)
+  int VisibleTiles[5];
+  double ViewCenter[2];  // in tile units
+  double PanVelocity[2]; // smoothed motion of ViewCenter between updates
+  int ZoomDirection;     // sign of the last zoom change
 
 private:
   vtkOsmLayer(const vtkOsmLayer&);            // Not implemented
@@ -0,0 +1,390 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMBTilesTileStore.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMBTilesTileStore.h"
+#include "vtkMapTileIndex.h"
+#include "vtkMapTileKey.h"
+
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtksys/SystemTools.hxx>
+
+#include <sqlite3.h>
+
+vtkStandardNewMacro(vtkMBTilesTileStore);
+
+//----------------------------------------------------------------------------
+class vtkMBTilesTileStore::vtkInternals
+{
+public:
+  sqlite3* Db;
+  sqlite3_stmt* SelectStatement;
+  sqlite3_stmt* ExistsStatement;
+  sqlite3_stmt* InsertStatement;
+  std::string FileName;
+
+  // Writes not yet committed, keyed by (zoom, x, TMS row)
+  vtkMapTileIndex<std::vector<unsigned char> > Pending;
+
+  // Serializes use of the connection and the prepared statements
+  vtkSimpleMutexLock Lock;
+
+  vtkInternals()
+    : Db(nullptr)
+    , SelectStatement(nullptr)
+    , ExistsStatement(nullptr)
+    , InsertStatement(nullptr)
+  {
+  }
+
+  bool Exec(const char* sql)
+  {
+    return sqlite3_exec(this->Db, sql, nullptr, nullptr, nullptr) == SQLITE_OK;
+  }
+
+  sqlite3_stmt* Prepare(const char* sql)
+  {
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(this->Db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+      return nullptr;
+    }
+    return stmt;
+  }
+
+  void BindTile(sqlite3_stmt* stmt, int zoom, int x, int row)
+  {
+    sqlite3_bind_int(stmt, 1, zoom);
+    sqlite3_bind_int(stmt, 2, x);
+    sqlite3_bind_int(stmt, 3, row);
+  }
+
+  // Commits pending writes in one transaction.
+  // Returns error message, empty on success.
+  std::string Commit()
+  {
+    if (this->Pending.Empty())
+    {
+      return std::string();
+    }
+
+    std::string error;
+    if (!this->Exec("BEGIN IMMEDIATE"))
+    {
+      error = sqlite3_errmsg(this->Db);
+      this->Pending.Clear();
+      return error;
+    }
+
+    sqlite3_stmt* stmt = this->InsertStatement;
+    this->Pending.ForEach(
+      [&](vtkTypeUInt64 key, const std::vector<unsigned char>& data) {
+        if (!error.empty())
+        {
+          return;
+        }
+        this->BindTile(stmt, vtkMapTileKey::Zoom(key), vtkMapTileKey::X(key),
+          vtkMapTileKey::Y(key));
+        sqlite3_bind_blob(stmt, 4, data.data(), static_cast<int>(data.size()),
+          SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+        {
+          error = sqlite3_errmsg(this->Db);
+        }
+        sqlite3_reset(stmt);
+      });
+    sqlite3_clear_bindings(stmt);
+    this->Pending.Clear();
+
+    if (!error.empty())
+    {
+      this->Exec("ROLLBACK");
+      return error;
+    }
+    if (!this->Exec("COMMIT"))
+    {
+      error = sqlite3_errmsg(this->Db);
+      this->Exec("ROLLBACK");
+    }
+    return error;
+  }
+
+  void Finalize()
+  {
+    sqlite3_finalize(this->SelectStatement);
+    sqlite3_finalize(this->ExistsStatement);
+    sqlite3_finalize(this->InsertStatement);
+    this->SelectStatement = nullptr;
+    this->ExistsStatement = nullptr;
+    this->InsertStatement = nullptr;
+    sqlite3_close(this->Db);
+    this->Db = nullptr;
+    this->FileName.clear();
+  }
+};
+
+//----------------------------------------------------------------------------
+// MBTiles numbers rows from the bottom (TMS scheme)
+static int TmsRow(int zoom, int y)
+{
+  return (1 << zoom) - 1 - y;
+}
+
+//----------------------------------------------------------------------------
+vtkMBTilesTileStore::vtkMBTilesTileStore()
+{
+  this->BatchSize = 64;
+  this->Format = nullptr;
+  this->SetFormat("png");
+  this->Internals = new vtkInternals;
+}
+
+//----------------------------------------------------------------------------
+vtkMBTilesTileStore::~vtkMBTilesTileStore()
+{
+  this->Close();
+  this->SetFormat(nullptr);
+  delete this->Internals;
+}
+
+//----------------------------------------------------------------------------
+void vtkMBTilesTileStore::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << this->Internals->FileName << "\n"
+     << indent << "Format: " << (this->Format ? this->Format : "(null)")
+     << "\n"
+     << indent << "BatchSize: " << this->BatchSize << std::endl;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMBTilesTileStore::Open(const std::string& fileName)
+{
+  this->Close();
+
+  vtkInternals* internals = this->Internals;
+  internals->Lock.Lock();
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+  if (sqlite3_open_v2(fileName.c_str(), &internals->Db, flags, nullptr) !=
+    SQLITE_OK)
+  {
+    vtkErrorMacro("Cannot open " << fileName << ": "
+                                 << sqlite3_errmsg(internals->Db));
+    internals->Finalize();
+    internals->Lock.Unlock();
+    return false;
+  }
+  sqlite3_busy_timeout(internals->Db, 5000);
+
+  // Readers don't block the writer (and vice versa) in WAL mode
+  internals->Exec("PRAGMA journal_mode=WAL");
+  internals->Exec("PRAGMA synchronous=NORMAL");
+
+  bool ok = internals->Exec("CREATE TABLE IF NOT EXISTS metadata "
+                            "(name TEXT, value TEXT)") &&
+    internals->Exec("CREATE TABLE IF NOT EXISTS tiles "
+                    "(zoom_level INTEGER, tile_column INTEGER, "
+                    "tile_row INTEGER, tile_data BLOB)");
+  if (!ok)
+  {
+    vtkErrorMacro("Cannot initialize MBTiles schema in "
+      << fileName << ": " << sqlite3_errmsg(internals->Db));
+    internals->Finalize();
+    internals->Lock.Unlock();
+    return false;
+  }
+
+  // Fails harmlessly if "tiles" is a view (deduplicated MBTiles file),
+  // in which case the store is read-only.
+  internals->Exec("CREATE UNIQUE INDEX IF NOT EXISTS tile_index "
+                  "ON tiles (zoom_level, tile_column, tile_row)");
+
+  // Required metadata for new files
+  std::string name = vtksys::SystemTools::GetFilenameWithoutLastExtension(
+    fileName);
+  const char* metadata[][2] = { { "name", name.c_str() },
+    { "format", this->Format ? this->Format : "png" },
+    { "type", "baselayer" } };
+  sqlite3_stmt* stmt =
+    internals->Prepare("INSERT INTO metadata SELECT ?1, ?2 WHERE NOT EXISTS "
+                       "(SELECT 1 FROM metadata WHERE name = ?1)");
+  for (int i = 0; stmt && i < 3; ++i)
+  {
+    sqlite3_bind_text(stmt, 1, metadata[i][0], -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, metadata[i][1], -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  internals->SelectStatement =
+    internals->Prepare("SELECT tile_data FROM tiles WHERE zoom_level = ? "
+                       "AND tile_column = ? AND tile_row = ?");
+  internals->ExistsStatement =
+    internals->Prepare("SELECT 1 FROM tiles WHERE zoom_level = ? "
+                       "AND tile_column = ? AND tile_row = ?");
+  internals->InsertStatement = internals->Prepare(
+    "INSERT OR REPLACE INTO tiles "
+    "(zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)");
+  if (!internals->SelectStatement || !internals->ExistsStatement)
+  {
+    vtkErrorMacro("Cannot read tiles from " << fileName << ": "
+                                            << sqlite3_errmsg(internals->Db));
+    internals->Finalize();
+    internals->Lock.Unlock();
+    return false;
+  }
+  if (!internals->InsertStatement)
+  {
+    vtkWarningMacro(<< fileName << " is read-only: "
+                    << sqlite3_errmsg(internals->Db));
+  }
+
+  internals->FileName = fileName;
+  internals->Lock.Unlock();
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkMBTilesTileStore::Close()
+{
+  vtkInternals* internals = this->Internals;
+  internals->Lock.Lock();
+  if (internals->Db)
+  {
+    std::string error = internals->Commit();
+    if (!error.empty())
+    {
+      vtkErrorMacro("Failed writing tiles: " << error);
+    }
+    internals->Finalize();
+  }
+  internals->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMBTilesTileStore::IsOpen()
+{
+  this->Internals->Lock.Lock();
+  bool result = this->Internals->Db != nullptr;
+  this->Internals->Lock.Unlock();
+  return result;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMBTilesTileStore::HasTile(int zoom, int x, int y)
+{
+  vtkInternals* internals = this->Internals;
+  int row = TmsRow(zoom, y);
+  internals->Lock.Lock();
+  bool result = false;
+  if (internals->Db)
+  {
+    result = internals->Pending.Contains(vtkMapTileKey::Make(zoom, x, row));
+    if (!result)
+    {
+      sqlite3_stmt* stmt = internals->ExistsStatement;
+      internals->BindTile(stmt, zoom, x, row);
+      result = sqlite3_step(stmt) == SQLITE_ROW;
+      sqlite3_reset(stmt);
+    }
+  }
+  internals->Lock.Unlock();
+  return result;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMBTilesTileStore::ReadTile(
+  int zoom, int x, int y, std::vector<unsigned char>& data)
+{
+  vtkInternals* internals = this->Internals;
+  int row = TmsRow(zoom, y);
+  internals->Lock.Lock();
+  bool result = false;
+  if (internals->Db)
+  {
+    std::vector<unsigned char>* pending =
+      internals->Pending.Find(vtkMapTileKey::Make(zoom, x, row));
+    if (pending)
+    {
+      data = *pending;
+      result = true;
+    }
+    else
+    {
+      sqlite3_stmt* stmt = internals->SelectStatement;
+      internals->BindTile(stmt, zoom, x, row);
+      if (sqlite3_step(stmt) == SQLITE_ROW)
+      {
+        const unsigned char* blob =
+          static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
+        int size = sqlite3_column_bytes(stmt, 0);
+        data.assign(blob, blob + size);
+        result = size > 0;
+      }
+      sqlite3_reset(stmt);
+    }
+  }
+  internals->Lock.Unlock();
+  return result;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMBTilesTileStore::WriteTile(
+  int zoom, int x, int y, const std::vector<unsigned char>& data)
+{
+  vtkInternals* internals = this->Internals;
+  internals->Lock.Lock();
+  if (!internals->Db || !internals->InsertStatement)
+  {
+    internals->Lock.Unlock();
+    return false;
+  }
+
+  vtkTypeUInt64 key = vtkMapTileKey::Make(zoom, x, TmsRow(zoom, y));
+  internals->Pending.Insert(key, data);
+  std::string error;
+  if (internals->Pending.Size() >= static_cast<std::size_t>(this->BatchSize))
+  {
+    error = internals->Commit();
+  }
+  internals->Lock.Unlock();
+
+  if (!error.empty())
+  {
+    vtkErrorMacro("Failed writing tiles: " << error);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkMBTilesTileStore::Flush()
+{
+  vtkInternals* internals = this->Internals;
+  internals->Lock.Lock();
+  std::string error;
+  if (internals->Db)
+  {
+    error = internals->Commit();
+  }
+  internals->Lock.Unlock();
+
+  if (!error.empty())
+  {
+    vtkErrorMacro("Failed writing tiles: " << error);
+  }
+}
@@ -0,0 +1,93 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    vtkMBTilesTileStore.h
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME vtkMBTilesTileStore - map-tile store in an MBTiles (SQLite) file
+// .SECTION Description
+// Stores map-tile images as blobs in a single SQLite database that
+// follows the MBTiles 1.3 layout (tables "metadata" and "tiles"), so the
+// file can be read by other MBTiles tools and copied as a unit to
+// machines without network access. As required by MBTiles, rows are
+// numbered bottom-up (TMS scheme); the conversion from the OSM row
+// index is done internally.
+//
+// The database is opened in write-ahead-log mode and all statements
+// are prepared once. Writes are queued in memory and committed in a
+// single transaction every BatchSize tiles, on whichever thread fills
+// the batch, or when Flush() or Close() is called.
+//
+// Typical use:
+//   vtkNew<vtkMBTilesTileStore> store;
+//   store->Open("/path/to/tiles.mbtiles");
+//   osmLayer->SetTileStore(store.GetPointer());
+
+#ifndef __vtkMBTilesTileStore_h
+#define __vtkMBTilesTileStore_h
+
+#include "vtkMapTileStore.h"
+#include "vtkmapmbtiles_export.h"
+
+#include <string>
+
+class VTKMAPMBTILES_EXPORT vtkMBTilesTileStore : public vtkMapTileStore
+{
+public:
+  static vtkMBTilesTileStore* New();
+  void PrintSelf(ostream& os, vtkIndent indent) override;
+  vtkTypeMacro(vtkMBTilesTileStore, vtkMapTileStore);
+
+  // Description:
+  // Number of queued writes that triggers a commit. Default is 64.
+  vtkSetMacro(BatchSize, int);
+  vtkGetMacro(BatchSize, int);
+
+  // Description:
+  // Image format recorded in the metadata table when a new file is
+  // created, "png" (default) or "jpg".
+  vtkSetStringMacro(Format);
+  vtkGetStringMacro(Format);
+
+  // Description:
+  // Open (creating if needed) an MBTiles file.
+  // Returns false and reports an error if the file cannot be used.
+  bool Open(const std::string& fileName);
+
+  // Description:
+  // Commit pending writes and close the file
+  void Close();
+
+  bool IsOpen();
+
+  bool HasTile(int zoom, int x, int y) override;
+  bool ReadTile(
+    int zoom, int x, int y, std::vector<unsigned char>& data) override;
+  bool WriteTile(
+    int zoom, int x, int y, const std::vector<unsigned char>& data) override;
+  void Flush() override;
+
+protected:
+  vtkMBTilesTileStore();
+  ~vtkMBTilesTileStore() override;
+
+  int BatchSize;
+  char* Format;
+
+  class vtkInternals;
+  vtkInternals* Internals;
+
+private:
+  vtkMBTilesTileStore(const vtkMBTilesTileStore&);            // Not implemented
+  vtkMBTilesTileStore& operator=(const vtkMBTilesTileStore&); // Not implemented
+};
+
+#endif // __vtkMBTilesTileStore_h
@@ -0,0 +1,153 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMBTilesTileStore.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMBTilesTileStore.h"
+#include "vtkMap.h"
+#include "vtkMultiThreadedOsmLayer.h"
+
+#include <vtkInteractorStyle.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkRenderWindow.h>
+#include <vtkRenderWindowInteractor.h>
+#include <vtkRenderer.h>
+
+#include <sqlite3.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Checks that tiles written to the store can be read back,
+// including the ones still queued for the next commit.
+bool TestReadWrite(vtkMBTilesTileStore* store)
+{
+  std::vector<unsigned char> data(16, 0x5a);
+  std::vector<unsigned char> result;
+
+  store->SetBatchSize(2);
+  store->WriteTile(3, 1, 2, data); // queued
+  if (!store->HasTile(3, 1, 2) || !store->ReadTile(3, 1, 2, result) ||
+    result != data)
+  {
+    std::cerr << "Queued tile not found" << std::endl;
+    return false;
+  }
+
+  data[0] = 0xa5;
+  store->WriteTile(3, 1, 2, data);
+  store->WriteTile(3, 2, 1, data); // commits
+  if (!store->ReadTile(3, 1, 2, result) || result != data)
+  {
+    std::cerr << "Committed tile not found" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that rows are stored flipped, as MBTiles uses TMS rows:
+// OSM row 2 at zoom 3 is stored as row 2^3 - 1 - 2 = 5.
+bool TestTmsRow(const std::string& fileName)
+{
+  sqlite3* db = nullptr;
+  sqlite3_stmt* stmt = nullptr;
+  int row = -1;
+  if (sqlite3_open_v2(fileName.c_str(), &db, SQLITE_OPEN_READONLY,
+        nullptr) == SQLITE_OK &&
+    sqlite3_prepare_v2(db,
+      "SELECT tile_row FROM tiles WHERE zoom_level = 3 AND tile_column = 1",
+      -1, &stmt, nullptr) == SQLITE_OK &&
+    sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    row = sqlite3_column_int(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  if (row != 5)
+  {
+    std::cerr << "Stored tile_row is " << row << ", expected 5" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestMBTilesTileStore(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cout << "\n"
+              << "Display map using an MBTiles file as tile cache."
+              << "\n"
+              << "Usage: TestMBTilesTileStore file.mbtiles"
+              << "\n"
+              << std::endl;
+    return -1;
+  }
+
+  // Use a separate file for the read/write checks
+  std::string checkFile = std::string(argv[1]) + ".test";
+  remove(checkFile.c_str());
+  vtkNew<vtkMBTilesTileStore> checkStore;
+  bool ok =
+    checkStore->Open(checkFile) && TestReadWrite(checkStore.GetPointer());
+  checkStore->Close();
+  ok = ok && TestTmsRow(checkFile);
+  remove(checkFile.c_str());
+  if (!ok)
+  {
+    return EXIT_FAILURE;
+  }
+
+  vtkNew<vtkMBTilesTileStore> store;
+  if (!store->Open(argv[1]))
+  {
+    return EXIT_FAILURE;
+  }
+
+  vtkNew<vtkMap> map;
+
+  vtkNew<vtkRenderer> renderer;
+  map->SetRenderer(renderer.GetPointer());
+  map->SetCenter(0.0, 0.0);
+  map->SetZoom(1);
+
+  vtkNew<vtkMultiThreadedOsmLayer> osmLayer;
+  map->AddLayer(osmLayer.GetPointer());
+  osmLayer->SetTileStore(store.GetPointer());
+
+  vtkNew<vtkRenderWindow> renderWindow;
+  renderWindow->AddRenderer(renderer.GetPointer());
+  renderWindow->SetSize(500, 500);
+
+  vtkNew<vtkRenderWindowInteractor> interactor;
+  interactor->SetRenderWindow(renderWindow.GetPointer());
+  map->SetInteractor(interactor.GetPointer());
+  interactor->Initialize();
+  map->Draw();
+
+  interactor->Start();
+
+  return EXIT_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMBTilesTileStore(argc, argv);
+}
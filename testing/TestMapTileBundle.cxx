@@ -0,0 +1,237 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileBundle.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileBundle.h"
+
+#include <vtkNew.h>
+#include <vtksys/SystemTools.hxx>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Writes a file, creating its directory
+bool WriteFile(const std::string& path, const std::vector<unsigned char>& data)
+{
+  vtksys::SystemTools::MakeDirectory(
+    vtksys::SystemTools::GetFilenamePath(path));
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(data.data()), data.size());
+  out.close();
+  if (!out)
+  {
+    std::cerr << "Cannot write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+std::vector<unsigned char> ReadFile(const std::string& path)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  return std::vector<unsigned char>(
+    std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+//----------------------------------------------------------------------------
+// Image of a tile, with a png or jpeg signature and seed as content
+std::vector<unsigned char> MakeImage(bool png, int seed)
+{
+  std::vector<unsigned char> data;
+  if (png)
+  {
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n',
+      0x1a, '\n' };
+    data.assign(signature, signature + 8);
+  }
+  else
+  {
+    data.push_back(0xff);
+    data.push_back(0xd8);
+  }
+  for (int i = 0; i < 50 + seed; ++i)
+  {
+    data.push_back(static_cast<unsigned char>(seed + i));
+  }
+  if (!png)
+  {
+    data.push_back(0xff);
+    data.push_back(0xd9);
+  }
+  return data;
+}
+
+//----------------------------------------------------------------------------
+// A tile of the bundle, and its image
+struct Tile
+{
+  int Zoom;
+  int X;
+  int Y;
+  std::vector<unsigned char> Data;
+};
+
+//----------------------------------------------------------------------------
+// Checks that Pack() writes the tile images of a cache directory in
+// mixed layouts, skipping other files, and that they are read back from
+// the bundle
+bool TestPack(const std::string& dir, const std::string& fileName)
+{
+  std::vector<Tile> tiles(3);
+  tiles[0] = { 3, 1, 2, MakeImage(true, 1) };
+  tiles[1] = { 5, 10, 7, MakeImage(false, 2) };
+  tiles[2] = { 4, 3, 3, MakeImage(true, 3) };
+  std::string cache = dir + "/cache";
+  bool ok = WriteFile(cache + "/3-1-2.png", tiles[0].Data) && // flat
+    WriteFile(cache + "/5/10/7.jpg", tiles[1].Data) &&      // sharded
+    WriteFile(cache + "/ab/cd/4-3-3.png", tiles[2].Data);   // hashed
+
+  // Invalid image, tile that is not an image, and file that is not a tile
+  std::string text = "not an image";
+  std::vector<unsigned char> textData(text.begin(), text.end());
+  ok = ok && WriteFile(cache + "/2/1/1.png", textData) &&
+    WriteFile(cache + "/2-0-0.txt", tiles[0].Data) &&
+    WriteFile(cache + "/index.txt", textData);
+  if (!ok)
+  {
+    return false;
+  }
+
+  vtkNew<vtkMapTileBundle> bundle;
+  if (!vtkMapTileBundle::Pack(cache, fileName) || !bundle->Open(fileName))
+  {
+    std::cerr << "Cannot pack " << cache << " into " << fileName
+              << std::endl;
+    return false;
+  }
+  if (bundle->GetNumberOfTiles() != tiles.size())
+  {
+    std::cerr << bundle->GetNumberOfTiles() << " tiles in the bundle"
+              << std::endl;
+    return false;
+  }
+
+  for (std::size_t i = 0; i < tiles.size(); ++i)
+  {
+    const Tile& tile = tiles[i];
+    std::vector<unsigned char> data;
+    if (!bundle->HasTile(tile.Zoom, tile.X, tile.Y) ||
+      !bundle->ReadTile(tile.Zoom, tile.X, tile.Y, data) || data != tile.Data)
+    {
+      std::cerr << "Tile " << tile.Zoom << "-" << tile.X << "-" << tile.Y
+                << " read " << data.size() << " bytes, expected "
+                << tile.Data.size() << std::endl;
+      ok = false;
+    }
+  }
+
+  // Skipped files, and tiles that were never in the directory
+  std::vector<unsigned char> data;
+  std::size_t size;
+  if (bundle->HasTile(2, 1, 1) || bundle->HasTile(2, 0, 0) ||
+    bundle->HasTile(3, 2, 1) || bundle->HasTile(0, 0, 0) ||
+    bundle->ReadTile(6, 0, 0, data) || bundle->GetTileData(29, 0, 0, size) ||
+    size != 0)
+  {
+    std::cerr << "Missing tile found in the bundle" << std::endl;
+    ok = false;
+  }
+  if (bundle->WriteTile(6, 0, 0, tiles[0].Data))
+  {
+    std::cerr << "Tile written to a read-only bundle" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that Open() fails on files that are not valid bundles, leaving
+// the bundle closed
+bool TestInvalidBundle(const std::string& dir, const std::string& fileName)
+{
+  std::vector<unsigned char> valid = ReadFile(fileName);
+  if (valid.size() < 40)
+  {
+    std::cerr << "Bundle of " << valid.size() << " bytes" << std::endl;
+    return false;
+  }
+
+  // Header and part of the index
+  std::vector<unsigned char> truncated(valid.begin(), valid.begin() + 40);
+  std::vector<unsigned char> badMagic = valid;
+  badMagic[0] = 'X';
+  std::vector<unsigned char> noHeader(valid.begin(), valid.begin() + 7);
+  std::vector<std::vector<unsigned char> > files;
+  files.push_back(truncated);
+  files.push_back(badMagic);
+  files.push_back(noHeader);
+  files.push_back(std::vector<unsigned char>());
+
+  vtkNew<vtkMapTileBundle> bundle;
+  bool ok = true;
+  for (std::size_t i = 0; i <= files.size(); ++i)
+  {
+    // The last file does not exist
+    std::string path = dir + "/invalid.bundle";
+    if (i < files.size() && !WriteFile(path, files[i]))
+    {
+      return false;
+    }
+    if (i == files.size())
+    {
+      vtksys::SystemTools::RemoveFile(path);
+    }
+
+    // A valid bundle is closed by the failed Open()
+    if (!bundle->Open(fileName))
+    {
+      std::cerr << "Cannot open " << fileName << std::endl;
+      return false;
+    }
+    if (bundle->Open(path) || bundle->IsOpen() ||
+      bundle->GetNumberOfTiles() != 0 || bundle->HasTile(3, 1, 2))
+    {
+      std::cerr << "Invalid bundle " << i << " opened" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileBundle(int argc, char* argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : "TestMapTileBundle.dir";
+  vtksys::SystemTools::RemoveADirectory(dir);
+  vtksys::SystemTools::MakeDirectory(dir);
+
+  std::string fileName = dir + "/tiles.bundle";
+  bool ok = TestPack(dir, fileName);
+  ok = ok && TestInvalidBundle(dir, fileName);
+
+  vtksys::SystemTools::RemoveADirectory(dir);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileBundle(argc, argv);
+}
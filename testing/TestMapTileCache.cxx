@@ -0,0 +1,253 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileCache.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTile.h"
+#include "vtkMapTileCache.h"
+#include "vtkMapTilePool.h"
+
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Adds count tiles of zoom level 4, at x = first, first + 1, ..., the last
+// one most recently used. Tiles have no image, so that each one counts for
+// TileOverhead. The cache holds the only reference to them.
+std::vector<vtkMapTile*> AddTiles(vtkMapTileCache* cache, int first, int count)
+{
+  std::vector<vtkMapTile*> tiles;
+  for (int x = first; x < first + count; ++x)
+  {
+    vtkSmartPointer<vtkMapTile> tile = vtkSmartPointer<vtkMapTile>::New();
+    cache->AddTile(4, x, 0, tile);
+    tiles.push_back(tile);
+  }
+  return tiles;
+}
+
+//----------------------------------------------------------------------------
+// Checks which of the tiles at x = 0, 1, ..., count - 1 are cached
+bool CheckCached(vtkMapTileCache* cache, int count, const std::vector<int>& xs,
+  const char* test)
+{
+  bool ok = cache->GetNumberOfTiles() == xs.size();
+  for (int x = 0; x < count; ++x)
+  {
+    bool expected = std::find(xs.begin(), xs.end(), x) != xs.end();
+    if ((cache->FindTile(4, x, 0) != nullptr) != expected)
+    {
+      std::cerr << test << ": tile " << x
+                << (expected ? " evicted" : " not evicted") << std::endl;
+      ok = false;
+    }
+  }
+  if (!ok)
+  {
+    std::cerr << test << ": " << cache->GetNumberOfTiles() << " tiles cached"
+              << std::endl;
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that GetTile() marks a tile as recently used and FindTile() does
+// not, and that Trim() evicts the least recently used tiles
+bool TestRecentlyUsed(vtkMapTileCache* cache)
+{
+  cache->SetTileOverhead(100);
+  cache->SetMemoryLimit(300);
+  std::vector<vtkMapTile*> tiles = AddTiles(cache, 0, 3);
+  if (cache->GetTile(4, 0, 0) != tiles[0] ||
+    cache->FindTile(4, 1, 0) != tiles[1] || cache->GetTile(4, 9, 0))
+  {
+    std::cerr << "Wrong tiles found" << std::endl;
+    return false;
+  }
+
+  // From the least recently used: 1, 2, 0, 3, 4
+  AddTiles(cache, 3, 2);
+  cache->Trim();
+  if (!CheckCached(cache, 5, { 0, 3, 4 }, "TestRecentlyUsed"))
+  {
+    return false;
+  }
+  if (cache->GetMemorySize() != 300)
+  {
+    std::cerr << "Memory size " << cache->GetMemorySize() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the memory size counts TileOverhead for each tile, and that
+// Trim() evicts tiles until it fits MemoryLimit, unless it is 0
+bool TestMemoryLimit(vtkMapTileCache* cache)
+{
+  cache->SetTileOverhead(1000);
+  cache->SetMemoryLimit(0);
+  AddTiles(cache, 0, 5);
+  cache->Trim();
+  if (cache->GetNumberOfTiles() != 5 || cache->GetMemorySize() != 5000)
+  {
+    std::cerr << cache->GetNumberOfTiles() << " tiles of "
+              << cache->GetMemorySize() << " bytes without limit"
+              << std::endl;
+    return false;
+  }
+
+  cache->SetMemoryLimit(2500);
+  cache->Trim();
+  if (!CheckCached(cache, 5, { 3, 4 }, "TestMemoryLimit"))
+  {
+    return false;
+  }
+  if (cache->GetMemorySize() != 2000)
+  {
+    std::cerr << "Memory size " << cache->GetMemorySize() << std::endl;
+    return false;
+  }
+
+  cache->Clear();
+  if (cache->GetNumberOfTiles() != 0 || cache->GetMemorySize() != 0)
+  {
+    std::cerr << "Cleared cache not empty" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that pinned tiles are not evicted, even if the cache remains over
+// its budget
+bool TestPinnedTiles(vtkMapTileCache* cache)
+{
+  cache->SetTileOverhead(100);
+  cache->SetMemoryLimit(200);
+  std::vector<vtkMapTile*> tiles = AddTiles(cache, 0, 4);
+  std::vector<vtkSmartPointer<vtkMapTile> > pinned;
+  pinned.push_back(tiles[0]);
+  pinned.push_back(tiles[1]);
+  pinned.push_back(tiles[3]);
+  cache->SetPinnedTiles(pinned);
+  cache->Trim();
+  if (!CheckCached(cache, 4, { 0, 1, 3 }, "TestPinnedTiles"))
+  {
+    return false;
+  }
+  if (cache->GetMemorySize() != 300)
+  {
+    std::cerr << "Memory size " << cache->GetMemorySize() << std::endl;
+    return false;
+  }
+
+  // Unpinned tiles are evicted again
+  pinned.resize(1);
+  cache->SetPinnedTiles(pinned);
+  cache->Trim();
+  return CheckCached(cache, 4, { 0, 3 }, "TestPinnedTiles");
+}
+
+//----------------------------------------------------------------------------
+// Checks that adding a tile with the indices of a cached one replaces its
+// entry, its size, and makes it the most recently used
+bool TestReplaceTile(vtkMapTileCache* cache)
+{
+  cache->SetTileOverhead(100);
+  cache->SetMemoryLimit(0);
+  AddTiles(cache, 0, 2);
+
+  cache->SetTileOverhead(250);
+  std::vector<vtkMapTile*> tiles = AddTiles(cache, 0, 1);
+  if (cache->GetNumberOfTiles() != 2 || cache->GetMemorySize() != 350 ||
+    cache->FindTile(4, 0, 0) != tiles[0])
+  {
+    std::cerr << "Replaced tile: " << cache->GetNumberOfTiles()
+              << " tiles of " << cache->GetMemorySize() << " bytes"
+              << std::endl;
+    return false;
+  }
+
+  cache->SetMemoryLimit(300);
+  cache->Trim();
+  return CheckCached(cache, 2, { 0 }, "TestReplaceTile");
+}
+
+//----------------------------------------------------------------------------
+// Checks that evicted tiles are released to the tile pool, and handed out
+// again by it
+bool TestTilePool(vtkMapTileCache* cache)
+{
+  vtkNew<vtkMapTilePool> pool;
+  pool->SetMaxSize(10);
+  cache->SetTilePool(pool.GetPointer());
+  cache->SetTileOverhead(100);
+  cache->SetMemoryLimit(200);
+  std::vector<vtkMapTile*> tiles = AddTiles(cache, 0, 5);
+  cache->Trim();
+  if (pool->GetNumberOfTiles() != 3)
+  {
+    std::cerr << pool->GetNumberOfTiles() << " tiles released to the pool"
+              << std::endl;
+    return false;
+  }
+
+  vtkSmartPointer<vtkMapTile> tile = pool->NewTile();
+  if (std::find(tiles.begin(), tiles.begin() + 3, tile.GetPointer()) ==
+    tiles.begin() + 3)
+  {
+    std::cerr << "Evicted tile not reused" << std::endl;
+    return false;
+  }
+  cache->SetTilePool(nullptr);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileCache(int, char* [])
+{
+  bool ok = true;
+  {
+    vtkNew<vtkMapTileCache> cache;
+    ok = TestRecentlyUsed(cache.GetPointer()) && ok;
+  }
+  {
+    vtkNew<vtkMapTileCache> cache;
+    ok = TestMemoryLimit(cache.GetPointer()) && ok;
+  }
+  {
+    vtkNew<vtkMapTileCache> cache;
+    ok = TestPinnedTiles(cache.GetPointer()) && ok;
+  }
+  {
+    vtkNew<vtkMapTileCache> cache;
+    ok = TestReplaceTile(cache.GetPointer()) && ok;
+  }
+  {
+    vtkNew<vtkMapTileCache> cache;
+    ok = TestTilePool(cache.GetPointer()) && ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileCache(argc, argv);
+}
@@ -0,0 +1,121 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileCoverage.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileCoverage.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+typedef vtkMapTileCoverage::Ring Ring;
+
+//----------------------------------------------------------------------------
+// Checks that tiles holds exactly the tiles of the column and row ranges
+// at zoom, given as first and last column, first and last row
+bool CheckTiles(const char* name, std::vector<vtkTypeUInt64> tiles, int zoom,
+  const std::vector<int>& ranges)
+{
+  std::vector<vtkTypeUInt64> expected;
+  for (std::size_t i = 0; i + 3 < ranges.size(); i += 4)
+  {
+    for (int y = ranges[i + 2]; y <= ranges[i + 3]; ++y)
+    {
+      for (int x = ranges[i]; x <= ranges[i + 1]; ++x)
+      {
+        expected.push_back(vtkMapTileKey::Make(zoom, x, y));
+      }
+    }
+  }
+  std::sort(expected.begin(), expected.end());
+  std::sort(tiles.begin(), tiles.end());
+  if (tiles != expected)
+  {
+    std::cerr << name << ": " << tiles.size() << " tiles, expected "
+              << expected.size() << std::endl;
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+      std::cerr << "  " << vtkMapTileKey::X(tiles[i]) << ", "
+                << vtkMapTileKey::Y(tiles[i]) << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool TestBoundingBox()
+{
+  std::vector<Ring> rings;
+  std::vector<vtkTypeUInt64> tiles;
+  bool ok = true;
+
+  // Whole world, latitudes clamped to the Mercator limit
+  vtkMapTileCoverage::AddBoundingBox(-90.0, -180.0, 90.0, 180.0, rings);
+  vtkMapTileCoverage::AddCoveringTiles(rings, 2, tiles);
+  ok = CheckTiles("World", tiles, 2, { 0, 3, 0, 3 }) && ok;
+
+  // Box inside tile (3, 4, 2) (lon 0 to 45, lat 41 to 66.5)
+  rings.clear();
+  tiles.clear();
+  vtkMapTileCoverage::AddBoundingBox(45.0, 10.0, 50.0, 20.0, rings);
+  vtkMapTileCoverage::AddCoveringTiles(rings, 3, tiles);
+  ok = CheckTiles("Small box", tiles, 3, { 4, 4, 2, 2 }) && ok;
+
+  // Crossing the antimeridian: last and first columns only
+  rings.clear();
+  tiles.clear();
+  vtkMapTileCoverage::AddBoundingBox(-10.0, 170.0, 10.0, -170.0, rings);
+  if (rings.size() != 2)
+  {
+    std::cerr << "Antimeridian box not split" << std::endl;
+    return false;
+  }
+  vtkMapTileCoverage::AddCoveringTiles(rings, 3, tiles);
+  ok = CheckTiles("Antimeridian", tiles, 3, { 7, 7, 3, 4, 0, 0, 3, 4 }) &&
+    ok;
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that an inner ring is a hole: tiles entirely inside it are not
+// covered, tiles crossed by its boundary are
+bool TestHole()
+{
+  std::vector<Ring> rings;
+  std::vector<vtkTypeUInt64> tiles;
+  vtkMapTileCoverage::AddBoundingBox(-80.0, -180.0, 80.0, 180.0, rings);
+  vtkMapTileCoverage::AddBoundingBox(-60.0, -134.0, 60.0, 134.0, rings);
+  vtkMapTileCoverage::AddCoveringTiles(rings, 3, tiles);
+
+  // The hole spans columns 1.02 to 6.98 and rows 2.32 to 5.68
+  std::vector<int> ranges = { 0, 7, 0, 2, 0, 1, 3, 4, 6, 7, 3, 4, 0, 7, 5,
+    7 };
+  return CheckTiles("Hole", tiles, 3, ranges);
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileCoverage(int, char* [])
+{
+  bool ok = TestBoundingBox();
+  ok = TestHole() && ok;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileCoverage(argc, argv);
+}
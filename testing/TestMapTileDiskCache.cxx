@@ -0,0 +1,520 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileDiskCache.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileDiskCache.h"
+#include "vtkMapTileKey.h"
+
+#include <vtkNew.h>
+#include <vtksys/Directory.hxx>
+#include <vtksys/SystemTools.hxx>
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+//----------------------------------------------------------------------------
+// Checks that the retry delay of a tile doubles with each consecutive
+// failure, from MinRetryDelay up to MaxRetryDelay.
+bool TestRetryDelay(vtkMapTileDiskCache* cache)
+{
+  const vtkTypeInt64 expected[] = { 100, 200, 300, 300 };
+  vtkTypeUInt64 key = vtkMapTileKey::Make(4, 3, 2);
+  cache->SetMinRetryDelay(100);
+  cache->SetMaxRetryDelay(300);
+  for (int i = 0; i < 4; ++i)
+  {
+    vtkTypeInt64 before = static_cast<vtkTypeInt64>(time(nullptr));
+    cache->AddFailure(key);
+    vtkTypeInt64 after = static_cast<vtkTypeInt64>(time(nullptr));
+    vtkTypeInt64 retryTime = cache->GetRetryTime(key);
+    if (retryTime < before + expected[i] || retryTime > after + expected[i])
+    {
+      std::cerr << "Failure " << i + 1 << " retries after "
+                << retryTime - before << "s, expected " << expected[i] << "s"
+                << std::endl;
+      return false;
+    }
+  }
+  if (!cache->IsFailed(key))
+  {
+    std::cerr << "Failed tile is not reported" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that failures (F records) and their removal (C records) are
+// replayed from the index journal by another instance.
+bool TestFailureJournal(vtkMapTileDiskCache* cache, const std::string& dir)
+{
+  vtkTypeUInt64 failed = vtkMapTileKey::Make(4, 3, 2);
+  vtkTypeUInt64 cleared = vtkMapTileKey::Make(5, 6, 7);
+  cache->AddFailure(cleared);
+  cache->RemoveFailure(cleared);
+
+  vtkNew<vtkMapTileDiskCache> reloaded;
+  reloaded->SetDirectory(dir);
+  if (reloaded->GetRetryTime(failed) != cache->GetRetryTime(failed) ||
+    !reloaded->IsFailed(failed))
+  {
+    std::cerr << "Failure record not reloaded" << std::endl;
+    return false;
+  }
+  if (reloaded->GetRetryTime(cleared) != 0 || reloaded->IsFailed(cleared))
+  {
+    std::cerr << "Cleared failure reloaded" << std::endl;
+    return false;
+  }
+
+  // The count is reloaded too: the next failure doubles the delay again
+  vtkTypeInt64 now = static_cast<vtkTypeInt64>(time(nullptr));
+  reloaded->SetMinRetryDelay(100);
+  reloaded->SetMaxRetryDelay(1000);
+  reloaded->AddFailure(failed);
+  if (reloaded->GetRetryTime(failed) < now + 800)
+  {
+    std::cerr << "Failure count not reloaded" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Lines of the index file of dir
+std::vector<std::string> ReadIndex(const std::string& dir)
+{
+  std::vector<std::string> lines;
+  std::ifstream in(
+    (dir + "/" + vtkMapTileDiskCache::IndexFileName()).c_str());
+  std::string line;
+  while (std::getline(in, line))
+  {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the records of a journal (A, M, H, R, F and C) are replayed
+// when the directory is opened, and that the index is then compacted into
+// a snapshot of the remaining entries and failures.
+bool TestJournalReplay(const std::string& dir)
+{
+  vtksys::SystemTools::MakeDirectory(dir);
+  vtkNew<vtkMapTileDiskCache> cache; // default layout
+  vtkTypeUInt64 keys[6];
+  std::string names[6];
+  for (int i = 0; i < 6; ++i)
+  {
+    keys[i] = vtkMapTileKey::Make(6, i, 2 * i);
+    names[i] = cache->MakeFileName(keys[i], "png");
+    if (i < 3)
+    {
+      // Files of 5, 6 and 7 bytes
+      std::string path = dir + "/" + names[i];
+      vtksys::SystemTools::MakeDirectory(
+        vtksys::SystemTools::GetFilenamePath(path));
+      std::ofstream file(path.c_str(), std::ios::binary);
+      file << std::string(5 + i, 'x');
+    }
+  }
+
+  vtkTypeInt64 retryTime = static_cast<vtkTypeInt64>(time(nullptr)) + 1000;
+  {
+    std::ofstream index(
+      (dir + "/" + vtkMapTileDiskCache::IndexFileName()).c_str(),
+      std::ios::binary);
+    index << "V journal\n"
+          << "A " << keys[0] << " 5 1000 " << names[0] << "\n"
+          << "M " << keys[0] << " 2000 1500 W/\"a b\"\n"
+          << "H " << keys[0] << " 77\n"
+          << "A " << keys[1] << " 6 1000 " << names[1] << "\n"
+          << "H " << keys[1] << " 77\n"
+          << "A " << keys[2] << " 7 1000 " << names[2] << "\n"
+          << "R " << keys[2] << "\n"
+          << "F " << keys[3] << " 2 " << retryTime << "\n"
+          << "F " << keys[4] << " 1 " << retryTime << "\n"
+          << "C " << keys[4] << "\n"
+          // Incomplete record of a writer that was interrupted
+          << "A " << keys[5] << " 8 1000 " << names[5];
+  }
+
+  cache->SetDirectory(dir);
+  vtkMapTileDiskCache::Metadata meta;
+  std::string path;
+  bool ok = true;
+  if (cache->GetNumberOfFiles() != 2 || cache->GetSize() != 11)
+  {
+    std::cerr << "Replayed " << cache->GetNumberOfFiles() << " files of "
+              << cache->GetSize() << " bytes, expected 2 files of 11 bytes"
+              << std::endl;
+    ok = false;
+  }
+  if (!cache->FindFile(keys[0], path) || path != dir + "/" + names[0] ||
+    !cache->GetMetadata(keys[0], meta) || meta.Expires != 2000 ||
+    meta.LastModified != 1500 || meta.ETag != "W/\"a b\"")
+  {
+    std::cerr << "Entry or metadata not replayed" << std::endl;
+    ok = false;
+  }
+  if (cache->FindFile(keys[2], path) || cache->FindFile(keys[5], path))
+  {
+    std::cerr << "Removed or incomplete entry replayed" << std::endl;
+    ok = false;
+  }
+  if (!cache->IsFailed(keys[3]) || cache->GetRetryTime(keys[3]) != retryTime ||
+    cache->GetRetryTime(keys[4]) != 0)
+  {
+    std::cerr << "Failures not replayed" << std::endl;
+    ok = false;
+  }
+
+  // Snapshot: one A record by entry with its M (if any) and H records,
+  // one F record by failure
+  std::vector<std::string> lines = ReadIndex(dir);
+  std::string ops;
+  for (std::size_t i = 0; i < lines.size(); ++i)
+  {
+    ops += lines[i].substr(0, 1);
+  }
+  std::sort(ops.begin() + (ops.empty() ? 0 : 1), ops.end());
+  if (ops != "VAAFHHM" || lines[0] == "V journal")
+  {
+    std::cerr << "Index not compacted: " << ops << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the index is compacted once the journal has grown larger
+// than the index (records of rewritten files)
+bool TestJournalCompaction(const std::string& dir)
+{
+  vtksys::SystemTools::MakeDirectory(dir);
+  vtkNew<vtkMapTileDiskCache> cache;
+  cache->SetDirectory(dir);
+  vtkTypeUInt64 key = vtkMapTileKey::Make(3, 2, 1);
+  std::string path = dir + "/" + cache->MakeFileName(key, "png");
+  const std::size_t records = 1100; // and as many M records
+  for (std::size_t i = 0; i < records; ++i)
+  {
+    cache->AddFile(key, path, 10);
+  }
+
+  // Compacted by the background thread once, records appended since are
+  // kept in the journal
+  for (int i = 0; i < 100; ++i)
+  {
+    if (ReadIndex(dir).size() < records)
+    {
+      return true;
+    }
+    vtksys::SystemTools::Delay(100);
+  }
+  std::cerr << "Index of " << ReadIndex(dir).size()
+            << " lines not compacted" << std::endl;
+  return false;
+}
+
+//----------------------------------------------------------------------------
+// Checks that instances sharing a directory see each other's records
+// across snapshots, even when they write snapshots in the same second
+bool TestSharedIndex(const std::string& dir)
+{
+  vtksys::SystemTools::MakeDirectory(dir);
+  vtkNew<vtkMapTileDiskCache> first;
+  vtkNew<vtkMapTileDiskCache> second;
+  first->SetDirectory(dir);
+  second->SetDirectory(dir);
+  vtkTypeUInt64 keys[2] = { vtkMapTileKey::Make(8, 1, 2),
+    vtkMapTileKey::Make(8, 3, 4) };
+  std::string path;
+
+  // Each instance replaces the index with a snapshot in turn, finding
+  // a file changes its access time
+  second->AddFile(
+    keys[0], dir + "/" + second->MakeFileName(keys[0], "png"), 4);
+  second->FindFile(keys[0], path);
+  second->Compact();
+  if (!first->FindFile(keys[0], path))
+  {
+    std::cerr << "Entry of the other instance not found" << std::endl;
+    return false;
+  }
+  first->Compact();
+  second->AddFile(
+    keys[1], dir + "/" + second->MakeFileName(keys[1], "png"), 4);
+  if (!first->FindFile(keys[1], path))
+  {
+    std::cerr << "Entry added after a snapshot of the other instance lost"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Contents of a file, empty if it cannot be read
+std::vector<unsigned char> ReadFileData(const std::string& path)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  return std::vector<unsigned char>(
+    std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+//----------------------------------------------------------------------------
+// Returns true if path is a hard link to the same file as other. Where
+// links are not checked, returns true if both files have the same content.
+bool IsSameFile(const std::string& path, const std::string& other)
+{
+#ifdef _WIN32
+  std::vector<unsigned char> data = ReadFileData(path);
+  return !data.empty() && data == ReadFileData(other);
+#else
+  struct stat st;
+  struct stat otherSt;
+  return stat(path.c_str(), &st) == 0 && stat(other.c_str(), &otherSt) == 0 &&
+    st.st_dev == otherSt.st_dev && st.st_ino == otherSt.st_ino;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// Checks that files written with identical data are linked to the same
+// file, and their content hashes journaled (H records), that the content
+// is still found through the remaining file once the first one is
+// removed, and that other data of the same size is not linked.
+bool TestContentLinks(const std::string& dir)
+{
+  vtksys::SystemTools::MakeDirectory(dir);
+  vtkNew<vtkMapTileDiskCache> cache;
+  cache->SetDirectory(dir);
+  std::vector<unsigned char> data(300);
+  for (std::size_t i = 0; i < data.size(); ++i)
+  {
+    data[i] = static_cast<unsigned char>(i * 7);
+  }
+  std::vector<unsigned char> other = data;
+  other[150] ^= 1;
+
+  vtkTypeUInt64 keys[4];
+  std::string paths[4];
+  for (int i = 0; i < 4; ++i)
+  {
+    keys[i] = vtkMapTileKey::Make(9, i, 5);
+    paths[i] = dir + "/" + cache->MakeFileName(keys[i], "png");
+  }
+  cache->WriteFileAsync(keys[0], paths[0], data);
+  cache->WriteFileAsync(keys[1], paths[1], data);
+  cache->FlushWrites();
+  bool ok = true;
+  if (!IsSameFile(paths[1], paths[0]) || ReadFileData(paths[1]) != data)
+  {
+    std::cerr << "Identical files not linked" << std::endl;
+    ok = false;
+  }
+
+  // Both files are recorded with the same content hash
+  std::vector<std::string> hashes(2);
+  std::vector<std::string> lines = ReadIndex(dir);
+  for (std::size_t i = 0; i < lines.size(); ++i)
+  {
+    for (int j = 0; j < 2; ++j)
+    {
+      std::ostringstream prefix;
+      prefix << "H " << keys[j] << " ";
+      if (lines[i].compare(0, prefix.str().size(), prefix.str()) == 0)
+      {
+        hashes[j] = lines[i].substr(prefix.str().size());
+      }
+    }
+  }
+  if (hashes[0].empty() || hashes[0] != hashes[1])
+  {
+    std::cerr << "Content hashes not journaled: \"" << hashes[0] << "\", \""
+              << hashes[1] << "\"" << std::endl;
+    ok = false;
+  }
+
+  // The content is then found through the second file
+  cache->RemoveFile(keys[0]);
+  cache->WriteFileAsync(keys[2], paths[2], data);
+  cache->WriteFileAsync(keys[3], paths[3], other);
+  cache->FlushWrites();
+  if (vtksys::SystemTools::FileExists(paths[0].c_str(), true) ||
+    !IsSameFile(paths[2], paths[1]) || ReadFileData(paths[2]) != data)
+  {
+    std::cerr << "File not linked to the remaining identical file"
+              << std::endl;
+    ok = false;
+  }
+  if (ReadFileData(paths[3]) != other || IsSameFile(paths[3], paths[1]))
+  {
+    std::cerr << "Different file of the same size linked" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the file names made in each layout are parsed back to
+// their key
+bool TestFileNames(vtkMapTileDiskCache* cache)
+{
+  const int layouts[] = { vtkMapTileDiskCache::FlatLayout,
+    vtkMapTileDiskCache::ShardedLayout, vtkMapTileDiskCache::HashedLayout };
+  const vtkTypeUInt64 keys[] = { vtkMapTileKey::Make(0, 0, 0),
+    vtkMapTileKey::Make(5, 12, 30), vtkMapTileKey::Make(19, 524287, 1234) };
+  bool ok = true;
+  for (int i = 0; i < 3; ++i)
+  {
+    cache->SetLayout(layouts[i]);
+    for (int j = 0; j < 3; ++j)
+    {
+      std::string name = cache->MakeFileName(keys[j], "png");
+      vtkTypeUInt64 key = 0;
+      if (!vtkMapTileDiskCache::ParseFileName(name, key) || key != keys[j])
+      {
+        std::cerr << "Layout " << layouts[i] << ": " << name
+                  << " not parsed back" << std::endl;
+        ok = false;
+      }
+      vtkTypeUInt64 temp = 0;
+      if (vtkMapTileDiskCache::ParseFileName(name + ".tmp", temp))
+      {
+        std::cerr << "Temporary file " << name << ".tmp parsed" << std::endl;
+        ok = false;
+      }
+    }
+  }
+  cache->SetLayoutToSharded();
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+// Checks that files are moved to the current layout, and that the
+// directories of the previous layout are removed once emptied
+bool TestMigration(vtkMapTileDiskCache* cache, const std::string& dir)
+{
+  std::vector<vtkTypeUInt64> keys;
+  for (int i = 0; i < 8; ++i)
+  {
+    keys.push_back(vtkMapTileKey::Make(7, 3 * i, 5 + i));
+  }
+  std::vector<unsigned char> data(64, 0x5a);
+  cache->SetLayoutToSharded();
+  for (std::size_t i = 0; i < keys.size(); ++i)
+  {
+    data[0] = static_cast<unsigned char>(i); // distinct content
+    cache->WriteFileAsync(
+      keys[i], dir + "/" + cache->MakeFileName(keys[i], "png"), data);
+  }
+  cache->FlushWrites();
+
+  const int layouts[] = { vtkMapTileDiskCache::HashedLayout,
+    vtkMapTileDiskCache::FlatLayout, vtkMapTileDiskCache::ShardedLayout };
+  for (int l = 0; l < 3; ++l)
+  {
+    cache->SetLayout(layouts[l]);
+    cache->MigrateFiles(); // concurrently with the background thread
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+      std::string path;
+      std::string expected = dir + "/" + cache->MakeFileName(keys[i], "png");
+      if (!cache->FindFile(keys[i], path) || path != expected ||
+        vtksys::SystemTools::FileLength(path) != data.size())
+      {
+        std::cerr << "Layout " << layouts[l] << ": tile at " << path
+                  << ", expected " << expected << std::endl;
+        return false;
+      }
+    }
+    if (l == 0 && vtksys::SystemTools::FileIsDirectory(dir + "/7"))
+    {
+      std::cerr << "Sharded layout directory not removed" << std::endl;
+      return false;
+    }
+  }
+
+  // The hashed layout directories were removed when moving to the flat
+  // layout
+  vtksys::Directory listing;
+  listing.Load(dir);
+  for (unsigned long i = 0; i < listing.GetNumberOfFiles(); ++i)
+  {
+    std::string name = listing.GetFile(i);
+    if (name.size() == 2 && name != ".." &&
+      name.find_first_not_of("0123456789abcdef") == std::string::npos)
+    {
+      std::cerr << "Hashed layout directory " << name << " not removed"
+                << std::endl;
+      return false;
+    }
+  }
+
+  // Files are found at their new path by another instance
+  vtkNew<vtkMapTileDiskCache> reloaded;
+  reloaded->SetDirectory(dir);
+  std::string path;
+  if (!reloaded->FindFile(keys[0], path) ||
+    path != dir + "/" + cache->MakeFileName(keys[0], "png"))
+  {
+    std::cerr << "Moved file not reloaded" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileDiskCache(int argc, char* argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : "TestMapTileDiskCache.dir";
+  vtksys::SystemTools::RemoveADirectory(dir);
+  vtksys::SystemTools::MakeDirectory(dir);
+
+  bool ok = true;
+  {
+    vtkNew<vtkMapTileDiskCache> cache;
+    cache->SetDirectory(dir);
+    ok = ok && TestRetryDelay(cache.GetPointer());
+    ok = ok && TestFailureJournal(cache.GetPointer(), dir);
+    ok = TestFileNames(cache.GetPointer()) && ok;
+    ok = ok && TestMigration(cache.GetPointer(), dir);
+  }
+  ok = TestJournalReplay(dir + "/replay") && ok;
+  ok = TestJournalCompaction(dir + "/compaction") && ok;
+  ok = TestSharedIndex(dir + "/shared") && ok;
+  ok = TestContentLinks(dir + "/links") && ok;
+
+  vtksys::SystemTools::RemoveADirectory(dir);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileDiskCache(argc, argv);
+}
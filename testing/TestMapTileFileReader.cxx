@@ -0,0 +1,136 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileFileReader.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileFileReader.h"
+
+#include <vtkNew.h>
+#include <vtksys/SystemTools.hxx>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Content of test file i, of a different size for each file
+std::vector<unsigned char> MakeContent(std::size_t i)
+{
+  std::vector<unsigned char> content(100 + 37 * i);
+  for (std::size_t j = 0; j < content.size(); ++j)
+  {
+    content[j] = static_cast<unsigned char>(i + j);
+  }
+  return content;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the data of the files are read in the order of the paths,
+// over several batches (see vtkMapTileFileReader), and that the data of
+// missing and empty files are left empty.
+bool TestReadFiles(vtkMapTileFileReader* reader, const std::string& dir)
+{
+  // More files than read in a batch through io_uring (32)
+  const std::size_t numberOfFiles = 75;
+  std::vector<std::string> paths;
+  std::vector<std::vector<unsigned char> > expected;
+  for (std::size_t i = 0; i < numberOfFiles; ++i)
+  {
+    std::ostringstream path;
+    path << dir << "/" << i << ".png";
+    paths.push_back(path.str());
+    expected.push_back(std::vector<unsigned char>());
+    if (i % 10 == 3)
+    {
+      continue; // missing
+    }
+    if (i % 10 != 7) // else empty
+    {
+      expected.back() = MakeContent(i);
+    }
+    FILE* file = fopen(paths.back().c_str(), "wb");
+    if (!file ||
+      fwrite(expected.back().data(), 1, expected.back().size(), file) !=
+        expected.back().size())
+    {
+      std::cerr << "Cannot write " << paths.back() << std::endl;
+      return false;
+    }
+    fclose(file);
+  }
+
+  // In reverse order, with a file read twice
+  std::vector<std::string> reversed(paths.rbegin(), paths.rend());
+  reversed.push_back(paths[0]);
+  std::vector<std::vector<unsigned char> > contents(
+    expected.rbegin(), expected.rend());
+  contents.push_back(expected[0]);
+
+  bool ok = true;
+  for (int pass = 0; pass < 2; ++pass) // the reader is reused
+  {
+    std::vector<std::vector<unsigned char> > data(1, MakeContent(1));
+    reader->ReadFiles(reversed, data);
+    if (data.size() != contents.size())
+    {
+      std::cerr << data.size() << " files read, expected "
+                << contents.size() << std::endl;
+      return false;
+    }
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+      if (data[i] != contents[i])
+      {
+        std::cerr << "Pass " << pass << ": " << reversed[i] << " read "
+                  << data[i].size() << " bytes, expected "
+                  << contents[i].size() << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  // No files
+  std::vector<std::vector<unsigned char> > data(2);
+  reader->ReadFiles(std::vector<std::string>(), data);
+  if (!data.empty())
+  {
+    std::cerr << "Data of no files not cleared" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileFileReader(int argc, char* argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : "TestMapTileFileReader.dir";
+  vtksys::SystemTools::RemoveADirectory(dir);
+  vtksys::SystemTools::MakeDirectory(dir);
+
+  vtkNew<vtkMapTileFileReader> reader;
+  std::cout << "Reading with io_uring: " << reader->GetUseIoUring()
+            << std::endl;
+  bool ok = TestReadFiles(reader.GetPointer(), dir);
+
+  vtksys::SystemTools::RemoveADirectory(dir);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileFileReader(argc, argv);
+}
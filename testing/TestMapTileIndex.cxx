@@ -0,0 +1,203 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTileIndex.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTileIndex.h"
+#include "vtkMapTileKey.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Pseudo-random numbers, the same on every platform
+class Random
+{
+public:
+  Random()
+    : State(12345)
+  {
+  }
+
+  int Next(int max) // in [0, max)
+  {
+    this->State =
+      this->State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return int((this->State >> 33) % vtkTypeUInt64(max));
+  }
+
+private:
+  vtkTypeUInt64 State;
+};
+
+//----------------------------------------------------------------------------
+// Checks that keys are unpacked to their zoom and indices, at every zoom
+// level, and that the parent key is obtained by dropping the two lowest
+// interleaved bits
+bool TestKeys()
+{
+  Random random;
+  for (int zoom = 0; zoom <= 29; ++zoom)
+  {
+    int last = int((vtkTypeUInt64(1) << zoom) - 1);
+    std::vector<int> indices = { 0, last, last / 2 };
+    for (int i = 0; i < 8; ++i)
+    {
+      indices.push_back(random.Next(last + 1));
+    }
+    for (std::size_t i = 0; i < indices.size(); ++i)
+    {
+      for (std::size_t j = 0; j < indices.size(); ++j)
+      {
+        int x = indices[i];
+        int y = indices[j];
+        vtkTypeUInt64 key = vtkMapTileKey::Make(zoom, x, y);
+        if (key == vtkMapTileKey::Invalid() ||
+          vtkMapTileKey::Zoom(key) != zoom || vtkMapTileKey::X(key) != x ||
+          vtkMapTileKey::Y(key) != y)
+        {
+          std::cerr << "Key of " << zoom << ", " << x << ", " << y
+                    << " unpacked to " << vtkMapTileKey::Zoom(key) << ", "
+                    << vtkMapTileKey::X(key) << ", " << vtkMapTileKey::Y(key)
+                    << std::endl;
+          return false;
+        }
+
+        const vtkTypeUInt64 indexBits = (vtkTypeUInt64(1) << 58) - 1;
+        vtkTypeUInt64 parent = (vtkTypeUInt64(zoom - 1) << 58) |
+          ((key & indexBits) >> 2);
+        if (zoom > 0 && parent != vtkMapTileKey::Make(zoom - 1, x / 2, y / 2))
+        {
+          std::cerr << "Parent key of " << zoom << ", " << x << ", " << y
+                    << " is not the key without its lowest bits"
+                    << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  // Neighbouring tiles of a quad have consecutive keys
+  vtkTypeUInt64 key = vtkMapTileKey::Make(12, 2048, 1024);
+  if (vtkMapTileKey::Make(12, 2049, 1024) != key + 1 ||
+    vtkMapTileKey::Make(12, 2048, 1025) != key + 2 ||
+    vtkMapTileKey::Make(12, 2049, 1025) != key + 3)
+  {
+    std::cerr << "Keys of a quad are not consecutive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that the index matches a std::map through a series of inserts,
+// replacements and erases, across rehashes
+bool TestIndex()
+{
+  vtkMapTileIndex<int> index;
+  std::map<vtkTypeUInt64, int> expected;
+  Random random;
+  if (index.Find(vtkMapTileKey::Make(0, 0, 0)) ||
+    index.Erase(vtkMapTileKey::Make(0, 0, 0)) || !index.Empty())
+  {
+    std::cerr << "Empty index finds keys" << std::endl;
+    return false;
+  }
+
+  // Keys of a small area, so that some of them collide
+  for (int step = 0; step < 20000; ++step)
+  {
+    vtkTypeUInt64 key =
+      vtkMapTileKey::Make(10, random.Next(64), random.Next(64));
+    if (random.Next(3) == 0)
+    {
+      bool erased = index.Erase(key);
+      if (erased != (expected.erase(key) == 1))
+      {
+        std::cerr << "Step " << step << ": erase returned " << erased
+                  << std::endl;
+        return false;
+      }
+    }
+    else
+    {
+      int& value = index.Insert(key, step);
+      expected[key] = step;
+      if (value != step)
+      {
+        std::cerr << "Step " << step << ": inserted " << value << std::endl;
+        return false;
+      }
+      value = -step; // the returned reference is the stored value
+      expected[key] = -step;
+    }
+  }
+
+  if (index.Size() != expected.size())
+  {
+    std::cerr << index.Size() << " entries, expected " << expected.size()
+              << std::endl;
+    return false;
+  }
+  for (int x = 0; x < 64; ++x)
+  {
+    for (int y = 0; y < 64; ++y)
+    {
+      vtkTypeUInt64 key = vtkMapTileKey::Make(10, x, y);
+      std::map<vtkTypeUInt64, int>::const_iterator it = expected.find(key);
+      int* value = index.Find(key);
+      if ((value != nullptr) != (it != expected.end()) ||
+        (value && *value != it->second))
+      {
+        std::cerr << "Wrong value for " << x << ", " << y << std::endl;
+        return false;
+      }
+    }
+  }
+
+  std::size_t visited = 0;
+  bool ok = true;
+  index.ForEach([&](vtkTypeUInt64 key, int value) {
+    ++visited;
+    ok = ok && expected.count(key) && expected[key] == value;
+  });
+  if (!ok || visited != expected.size())
+  {
+    std::cerr << "ForEach visited " << visited << " entries" << std::endl;
+    return false;
+  }
+
+  index.Clear();
+  if (!index.Empty() || index.Contains(expected.begin()->first))
+  {
+    std::cerr << "Cleared index not empty" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTileIndex(int, char* [])
+{
+  bool ok = TestKeys();
+  ok = TestIndex() && ok;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTileIndex(argc, argv);
+}
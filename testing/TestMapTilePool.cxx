@@ -0,0 +1,127 @@
+/*=========================================================================
+
+  Program:   Visualization Toolkit
+  Module:    TestMapTilePool.cxx
+
+  Copyright (c) Ken Martin, Will Schroeder, Bill Lorensen
+  All rights reserved.
+  See Copyright.txt or http://www.kitware.com/Copyright.htm for details.
+
+   This software is distributed WITHOUT ANY WARRANTY; without even
+   the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+   PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+
+#include "vtkMapTile.h"
+#include "vtkMapTilePool.h"
+
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Checks that the pool keeps at most MaxSize tiles, and hands out the
+// tiles it keeps, last released first, before creating new ones
+bool TestMaxSize(vtkMapTilePool* pool)
+{
+  pool->SetMaxSize(3);
+  std::vector<vtkSmartPointer<vtkMapTile> > tiles;
+  for (int i = 0; i < 5; ++i)
+  {
+    tiles.push_back(pool->NewTile());
+  }
+
+  std::vector<vtkMapTile*> kept;
+  for (std::size_t i = 0; i < tiles.size(); ++i)
+  {
+    bool released = pool->ReleaseTile(tiles[i]);
+    if (released)
+    {
+      kept.push_back(tiles[i]);
+    }
+    tiles[i] = nullptr;
+    if (released != (i < 3) || pool->GetNumberOfTiles() != kept.size())
+    {
+      std::cerr << "Tile " << i << " released: " << released << ", "
+                << pool->GetNumberOfTiles() << " tiles in the pool"
+                << std::endl;
+      return false;
+    }
+  }
+
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    tiles[i] = pool->NewTile();
+    vtkMapTile* tile = tiles[i];
+    bool reused = std::find(kept.begin(), kept.end(), tile) != kept.end();
+    if (reused != (i < 3) || (reused && tile != kept[2 - i]))
+    {
+      std::cerr << "Tile " << i << " not handed out in order" << std::endl;
+      return false;
+    }
+  }
+  if (pool->GetNumberOfReusedTiles() != 3 || pool->GetNumberOfTiles() != 0)
+  {
+    std::cerr << pool->GetNumberOfReusedTiles() << " tiles reused"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Checks that tiles referenced elsewhere, e.g. still displayed, are not
+// kept, and that a pool of size 0 keeps no tiles
+bool TestReferencedTile(vtkMapTilePool* pool)
+{
+  pool->SetMaxSize(10);
+  vtkSmartPointer<vtkMapTile> tile = pool->NewTile();
+  vtkSmartPointer<vtkMapTile> other = tile;
+  if (pool->ReleaseTile(tile) || pool->GetNumberOfTiles() != 0)
+  {
+    std::cerr << "Referenced tile kept" << std::endl;
+    return false;
+  }
+  other = nullptr;
+  if (!pool->ReleaseTile(tile) || pool->GetNumberOfTiles() != 1)
+  {
+    std::cerr << "Unreferenced tile not kept" << std::endl;
+    return false;
+  }
+  pool->Clear();
+
+  pool->SetMaxSize(0);
+  tile = pool->NewTile();
+  if (pool->ReleaseTile(tile) || pool->GetNumberOfTiles() != 0)
+  {
+    std::cerr << "Tile kept by a disabled pool" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestMapTilePool(int, char* [])
+{
+  bool ok = true;
+  {
+    vtkNew<vtkMapTilePool> pool;
+    ok = TestMaxSize(pool.GetPointer()) && ok;
+  }
+  {
+    vtkNew<vtkMapTilePool> pool;
+    ok = TestReferencedTile(pool.GetPointer()) && ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+  return TestMapTilePool(argc, argv);
+}